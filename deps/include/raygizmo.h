@@ -1,6 +1,12 @@
 #ifndef RAYGIZMO_H
 #define RAYGIZMO_H
 
+// Handles under the mouse cursor are picked on the CPU by ray-casting the
+// mouse ray against the analytic handle shapes. Define RAYGIZMO_FBO_PICKING
+// to pick them on the GPU instead: the gizmo is rendered into the picking fbo
+// and the pixel under the cursor is read back (this syncs with the GPU and
+// allocates the read back buffer every update).
+
 #include "raylib.h"
 
 typedef enum RGizmoState {
@@ -19,6 +25,17 @@ typedef enum RGizmoState {
     RGIZMO_STATE_ACTIVE_PLANE,
 } RGizmoState;
 
+typedef struct RGizmoView {
+    float size;
+    float handle_draw_thickness;
+    float active_axis_draw_thickness;
+    float axis_handle_length;
+    float axis_handle_tip_length;
+    float axis_handle_tip_radius;
+    float plane_handle_offset;
+    float plane_handle_size;
+} RGizmoView;
+
 typedef struct RGizmo {
     struct {
         Vector3 translation;
@@ -26,18 +43,22 @@ typedef struct RGizmo {
         float angle;
     } update;
 
-    struct {
-        float size;
-        float handle_draw_thickness;
-        float active_axis_draw_thickness;
-        float axis_handle_length;
-        float axis_handle_tip_length;
-        float axis_handle_tip_radius;
-        float plane_handle_offset;
-        float plane_handle_size;
-    } view;
+    RGizmoView view;
 
     RGizmoState state;
+
+    // Inputs of the last handle picking. While they don't change, the
+    // picked handle is reused and the picking is skipped
+    struct {
+        bool is_valid;
+        Vector2 mouse_position;
+        int screen_width;
+        int screen_height;
+        Camera3D camera;
+        Vector3 position;
+        RGizmoView view;
+        unsigned char handle_id;
+    } picking;
 } RGizmo;
 
 void rgizmo_unload(void);
@@ -121,8 +142,17 @@ void main() { \
 ";
 #endif
 
-#define PICKING_FBO_WIDTH 512
-#define PICKING_FBO_HEIGHT 512
+// The gizmo is rendered into the single pixel under the mouse cursor only
+// (see pick_handle), so the picking read back is as small as possible
+#define PICKING_FBO_WIDTH 1
+#define PICKING_FBO_HEIGHT 1
+
+// Rotation handles are drawn by DrawCircle3D as 36 line segments
+#define N_ROT_HANDLE_SEGMENTS 36
+
+// Same threshold as in the rotation handles shader: the back half of the
+// circles is discarded
+#define ROT_HANDLE_DISCARD_DOT 0.1f
 
 #define X_AXIS \
     (Vector3) { 1.0, 0.0, 0.0 }
@@ -145,8 +175,10 @@ static Shader SHADER;
 static int SHADER_CAMERA_POSITION_LOC;
 static int SHADER_GIZMO_POSITION_LOC;
 
+#ifdef RAYGIZMO_FBO_PICKING
 static unsigned int PICKING_FBO;
 static unsigned int PICKING_TEXTURE;
+#endif
 
 typedef enum HandleId {
     HANDLE_X,
@@ -333,6 +365,303 @@ static void draw_gizmo(
     }
 }
 
+static HandleColors get_picking_colors(void) {
+    // Handle ids are encoded in the red channel
+    HandleColors colors = {
+        {(Color){ROT_HANDLE_X, 0, 0, 0},
+         (Color){ROT_HANDLE_Y, 0, 0, 0},
+         (Color){ROT_HANDLE_Z, 0, 0, 0}},
+        {(Color){AXIS_HANDLE_X, 0, 0, 0},
+         (Color){AXIS_HANDLE_Y, 0, 0, 0},
+         (Color){AXIS_HANDLE_Z, 0, 0, 0}},
+        {(Color){PLANE_HANDLE_X, 0, 0, 0},
+         (Color){PLANE_HANDLE_Y, 0, 0, 0},
+         (Color){PLANE_HANDLE_Z, 0, 0, 0}}};
+    return colors;
+}
+
+#ifdef RAYGIZMO_FBO_PICKING
+static unsigned char pick_handle(
+    RGizmo gizmo, Camera3D camera, Vector3 position
+) {
+    // -------------------------------------------------------------------
+    // Draw gizmo into the picking fbo for the mouse pixel-picking.
+    // The viewport covers the whole screen, but it's shifted so that the
+    // pixel under the mouse cursor lands into the single fbo pixel
+    int screen_width = GetScreenWidth();
+    int screen_height = GetScreenHeight();
+    Vector2 mouse_position = GetMousePosition();
+    int x = (int)Clamp(mouse_position.x, 0.0, screen_width - 1);
+    int y = (int)Clamp(
+        screen_height - 1 - mouse_position.y, 0.0, screen_height - 1
+    );
+
+    rlEnableFramebuffer(PICKING_FBO);
+    rlViewport(-x, -y, screen_width, screen_height);
+    rlClearColor(0, 0, 0, 0);
+    rlClearScreenBuffers();
+    rlDisableColorBlend();
+
+    draw_gizmo(gizmo, camera, position, get_picking_colors());
+
+    rlDisableFramebuffer();
+    rlEnableColorBlend();
+    rlViewport(0, 0, screen_width, screen_height);
+
+    // -------------------------------------------------------------------
+    // Pick the pixel under the mouse cursor
+    // (rlReadTexturePixels allocates the pixels buffer, rlgl has no other way)
+    unsigned char *pixels = (unsigned char *)rlReadTexturePixels(
+        PICKING_TEXTURE,
+        PICKING_FBO_WIDTH,
+        PICKING_FBO_HEIGHT,
+        RL_PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+    );
+    unsigned char picked_id = pixels[0];
+
+    free(pixels);
+
+    return picked_id;
+}
+#else
+static float get_ray_segment_distance(
+    Ray ray, Vector3 p0, Vector3 p1, Vector3 *segment_point
+) {
+    // Closest points of the ray (t >= 0) and the segment (s in [0, 1])
+    Vector3 d = Vector3Subtract(p1, p0);
+    Vector3 r = Vector3Subtract(ray.position, p0);
+    float a = Vector3DotProduct(ray.direction, ray.direction);
+    float b = Vector3DotProduct(ray.direction, d);
+    float c = Vector3DotProduct(ray.direction, r);
+    float e = Vector3DotProduct(d, d);
+    float f = Vector3DotProduct(d, r);
+
+    float denominator = a * e - b * b;
+    float t = denominator > EPSILON ? fmaxf((b * f - c * e) / denominator, 0.0f)
+                                    : 0.0f;
+    float s = e > EPSILON ? (b * t + f) / e : 0.0f;
+    if (s < 0.0f) {
+        s = 0.0f;
+        t = fmaxf(-c / a, 0.0f);
+    } else if (s > 1.0f) {
+        s = 1.0f;
+        t = fmaxf((b - c) / a, 0.0f);
+    }
+
+    *segment_point = Vector3Add(p0, Vector3Scale(d, s));
+    Vector3 ray_point = Vector3Add(ray.position, Vector3Scale(ray.direction, t));
+    return Vector3Distance(ray_point, *segment_point);
+}
+
+static bool check_ray_quad_collision(
+    Ray ray, Vector3 center, Vector3 normal, float half_size
+) {
+    // Quad is axis-aligned, its normal is one of the world axes
+    float denominator = Vector3DotProduct(ray.direction, normal);
+    if (fabs(denominator) < EPSILON) return false;
+
+    float t = Vector3DotProduct(Vector3Subtract(center, ray.position), normal)
+              / denominator;
+    if (t < 0.0f) return false;
+
+    Vector3 p = Vector3Add(ray.position, Vector3Scale(ray.direction, t));
+    Vector3 d = Vector3Subtract(p, center);
+    return fabs(d.x) <= half_size && fabs(d.y) <= half_size
+           && fabs(d.z) <= half_size;
+}
+
+static bool check_ray_cone_collision(
+    Ray ray, Vector3 base, Vector3 apex, float radius
+) {
+    Vector3 axis = Vector3Subtract(base, apex);
+    float height = Vector3Length(axis);
+    if (height < EPSILON) return false;
+    axis = Vector3Scale(axis, 1.0f / height);
+
+    // -------------------------------------------------------------------
+    // Lateral surface: dot(p - apex, axis)^2 = |p - apex|^2 * cos^2
+    float cos2 = (height * height) / (height * height + radius * radius);
+    Vector3 co = Vector3Subtract(ray.position, apex);
+    float dv = Vector3DotProduct(ray.direction, axis);
+    float cov = Vector3DotProduct(co, axis);
+    float a = dv * dv - cos2;
+    float b = 2.0f * (dv * cov - Vector3DotProduct(ray.direction, co) * cos2);
+    float c = cov * cov - Vector3DotProduct(co, co) * cos2;
+
+    float discriminant = b * b - 4.0f * a * c;
+    if (fabs(a) > EPSILON && discriminant >= 0.0f) {
+        float sqrt_discriminant = sqrtf(discriminant);
+        float roots[2] = {
+            (-b - sqrt_discriminant) / (2.0f * a),
+            (-b + sqrt_discriminant) / (2.0f * a)};
+        for (int i = 0; i < 2; ++i) {
+            float h = cov + roots[i] * dv;
+            if (roots[i] >= 0.0f && h >= 0.0f && h <= height) return true;
+        }
+    }
+
+    // -------------------------------------------------------------------
+    // Base disk
+    if (fabs(dv) > EPSILON) {
+        float t = (height - cov) / dv;
+        Vector3 p = Vector3Add(ray.position, Vector3Scale(ray.direction, t));
+        if (t >= 0.0f && Vector3Distance(p, base) <= radius) return true;
+    }
+
+    return false;
+}
+
+static unsigned char pick_handle(
+    RGizmo gizmo, Camera3D camera, Vector3 position
+) {
+    // Handles are ray-casted in the same order as draw_gizmo draws them
+    // into the picking fbo (without the depth test), so the last hit handle
+    // wins, exactly like the last drawn pixel does
+    HandleColors colors = get_picking_colors();
+    Ray ray = GetMouseRay(GetMousePosition(), camera);
+    float radius = gizmo.view.size * Vector3Distance(camera.position, position);
+    unsigned char picked_id = 0;
+
+    // Lines are drawn with a constant screen-space thickness, convert
+    // it to the world-space tube radius at the gizmo's distance
+    float world_per_pixel = camera.fovy / GetScreenHeight();
+    if (camera.projection == CAMERA_PERSPECTIVE) {
+        world_per_pixel = 2.0f * tanf(0.5f * DEG2RAD * camera.fovy)
+                          * Vector3Distance(camera.position, position)
+                          / GetScreenHeight();
+    }
+    float tube_radius = 0.5f * gizmo.view.handle_draw_thickness
+                        * world_per_pixel;
+
+    // ---------------------------------------------------------------
+    // Pick plane handles
+    {
+        float offset = radius * gizmo.view.plane_handle_offset;
+        float half_size = 0.5f * radius * gizmo.view.plane_handle_size;
+
+        Vector3 px = Vector3Add(position, (Vector3){0.0f, offset, offset});
+        Vector3 py = Vector3Add(position, (Vector3){offset, 0.0f, offset});
+        Vector3 pz = Vector3Add(position, (Vector3){offset, offset, 0.0f});
+
+        // Here the handle axis is the quad normal
+        Handle hx = {
+            px,
+            X_AXIS,
+            colors.plane.x,
+            Vector3DistanceSqr(px, camera.position)};
+        Handle hy = {
+            py,
+            Y_AXIS,
+            colors.plane.y,
+            Vector3DistanceSqr(py, camera.position)};
+        Handle hz = {
+            pz,
+            Z_AXIS,
+            colors.plane.z,
+            Vector3DistanceSqr(pz, camera.position)};
+        Handles handles = sort_handles(hx, hy, hz);
+
+        for (int i = 0; i < 3; ++i) {
+            Handle *h = &handles.arr[i];
+            if (check_ray_quad_collision(ray, h->position, h->axis, half_size)) {
+                picked_id = h->color.r;
+            }
+        }
+    }
+
+    // ---------------------------------------------------------------
+    // Pick rotation handles
+    {
+        // Circle bases, as they are rotated by DrawCircle3D in draw_gizmo
+        Vector3 bases[3][2] = {
+            {(Vector3){0.0f, 0.0f, -1.0f}, Y_AXIS},
+            {X_AXIS, Z_AXIS},
+            {X_AXIS, Y_AXIS}};
+        unsigned char ids[3] = {colors.rot.x.r, colors.rot.y.r, colors.rot.z.r};
+
+        for (int i = 0; i < 3; ++i) {
+            Vector3 p0 = Vector3Add(position, Vector3Scale(bases[i][1], radius));
+            for (int j = 1; j <= N_ROT_HANDLE_SEGMENTS; ++j) {
+                float angle = 2.0f * PI * j / N_ROT_HANDLE_SEGMENTS;
+                Vector3 p1 = Vector3Add(
+                    position,
+                    Vector3Add(
+                        Vector3Scale(bases[i][0], radius * sinf(angle)),
+                        Vector3Scale(bases[i][1], radius * cosf(angle))
+                    )
+                );
+
+                Vector3 p;
+                float distance = get_ray_segment_distance(ray, p0, p1, &p);
+                p0 = p1;
+                if (distance > tube_radius) continue;
+
+                Vector3 r = Vector3Normalize(Vector3Subtract(p, position));
+                Vector3 c = Vector3Normalize(Vector3Subtract(p, camera.position));
+                if (Vector3DotProduct(r, c) > ROT_HANDLE_DISCARD_DOT) continue;
+
+                picked_id = ids[i];
+                break;
+            }
+        }
+    }
+
+    // ---------------------------------------------------------------
+    // Pick axis handles
+    {
+        float length = radius * gizmo.view.axis_handle_length;
+        float tip_length = radius * gizmo.view.axis_handle_tip_length;
+        float tip_radius = radius * gizmo.view.axis_handle_tip_radius;
+
+        Vector3 px = Vector3Add(position, Vector3Scale(X_AXIS, length));
+        Vector3 py = Vector3Add(position, Vector3Scale(Y_AXIS, length));
+        Vector3 pz = Vector3Add(position, Vector3Scale(Z_AXIS, length));
+
+        Handle hx = {
+            px, X_AXIS, colors.axis.x, Vector3DistanceSqr(px, camera.position)};
+        Handle hy = {
+            py, Y_AXIS, colors.axis.y, Vector3DistanceSqr(py, camera.position)};
+        Handle hz = {
+            pz, Z_AXIS, colors.axis.z, Vector3DistanceSqr(pz, camera.position)};
+        Handles handles = sort_handles(hx, hy, hz);
+
+        for (int i = 0; i < 3; ++i) {
+            Handle *h = &handles.arr[i];
+            Vector3 tip_end = Vector3Add(
+                h->position, Vector3Scale(h->axis, tip_length)
+            );
+
+            Vector3 p;
+            bool is_line_hit = get_ray_segment_distance(
+                                   ray, position, h->position, &p
+                               )
+                               <= tube_radius;
+            if (is_line_hit
+                || check_ray_cone_collision(
+                    ray, h->position, tip_end, tip_radius
+                )) {
+                picked_id = h->color.r;
+            }
+        }
+    }
+
+    return picked_id;
+}
+#endif
+
+static bool is_picking_valid(RGizmo gizmo, Camera3D camera, Vector3 position) {
+    // Exact comparison: any change of the inputs invalidates the picking
+    Vector2 mouse_position = GetMousePosition();
+    return gizmo.picking.is_valid
+           && gizmo.picking.mouse_position.x == mouse_position.x
+           && gizmo.picking.mouse_position.y == mouse_position.y
+           && gizmo.picking.screen_width == GetScreenWidth()
+           && gizmo.picking.screen_height == GetScreenHeight()
+           && memcmp(&gizmo.picking.camera, &camera, sizeof(camera)) == 0
+           && memcmp(&gizmo.picking.position, &position, sizeof(position)) == 0
+           && memcmp(&gizmo.picking.view, &gizmo.view, sizeof(gizmo.view)) == 0;
+}
+
 static void rgizmo_load(void) {
     if (IS_LOADED) {
         TraceLog(LOG_WARNING, "RAYGIZMO: Gizmo is already loaded, skip");
@@ -345,6 +674,7 @@ static void rgizmo_load(void) {
     SHADER_CAMERA_POSITION_LOC = GetShaderLocation(SHADER, "cameraPosition");
     SHADER_GIZMO_POSITION_LOC = GetShaderLocation(SHADER, "gizmoPosition");
 
+#ifdef RAYGIZMO_FBO_PICKING
     // -------------------------------------------------------------------
     // Load picking fbo
     PICKING_FBO = rlLoadFramebuffer(PICKING_FBO_WIDTH, PICKING_FBO_HEIGHT);
@@ -373,6 +703,7 @@ static void rgizmo_load(void) {
         TraceLog(LOG_ERROR, "RAYGIZMO: Picking fbo is not complete");
         exit(1);
     }
+#endif
 
     IS_LOADED = true;
     TraceLog(LOG_INFO, "RAYGIZMO: Gizmo loaded");
@@ -385,8 +716,10 @@ void rgizmo_unload(void) {
     }
 
     UnloadShader(SHADER);
+#ifdef RAYGIZMO_FBO_PICKING
     rlUnloadFramebuffer(PICKING_FBO);
     rlUnloadTexture(PICKING_TEXTURE);
+#endif
 
     IS_LOADED = false;
     TraceLog(LOG_INFO, "RAYGIZMO: Gizmo unloaded");
@@ -413,58 +746,32 @@ void rgizmo_update(RGizmo *gizmo, Camera3D camera, Vector3 position) {
         exit(1);
     }
 
-    // -------------------------------------------------------------------
-    // Draw gizmo into the picking fbo for the mouse pixel-picking
-    rlEnableFramebuffer(PICKING_FBO);
-    rlViewport(0, 0, PICKING_FBO_WIDTH, PICKING_FBO_HEIGHT);
-    rlClearColor(0, 0, 0, 0);
-    rlClearScreenBuffers();
-    rlDisableColorBlend();
-
-    HandleColors colors = {
-        {(Color){ROT_HANDLE_X, 0, 0, 0},
-         (Color){ROT_HANDLE_Y, 0, 0, 0},
-         (Color){ROT_HANDLE_Z, 0, 0, 0}},
-        {(Color){AXIS_HANDLE_X, 0, 0, 0},
-         (Color){AXIS_HANDLE_Y, 0, 0, 0},
-         (Color){AXIS_HANDLE_Z, 0, 0, 0}},
-        {(Color){PLANE_HANDLE_X, 0, 0, 0},
-         (Color){PLANE_HANDLE_Y, 0, 0, 0},
-         (Color){PLANE_HANDLE_Z, 0, 0, 0}}};
-
-    draw_gizmo(*gizmo, camera, position, colors);
-
-    rlDisableFramebuffer();
-    rlEnableColorBlend();
-    rlViewport(0, 0, GetScreenWidth(), GetScreenHeight());
+    bool is_lmb_down = IsMouseButtonDown(0);
+    bool is_active = is_lmb_down && gizmo->state >= RGIZMO_STATE_ACTIVE;
 
     // -------------------------------------------------------------------
-    // Pick the pixel under the mouse cursor
-    Vector2 mouse_position = GetMousePosition();
-    unsigned char *pixels = (unsigned char *)rlReadTexturePixels(
-        PICKING_TEXTURE,
-        PICKING_FBO_WIDTH,
-        PICKING_FBO_HEIGHT,
-        RL_PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
-    );
-
-    float x_fract = Clamp(mouse_position.x / (float)GetScreenWidth(), 0.0, 1.0);
-    float y_fract = Clamp(
-        1.0 - (mouse_position.y / (float)GetScreenHeight()), 0.0, 1.0
-    );
-    int x = (int)(PICKING_FBO_WIDTH * x_fract);
-    int y = (int)(PICKING_FBO_HEIGHT * y_fract);
-    int idx = 4 * (y * PICKING_FBO_WIDTH + x);
-    unsigned char picked_id = pixels[idx];
-
-    free(pixels);
+    // Pick the handle under the mouse cursor. The active gizmo doesn't need
+    // it, and the idle one reuses the last picked handle until the mouse,
+    // the camera, the screen or the gizmo position changes
+    unsigned char picked_id = gizmo->picking.handle_id;
+    if (!is_active && !is_picking_valid(*gizmo, camera, position)) {
+        picked_id = pick_handle(*gizmo, camera, position);
+
+        gizmo->picking.is_valid = true;
+        gizmo->picking.mouse_position = GetMousePosition();
+        gizmo->picking.screen_width = GetScreenWidth();
+        gizmo->picking.screen_height = GetScreenHeight();
+        gizmo->picking.camera = camera;
+        gizmo->picking.position = position;
+        gizmo->picking.view = gizmo->view;
+        gizmo->picking.handle_id = picked_id;
+    }
 
     // -------------------------------------------------------------------
     // Update gizmo
     gizmo->update.angle = 0.0;
     gizmo->update.translation = Vector3Zero();
 
-    bool is_lmb_down = IsMouseButtonDown(0);
     if (!is_lmb_down) gizmo->state = RGIZMO_STATE_COLD;
 
     if (gizmo->state < RGIZMO_STATE_ACTIVE) {
@@ -0,0 +1,1150 @@
+#define _POSIX_C_SOURCE 200809L
+
+#define RAYMATH_STATIC_INLINE
+#define RAYFRUSTUM_IMPLEMENTATION
+#include "../include/rayfrustum.h"
+#include "../include/rfatlas.h"
+#include "../include/rfclusters.h"
+#include "../include/rfjobs.h"
+#include "../include/rfocclusion.h"
+#include "../include/rfpointlight.h"
+#include "../include/rfprofiler.h"
+#include "../include/rfraster.h"
+#include "../include/rfshadowbudget.h"
+#include "../include/rfunproject.h"
+#include "../include/rfvsm.h"
+#include "../include/rfzbins.h"
+
+#include "raylib.h"
+#include "raymath.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_CYCLE_COUNTER 1
+#else
+#define HAS_CYCLE_COUNTER 0
+#endif
+
+// Microbenchmarks of the frustum and cascade functions.
+//
+// Every benchmark is warmed up, then measured for a number of repetitions
+// (each repetition is a batch of calls, long enough to hide the timer
+// overhead) and the median/p99 per-call time is reported.
+//
+// Usage: ./bench [--reps N] [--json FILE] [--compare BASELINE_JSON] [--threshold PCT]
+//
+// With --compare the benchmarks are diffed against the saved --json output
+// and the process exits with 1 if any median regressed above the threshold.
+
+#define N_INPUTS 256
+#define N_BOXES 1024
+#define MIN_BATCH_NS 200000
+#define DEFAULT_N_REPS 51
+#define DEFAULT_THRESHOLD_PCT 5.0
+#define MAX_N_REPS 1024
+#define MAX_N_BASELINE_BENCHMARKS 64
+#define DEPTH_WIDTH 1920
+#define DEPTH_HEIGHT 1080
+#define SHADOW_MAP_RESOLUTION 1024
+#define N_OCCLUDERS 64
+#define N_CLUSTERS_X 16
+#define N_CLUSTERS_Y 9
+#define N_CLUSTERS_Z 24
+#define MAX_N_LIGHTS 50000
+#define MAX_N_LIGHT_INDICES (1 << 22)
+#define SHADOW_ATLAS_RESOLUTION 8192
+
+typedef struct Benchmark {
+    const char *name;
+    void (*run)(int n_calls);
+} Benchmark;
+
+typedef struct BenchmarkStats {
+    const char *name;
+    int n_calls_per_rep;
+    double median_ns;
+    double p99_ns;
+    double min_ns;
+    double median_cycles;
+} BenchmarkStats;
+
+typedef struct BaselineEntry {
+    char name[64];
+    double median_ns;
+} BaselineEntry;
+
+static FrameInput INPUTS[N_INPUTS];
+static Frustum CAMERA_FRUSTUMS[N_INPUTS];
+static FrustumsCascade CAMERA_CASCADES[N_INPUTS];
+static BoundingBox BOXES[N_BOXES];
+static unsigned short MASKS[N_BOXES];
+static FrameResult RESULT;
+static float DEPTH[DEPTH_WIDTH * DEPTH_HEIGHT];
+static Vector3 DEPTH_POINTS[DEPTH_WIDTH * DEPTH_HEIGHT];
+static JobPool POOL;
+static Vector3 BOX_TRIANGLES[3 * RASTER_N_BOX_TRIANGLES * N_BOXES];
+static DepthRaster SHADOW_MAP;
+static Frustum LIGHT_FRUSTUM;
+static OcclusionCuller OCCLUSION_CULLER;
+static ClusterGrid CLUSTER_GRID;
+static ClusterLights CLUSTER_LIGHTS;
+static ZBinLights ZBIN_LIGHTS;
+static Light LIGHTS[MAX_N_LIGHTS];
+static Frustum SPOT_FRUSTUMS[N_INPUTS];
+static Light SPOT_LIGHTS[N_INPUTS];
+static float SPOT_TILE_SIZES[N_INPUTS];
+static ShadowAtlas SHADOW_ATLAS;
+static ShadowCandidate SHADOW_CANDIDATES[N_INPUTS];
+static ShadowScheduler SHADOW_SCHEDULER;
+static VirtualShadowMap VIRTUAL_SHADOW_MAP;
+static int CLUSTER_LIGHT_IDS[MAX_N_LIGHTS];
+static int ZBIN_LIGHT_IDS[MAX_N_LIGHTS];
+static int ZBIN_LIGHT_STAMPS[MAX_N_LIGHTS];
+
+// Prevents the compiler from optimizing the benchmarked calls away
+static volatile float SINK;
+
+static unsigned long long get_cycles(void) {
+#if HAS_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// -----------------------------------------------------------------------
+// Reference implementations (the original ones) of the functions which have
+// been replaced by the faster versions. The reference ones don't fill the sides
+static Frustum reference_get_frustum_of_view_proj(Matrix view, Matrix proj) {
+    Frustum frustum = {.view = view, .proj = proj};
+    Vector3 ndc_corners[8] = {
+        {-1.0, -1.0, -1.0},
+        {-1.0, 1.0, -1.0},
+        {1.0, 1.0, -1.0},
+        {1.0, -1.0, -1.0},
+        {-1.0, -1.0, 1.0},
+        {-1.0, 1.0, 1.0},
+        {1.0, 1.0, 1.0},
+        {1.0, -1.0, 1.0}};
+    for (int i = 0; i < 8; ++i) {
+        frustum.corners[i] = Vector3Unproject(ndc_corners[i], proj, view);
+    }
+
+    return frustum;
+}
+
+static Frustum reference_get_frustum_of_directional_light(
+    Frustum camera_frustum, Vector3 light_direction
+) {
+    light_direction = Vector3Normalize(light_direction);
+    Matrix light_view = MatrixLookAt(
+        Vector3Zero(), light_direction, (Vector3){0.0, 1.0, 0.0}
+    );
+    Vector3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+    Vector3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int i = 0; i < 8; ++i) {
+        Vector3 corner = Vector3Transform(camera_frustum.corners[i], light_view);
+        min = Vector3Min(min, corner);
+        max = Vector3Max(max, corner);
+    }
+
+    Vector3 light_pos = Vector3Scale(Vector3Add(min, max), 0.5);
+    light_pos = Vector3Transform(light_pos, MatrixInvert(light_view));
+
+    light_view = MatrixLookAt(
+        light_pos, Vector3Add(light_pos, light_direction), (Vector3){0.0, 1.0, 0.0}
+    );
+    min = (Vector3){FLT_MAX, FLT_MAX, FLT_MAX};
+    max = (Vector3){-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int i = 0; i < 8; ++i) {
+        Vector3 corner = Vector3Transform(camera_frustum.corners[i], light_view);
+        min = Vector3Min(min, corner);
+        max = Vector3Max(max, corner);
+    }
+    Matrix light_proj = MatrixOrtho(min.x, max.x, min.y, max.y, min.z, max.z);
+
+    return reference_get_frustum_of_view_proj(light_view, light_proj);
+}
+
+static bool reference_is_side_separating(Vector4 side, const Vector3 corners[8]) {
+    for (int i = 0; i < 8; ++i) {
+        Vector3 p = corners[i];
+        if (side.x * p.x + side.y * p.y + side.z * p.z + side.w >= 0.0) return false;
+    }
+
+    return true;
+}
+
+static bool reference_is_axis_separating(
+    Vector3 axis, const Vector3 a[8], const Vector3 b[8]
+) {
+    float min_a = FLT_MAX, max_a = -FLT_MAX, min_b = FLT_MAX, max_b = -FLT_MAX;
+    for (int i = 0; i < 8; ++i) {
+        float da = Vector3DotProduct(axis, a[i]);
+        float db = Vector3DotProduct(axis, b[i]);
+        min_a = fminf(min_a, da);
+        max_a = fmaxf(max_a, da);
+        min_b = fminf(min_b, db);
+        max_b = fmaxf(max_b, db);
+    }
+
+    return max_a < min_b || max_b < min_a;
+}
+
+// Brute-force depth of the a and b intersection: the distance from the center
+// of its points (they are on the boundary, the center is inside) to the
+// closest side of a or b, -1 if they don't intersect
+static float get_frustums_intersection_depth(Frustum a, Frustum b) {
+    Vector3 points[MAX_N_FRUSTUMS_INTERSECTION_POINTS];
+    int n_points = get_frustums_intersection_points(a, b, points);
+    if (n_points == 0) return -1.0;
+
+    Vector3 p = Vector3Zero();
+    for (int i = 0; i < n_points; ++i) p = Vector3Add(p, points[i]);
+    p = Vector3Scale(p, 1.0 / n_points);
+
+    float depth = FLT_MAX;
+    for (int i = 0; i < 12; ++i) {
+        Vector4 s = i < 6 ? a.sides[i] : b.sides[i - 6];
+        depth = fminf(depth, s.x * p.x + s.y * p.y + s.z * p.z + s.w);
+    }
+
+    return depth;
+}
+
+static bool reference_are_frustums_intersecting(Frustum a, Frustum b) {
+    for (int i = 0; i < 6; ++i) {
+        if (reference_is_side_separating(a.sides[i], b.corners)) return false;
+        if (reference_is_side_separating(b.sides[i], a.corners)) return false;
+    }
+
+    Vector3 edges_a[6], edges_b[6];
+    Frustum frustums[2] = {a, b};
+    Vector3 *edges[2] = {edges_a, edges_b};
+    for (int k = 0; k < 2; ++k) {
+        Vector3 *c = frustums[k].corners;
+        edges[k][0] = Vector3Subtract(c[3], c[0]);
+        edges[k][1] = Vector3Subtract(c[1], c[0]);
+        for (int i = 0; i < 4; ++i) edges[k][2 + i] = Vector3Subtract(c[4 + i], c[i]);
+    }
+    for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 6; ++j) {
+            Vector3 axis = Vector3CrossProduct(edges_a[i], edges_b[j]);
+            float min_length_sqr = 1e-10 * Vector3LengthSqr(edges_a[i])
+                                   * Vector3LengthSqr(edges_b[j]);
+            if (Vector3LengthSqr(axis) <= min_length_sqr) continue;
+            if (reference_is_axis_separating(axis, a.corners, b.corners)) return false;
+        }
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------
+// Benchmarks
+static void run_get_frustum_of_camera(int n_calls) {
+    float sink = 0.0;
+    for (int i = 0; i < n_calls; ++i) {
+        FrameInput *in = &INPUTS[i % N_INPUTS];
+        Frustum f = get_frustum_of_camera(in->camera, in->aspect, 0.1, 16.0);
+        sink += f.corners[6].x;
+    }
+    SINK = sink;
+}
+
+static void run_get_frustum_of_view_proj(int n_calls) {
+    float sink = 0.0;
+    for (int i = 0; i < n_calls; ++i) {
+        Frustum *c = &CAMERA_FRUSTUMS[i % N_INPUTS];
+        Frustum f = get_frustum_of_view_proj(c->view, c->proj);
+        sink += f.corners[6].x;
+    }
+    SINK = sink;
+}
+
+static void run_reference_get_frustum_of_view_proj(int n_calls) {
+    float sink = 0.0;
+    for (int i = 0; i < n_calls; ++i) {
+        Frustum *c = &CAMERA_FRUSTUMS[i % N_INPUTS];
+        Frustum f = reference_get_frustum_of_view_proj(c->view, c->proj);
+        sink += f.corners[6].x;
+    }
+    SINK = sink;
+}
+
+static void run_get_frustum_of_directional_light(int n_calls) {
+    float sink = 0.0;
+    for (int i = 0; i < n_calls; ++i) {
+        int k = i % N_INPUTS;
+        Frustum f = get_frustum_of_directional_light(
+            CAMERA_FRUSTUMS[k], INPUTS[k].light_direction
+        );
+        sink += f.corners[6].x;
+    }
+    SINK = sink;
+}
+
+static void run_reference_get_frustum_of_directional_light(int n_calls) {
+    float sink = 0.0;
+    for (int i = 0; i < n_calls; ++i) {
+        int k = i % N_INPUTS;
+        Frustum f = reference_get_frustum_of_directional_light(
+            CAMERA_FRUSTUMS[k], INPUTS[k].light_direction
+        );
+        sink += f.corners[6].x;
+    }
+    SINK = sink;
+}
+
+static void run_get_frustums_cascade_of_camera(int n_calls) {
+    float sink = 0.0;
+    for (int i = 0; i < n_calls; ++i) {
+        FrameInput *in = &INPUTS[i % N_INPUTS];
+        FrustumsCascade c = get_frustums_cascade_of_camera(
+            in->camera, in->aspect, in->planes, in->n_planes
+        );
+        sink += c.frustums[c.n_frustums - 1].corners[6].x;
+    }
+    SINK = sink;
+}
+
+static void run_get_frustums_cascade_of_directional_light(int n_calls) {
+    float sink = 0.0;
+    for (int i = 0; i < n_calls; ++i) {
+        int k = i % N_INPUTS;
+        FrustumsCascade c = get_frustums_cascade_of_directional_light(
+            CAMERA_CASCADES[k], INPUTS[k].light_direction
+        );
+        sink += c.frustums[c.n_frustums - 1].corners[6].x;
+    }
+    SINK = sink;
+}
+
+static void run_is_box_in_frustum(int n_calls) {
+    int n_inside = 0;
+    for (int i = 0; i < n_calls; ++i) {
+        n_inside += is_box_in_frustum(
+            CAMERA_FRUSTUMS[i % N_INPUTS], BOXES[i % N_BOXES]
+        );
+    }
+    SINK = n_inside;
+}
+
+static void run_are_frustums_intersecting(int n_calls) {
+    int n_intersecting = 0;
+    for (int i = 0; i < n_calls; ++i) {
+        int k = i % N_INPUTS;
+        n_intersecting += are_frustums_intersecting(CAMERA_FRUSTUMS[k], SPOT_FRUSTUMS[k]);
+    }
+    SINK = n_intersecting;
+}
+
+static void run_reference_are_frustums_intersecting(int n_calls) {
+    int n_intersecting = 0;
+    for (int i = 0; i < n_calls; ++i) {
+        int k = i % N_INPUTS;
+        n_intersecting += reference_are_frustums_intersecting(
+            CAMERA_FRUSTUMS[k], SPOT_FRUSTUMS[k]
+        );
+    }
+    SINK = n_intersecting;
+}
+
+static void run_get_frustums_overlap_volume(int n_calls) {
+    float sink = 0.0;
+    for (int i = 0; i < n_calls; ++i) {
+        int k = i % N_INPUTS;
+        sink += get_frustums_overlap_volume(SPOT_FRUSTUMS[k], CAMERA_FRUSTUMS[k]);
+    }
+    SINK = sink;
+}
+
+static void run_cull_boxes_by_cascade(int n_calls) {
+    for (int i = 0; i < n_calls; ++i) {
+        cull_boxes_by_cascade(CAMERA_CASCADES[i % N_INPUTS], BOXES, N_BOXES, MASKS);
+    }
+    SINK = MASKS[0];
+}
+
+static void run_compute_frame_result(int n_calls) {
+    for (int i = 0; i < n_calls; ++i) {
+        compute_frame_result(INPUTS[i % N_INPUTS], BOXES, N_BOXES, &RESULT);
+    }
+    SINK = RESULT.camera_masks[0];
+}
+
+static void run_unproject_depth_image(int n_calls, JobPool *pool) {
+    DepthImage depth = {DEPTH, DEPTH_WIDTH, DEPTH_HEIGHT, DEPTH_FORMAT_FLOAT32};
+    Frustum *c = &CAMERA_FRUSTUMS[0];
+    BoundingBox bounds;
+    for (int i = 0; i < n_calls; ++i) {
+        unproject_depth_image(
+            depth, c->view, c->proj, MatrixIdentity(), DEPTH_POINTS, &bounds, pool
+        );
+    }
+    SINK = bounds.max.x;
+}
+
+static void run_unproject_depth_image_single_thread(int n_calls) {
+    run_unproject_depth_image(n_calls, NULL);
+}
+
+static void run_unproject_depth_image_pool(int n_calls) {
+    run_unproject_depth_image(n_calls, &POOL);
+}
+
+static void run_reference_unproject_depth_image(int n_calls) {
+    Frustum *c = &CAMERA_FRUSTUMS[0];
+    for (int i = 0; i < n_calls; ++i) {
+        for (int y = 0; y < DEPTH_HEIGHT; ++y) {
+            for (int x = 0; x < DEPTH_WIDTH; ++x) {
+                int idx = y * DEPTH_WIDTH + x;
+                Vector3 ndc = {
+                    (x + 0.5f) * (2.0f / DEPTH_WIDTH) - 1.0f,
+                    (y + 0.5f) * (2.0f / DEPTH_HEIGHT) - 1.0f,
+                    DEPTH[idx] * 2.0f - 1.0f};
+                DEPTH_POINTS[idx] = Vector3Unproject(ndc, c->proj, c->view);
+            }
+        }
+    }
+    SINK = DEPTH_POINTS[0].x;
+}
+
+static void run_depth_raster_render(int n_calls, JobPool *pool) {
+    for (int i = 0; i < n_calls; ++i) {
+        depth_raster_clear(&SHADOW_MAP);
+        depth_raster_render(
+            &SHADOW_MAP,
+            LIGHT_FRUSTUM.view,
+            LIGHT_FRUSTUM.proj,
+            BOX_TRIANGLES,
+            RASTER_N_BOX_TRIANGLES * N_BOXES,
+            pool
+        );
+    }
+    SINK = SHADOW_MAP.depth[0];
+}
+
+static void run_depth_raster_render_single_thread(int n_calls) {
+    run_depth_raster_render(n_calls, NULL);
+}
+
+static void run_depth_raster_render_pool(int n_calls) {
+    run_depth_raster_render(n_calls, &POOL);
+}
+
+static void run_get_frustum_of_spot_light(int n_calls) {
+    Frustum light_frustum;
+    int n_visible = 0;
+    for (int i = 0; i < n_calls; ++i) {
+        Light l = SPOT_LIGHTS[i % N_INPUTS];
+        n_visible += get_frustum_of_spot_light(
+            CAMERA_FRUSTUMS[(i / 7) % N_INPUTS],
+            l.position,
+            l.direction,
+            l.half_angle,
+            l.range,
+            &light_frustum
+        );
+    }
+    SINK = n_visible + light_frustum.corners[0].x;
+}
+
+static void run_get_point_light_faces(int n_calls) {
+    int n_faces = 0;
+    for (int i = 0; i < n_calls; ++i) {
+        Light l = SPOT_LIGHTS[i % N_INPUTS];
+        PointLightFaces faces = get_point_light_faces(
+            CAMERA_FRUSTUMS[(i / 7) % N_INPUTS], l.position, l.range
+        );
+        n_faces += __builtin_popcount(faces.mask);
+    }
+    SINK = n_faces;
+}
+
+static void run_get_shadow_tile_size(int n_calls) {
+    float sink = 0.0;
+    for (int i = 0; i < n_calls; ++i) {
+        int k = i % N_INPUTS;
+        sink += get_shadow_tile_size(CAMERA_FRUSTUMS[k], SPOT_FRUSTUMS[k], 1080);
+    }
+    SINK = sink;
+}
+
+static void run_update_shadow_atlas(int n_calls) {
+    // Every call is a frame with the slightly changed tile sizes
+    static ShadowAtlasRequest requests[N_INPUTS];
+    static int frame = 0;
+    for (int i = 0; i < n_calls; ++i, ++frame) {
+        for (int j = 0; j < N_INPUTS; ++j) {
+            float noise = 1.0 + 0.2 * sinf(0.1 * frame + j);
+            requests[j] = (ShadowAtlasRequest){j, SPOT_TILE_SIZES[j] * noise};
+        }
+        update_shadow_atlas(
+            &SHADOW_ATLAS, requests, N_INPUTS, SHADOW_ATLAS_RESOLUTION * 3LL * 1024
+        );
+    }
+    SINK = SHADOW_ATLAS.n_used_texels;
+}
+
+static void run_select_shadow_updates(int n_calls) {
+    static int selected[N_INPUTS];
+    ShadowBudget budget = {.max_n_updates = 16, .max_n_texels = 16LL * 1024 * 1024};
+    int n_selected = 0;
+    for (int i = 0; i < n_calls; ++i) {
+        n_selected += select_shadow_updates(
+            &SHADOW_SCHEDULER,
+            CAMERA_FRUSTUMS[i % N_INPUTS],
+            SHADOW_CANDIDATES,
+            N_INPUTS,
+            1080,
+            budget,
+            selected
+        );
+    }
+    SINK = n_selected;
+}
+
+static void run_mark_virtual_shadow_pages(int n_calls) {
+    DepthImage depth = {DEPTH, DEPTH_WIDTH, DEPTH_HEIGHT, DEPTH_FORMAT_FLOAT32};
+    int n_marked = 0;
+    for (int i = 0; i < n_calls; ++i) {
+        int k = i % N_INPUTS;
+        Frustum *c = &CAMERA_FRUSTUMS[k];
+        n_marked += mark_virtual_shadow_pages(
+            &VIRTUAL_SHADOW_MAP, depth, c->view, c->proj, INPUTS[0].light_direction, &POOL
+        );
+    }
+    SINK = n_marked;
+}
+
+static void run_occlusion_culling(int n_calls) {
+    int n_occluded = 0;
+    for (int i = 0; i < n_calls; ++i) {
+        int k = i % N_INPUTS;
+        cull_boxes_by_cascade(CAMERA_CASCADES[k], BOXES, N_BOXES, MASKS);
+        occlusion_culler_render(
+            &OCCLUSION_CULLER, CAMERA_FRUSTUMS[k], BOXES, MASKS, N_BOXES, &POOL
+        );
+        n_occluded += cull_boxes_by_occlusion(
+            &OCCLUSION_CULLER, BOXES, N_BOXES, MASKS, &POOL
+        );
+    }
+    SINK = n_occluded;
+}
+
+static void run_update_cluster_grid(int n_calls) {
+    // Every input has its own fovy, so the grid is rebuilt on every call
+    int n_rebuilt = 0;
+    for (int i = 0; i < n_calls; ++i) {
+        FrameInput *in = &INPUTS[i % N_INPUTS];
+        n_rebuilt += update_cluster_grid(
+            &CLUSTER_GRID, in->camera, in->aspect, 0.1, 64.0
+        );
+    }
+    SINK = n_rebuilt + CLUSTER_GRID.max_x[0];
+}
+
+static void run_assign_lights_to_clusters(int n_calls, int n_lights) {
+    FrameInput *in = &INPUTS[0];
+    Matrix view = MatrixLookAt(in->camera.position, in->camera.target, in->camera.up);
+    update_cluster_grid(&CLUSTER_GRID, in->camera, in->aspect, 0.1, 64.0);
+    for (int i = 0; i < n_calls; ++i) {
+        assign_lights_to_clusters(
+            &CLUSTER_LIGHTS, &CLUSTER_GRID, view, LIGHTS, n_lights, &POOL
+        );
+    }
+    SINK = CLUSTER_LIGHTS.n_indices;
+}
+
+static void run_assign_lights_to_clusters_1k(int n_calls) {
+    run_assign_lights_to_clusters(n_calls, 1000);
+}
+
+static void run_assign_lights_to_clusters_10k(int n_calls) {
+    run_assign_lights_to_clusters(n_calls, 10000);
+}
+
+static void run_assign_lights_to_clusters_50k(int n_calls) {
+    run_assign_lights_to_clusters(n_calls, 50000);
+}
+
+static void run_assign_lights_to_zbins(int n_calls, int n_lights) {
+    FrameInput *in = &INPUTS[0];
+    Matrix view = MatrixLookAt(in->camera.position, in->camera.target, in->camera.up);
+    update_cluster_grid(&CLUSTER_GRID, in->camera, in->aspect, 0.1, 64.0);
+    for (int i = 0; i < n_calls; ++i) {
+        assign_lights_to_zbins(
+            &ZBIN_LIGHTS, &CLUSTER_GRID, view, LIGHTS, n_lights, &POOL
+        );
+    }
+    SINK = ZBIN_LIGHTS.n_lights;
+}
+
+static void run_assign_lights_to_zbins_10k(int n_calls) {
+    run_assign_lights_to_zbins(n_calls, 10000);
+}
+
+static void run_assign_lights_to_zbins_50k(int n_calls) {
+    run_assign_lights_to_zbins(n_calls, 50000);
+}
+
+static Benchmark BENCHMARKS[] = {
+    {"get_frustum_of_camera", run_get_frustum_of_camera},
+    {"get_frustum_of_view_proj", run_get_frustum_of_view_proj},
+    {"reference/get_frustum_of_view_proj", run_reference_get_frustum_of_view_proj},
+    {"get_frustum_of_directional_light", run_get_frustum_of_directional_light},
+    {"reference/get_frustum_of_directional_light",
+     run_reference_get_frustum_of_directional_light},
+    {"get_frustums_cascade_of_camera", run_get_frustums_cascade_of_camera},
+    {"get_frustums_cascade_of_directional_light",
+     run_get_frustums_cascade_of_directional_light},
+    {"is_box_in_frustum", run_is_box_in_frustum},
+    {"are_frustums_intersecting", run_are_frustums_intersecting},
+    {"reference/are_frustums_intersecting", run_reference_are_frustums_intersecting},
+    {"get_frustums_overlap_volume/8x8x8", run_get_frustums_overlap_volume},
+    {"cull_boxes_by_cascade/1024", run_cull_boxes_by_cascade},
+    {"compute_frame_result/1024", run_compute_frame_result},
+    {"unproject_depth_image/1920x1080", run_unproject_depth_image_single_thread},
+    {"unproject_depth_image/1920x1080/pool", run_unproject_depth_image_pool},
+    {"reference/unproject_depth_image/1920x1080", run_reference_unproject_depth_image},
+    {"depth_raster_render/12288/1024x1024", run_depth_raster_render_single_thread},
+    {"depth_raster_render/12288/1024x1024/pool", run_depth_raster_render_pool},
+    {"occlusion_culling/1024/256x128/pool", run_occlusion_culling},
+    {"get_frustum_of_spot_light", run_get_frustum_of_spot_light},
+    {"get_point_light_faces", run_get_point_light_faces},
+    {"get_shadow_tile_size", run_get_shadow_tile_size},
+    {"update_shadow_atlas/256/8192", run_update_shadow_atlas},
+    {"select_shadow_updates/256/16", run_select_shadow_updates},
+    {"mark_virtual_shadow_pages/1920x1080/16k/pool", run_mark_virtual_shadow_pages},
+    {"update_cluster_grid/16x9x24", run_update_cluster_grid},
+    {"assign_lights_to_clusters/1000/16x9x24/pool", run_assign_lights_to_clusters_1k},
+    {"assign_lights_to_clusters/10000/16x9x24/pool", run_assign_lights_to_clusters_10k},
+    {"assign_lights_to_clusters/50000/16x9x24/pool", run_assign_lights_to_clusters_50k},
+    {"assign_lights_to_zbins/10000/16x9x24/pool", run_assign_lights_to_zbins_10k},
+    {"assign_lights_to_zbins/50000/16x9x24/pool", run_assign_lights_to_zbins_50k},
+};
+#define N_BENCHMARKS ((int)(sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0])))
+
+// -----------------------------------------------------------------------
+// Harness
+static void create_inputs(void) {
+    for (int i = 0; i < N_INPUTS; ++i) {
+        float t = (float)i / N_INPUTS;
+        float angle = 2.0 * PI * t;
+
+        Camera3D camera = {0};
+        camera.fovy = 30.0 + 60.0 * t;
+        camera.up = (Vector3){0.0, 1.0, 0.0};
+        camera.position = (Vector3){10.0 * cosf(angle), 3.0, 10.0 * sinf(angle)};
+        camera.target = (Vector3){0.0, 1.0, 0.0};
+        camera.projection = CAMERA_PERSPECTIVE;
+
+        Vector3 light_direction = {cosf(3.0 * angle), 1.0, sinf(3.0 * angle)};
+        INPUTS[i] = (FrameInput){
+            .camera = camera,
+            .aspect = 4.0 / 3.0,
+            .n_planes = 4,
+            .planes = {0.01, 2.0, 4.0, 16.0},
+            .light_direction = light_direction};
+        CAMERA_FRUSTUMS[i] = get_frustum_of_camera(camera, 4.0 / 3.0, 0.1, 16.0);
+        CAMERA_CASCADES[i] = get_frustums_cascade_of_camera(
+            camera, INPUTS[i].aspect, INPUTS[i].planes, INPUTS[i].n_planes
+        );
+    }
+
+    for (int i = 0; i < N_BOXES; ++i) {
+        int x = i % 32;
+        int z = i / 32;
+        Vector3 center = {-31.0 + 2.0 * x, 0.0, -31.0 + 2.0 * z};
+        BOXES[i] = (BoundingBox){
+            (Vector3){center.x - 0.3, 0.0, center.z - 0.3},
+            (Vector3){center.x + 0.3, 1.0, center.z + 0.3}};
+    }
+
+    // Box soup rendered into the shadow map of the light frustum
+    for (int i = 0; i < N_BOXES; ++i) {
+        get_box_triangles(BOXES[i], &BOX_TRIANGLES[3 * RASTER_N_BOX_TRIANGLES * i]);
+    }
+    Frustum camera_frustum = get_frustum_of_camera(
+        INPUTS[0].camera, 4.0 / 3.0, 0.1, 64.0
+    );
+    LIGHT_FRUSTUM = get_frustum_of_directional_light(
+        camera_frustum, INPUTS[0].light_direction
+    );
+    SHADOW_MAP = depth_raster_load(
+        SHADOW_MAP_RESOLUTION,
+        SHADOW_MAP_RESOLUTION,
+        RASTER_N_BOX_TRIANGLES * N_BOXES,
+        8 * RASTER_N_BOX_TRIANGLES * N_BOXES
+    );
+
+    OCCLUSION_CULLER = occlusion_culler_load(
+        OCCLUSION_DEFAULT_WIDTH, OCCLUSION_DEFAULT_HEIGHT, N_OCCLUDERS
+    );
+
+    CLUSTER_GRID = cluster_grid_load(N_CLUSTERS_X, N_CLUSTERS_Y, N_CLUSTERS_Z);
+    CLUSTER_LIGHTS = cluster_lights_load(
+        &CLUSTER_GRID, MAX_N_LIGHTS, MAX_N_LIGHT_INDICES
+    );
+    ZBIN_LIGHTS = zbin_lights_load(&CLUSTER_GRID, MAX_N_LIGHTS);
+
+    // Lights are scattered over the boxes field, every 4-th one is a spot
+    for (int i = 0; i < MAX_N_LIGHTS; ++i) {
+        float u = (float)((i * 7919LL) % MAX_N_LIGHTS) / MAX_N_LIGHTS;
+        float v = (float)((i * 104729LL) % MAX_N_LIGHTS) / MAX_N_LIGHTS;
+        Vector3 direction = {cosf(13.0 * i), -1.0, sinf(13.0 * i)};
+        LIGHTS[i] = (Light){
+            .type = i % 4 == 0 ? LIGHT_SPOT : LIGHT_POINT,
+            .position = {-32.0 + 64.0 * u, 0.5 + 2.0 * v, -32.0 + 64.0 * v * u},
+            .range = 0.5 + 2.0 * u * v,
+            .direction = Vector3Normalize(direction),
+            .half_angle = 30.0};
+    }
+
+    // Spot light frustums scattered around the cameras, some of them intersect
+    for (int i = 0; i < N_INPUTS; ++i) {
+        float angle = 2.0 * PI * i / N_INPUTS;
+        Vector3 position = {12.0 * cosf(5.0 * angle), 2.0, 12.0 * sinf(7.0 * angle)};
+        Vector3 target = {4.0 * cosf(11.0 * angle), 0.0, 4.0 * sinf(3.0 * angle)};
+        SPOT_FRUSTUMS[i] = get_frustum_of_view_proj(
+            MatrixLookAt(position, target, (Vector3){0.0, 1.0, 0.0}),
+            MatrixPerspective(0.4 * PI, 1.0, 0.05, 8.0)
+        );
+        SPOT_LIGHTS[i] = (Light){
+            .type = LIGHT_SPOT,
+            .position = position,
+            .range = 8.0,
+            .direction = Vector3Normalize(Vector3Subtract(target, position)),
+            .half_angle = 36.0};
+        SPOT_TILE_SIZES[i] = get_shadow_tile_size(
+            CAMERA_FRUSTUMS[0], SPOT_FRUSTUMS[i], 1080
+        );
+    }
+    SHADOW_ATLAS = shadow_atlas_load(SHADOW_ATLAS_RESOLUTION, 128, N_INPUTS);
+
+    for (int i = 0; i < N_INPUTS; ++i) {
+        SHADOW_CANDIDATES[i] = (ShadowCandidate){
+            .key = i,
+            .frustum = SPOT_FRUSTUMS[i],
+            .n_casters = 16 + i % 64,
+            .n_texels = 1024 * 1024};
+    }
+    SHADOW_SCHEDULER = shadow_scheduler_load(N_INPUTS, N_INPUTS);
+    VIRTUAL_SHADOW_MAP = virtual_shadow_map_load(16384, 128, 64.0, Vector3Zero());
+
+    // Smooth depth with a cleared (background) band on top
+    for (int y = 0; y < DEPTH_HEIGHT; ++y) {
+        for (int x = 0; x < DEPTH_WIDTH; ++x) {
+            float t = (float)(x + y) / (DEPTH_WIDTH + DEPTH_HEIGHT);
+            DEPTH[y * DEPTH_WIDTH + x] = y > DEPTH_HEIGHT * 0.8 ? 1.0 : 0.9 + 0.099 * t;
+        }
+    }
+
+    // Workers plus the main thread use all cores
+    int n_workers = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (n_workers < 0) n_workers = 0;
+    if (n_workers > JOB_POOL_MAX_N_WORKERS) n_workers = JOB_POOL_MAX_N_WORKERS;
+    job_pool_start(&POOL, n_workers);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static BenchmarkStats run_benchmark(Benchmark benchmark, int n_reps) {
+    // Calibrate the batch size (this also warms up caches and branch predictors)
+    int n_calls = 1;
+    while (true) {
+        long long t0 = get_time_ns();
+        benchmark.run(n_calls);
+        long long dt = get_time_ns() - t0;
+        if (dt >= MIN_BATCH_NS) break;
+        n_calls *= 2;
+    }
+    benchmark.run(n_calls);
+
+    static double ns[MAX_N_REPS];
+    static double cycles[MAX_N_REPS];
+    for (int i = 0; i < n_reps; ++i) {
+        unsigned long long c0 = get_cycles();
+        long long t0 = get_time_ns();
+        benchmark.run(n_calls);
+        long long t1 = get_time_ns();
+        unsigned long long c1 = get_cycles();
+        ns[i] = (double)(t1 - t0) / n_calls;
+        cycles[i] = (double)(c1 - c0) / n_calls;
+    }
+
+    qsort(ns, n_reps, sizeof(ns[0]), compare_doubles);
+    qsort(cycles, n_reps, sizeof(cycles[0]), compare_doubles);
+
+    int p99_idx = (int)ceil(0.99 * n_reps) - 1;
+    BenchmarkStats stats = {
+        .name = benchmark.name,
+        .n_calls_per_rep = n_calls,
+        .median_ns = ns[n_reps / 2],
+        .p99_ns = ns[p99_idx],
+        .min_ns = ns[0],
+        .median_cycles = cycles[n_reps / 2]};
+
+    return stats;
+}
+
+static void check_replacement_errors(void) {
+    // Fast replacements must give the same frustums as the reference ones
+    float max_error = 0.0;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        Frustum c = CAMERA_FRUSTUMS[i];
+        Frustum f0 = get_frustum_of_view_proj(c.view, c.proj);
+        Frustum f1 = reference_get_frustum_of_view_proj(c.view, c.proj);
+        Frustum l0 = get_frustum_of_directional_light(c, INPUTS[i].light_direction);
+        Frustum l1 = reference_get_frustum_of_directional_light(
+            c, INPUTS[i].light_direction
+        );
+        for (int j = 0; j < 8; ++j) {
+            max_error = fmaxf(max_error, Vector3Distance(f0.corners[j], f1.corners[j]));
+            max_error = fmaxf(max_error, Vector3Distance(l0.corners[j], l1.corners[j]));
+        }
+    }
+
+    // Batched unprojection must match Vector3Unproject (relative to the distance)
+    DepthImage depth = {DEPTH, DEPTH_WIDTH, DEPTH_HEIGHT, DEPTH_FORMAT_FLOAT32};
+    Frustum *c = &CAMERA_FRUSTUMS[0];
+    unproject_depth_image(
+        depth, c->view, c->proj, MatrixIdentity(), DEPTH_POINTS, NULL, &POOL
+    );
+    for (int y = 0; y < DEPTH_HEIGHT; y += 7) {
+        for (int x = 0; x < DEPTH_WIDTH; x += 5) {
+            int idx = y * DEPTH_WIDTH + x;
+            Vector3 ndc = {
+                (x + 0.5f) * (2.0f / DEPTH_WIDTH) - 1.0f,
+                (y + 0.5f) * (2.0f / DEPTH_HEIGHT) - 1.0f,
+                DEPTH[idx] * 2.0f - 1.0f};
+            Vector3 p = Vector3Unproject(ndc, c->proj, c->view);
+            float distance = Vector3Distance(p, c->corners[0]) + 1.0;
+            max_error = fmaxf(
+                max_error, Vector3Distance(p, DEPTH_POINTS[idx]) / distance
+            );
+        }
+    }
+
+    // SIMD separating axis test must agree with the scalar one
+    int n_mismatches = 0;
+    for (int i = 0; i < N_INPUTS; ++i) {
+        for (int j = 0; j < N_INPUTS; j += 8) {
+            Frustum a = CAMERA_FRUSTUMS[i], b = SPOT_FRUSTUMS[j];
+            n_mismatches += are_frustums_intersecting(a, b)
+                            != reference_are_frustums_intersecting(a, b);
+        }
+    }
+
+    // Tightened spot light frustums must contain the whole part of the cone
+    // inside the camera frustum (the cone is bounded by the square pyramid,
+    // the same as in get_frustum_of_spot_light)
+    for (int i = 0; i < N_INPUTS; ++i) {
+        for (int j = 0; j < N_INPUTS; j += 8) {
+            Frustum c = CAMERA_FRUSTUMS[i];
+            Light l = SPOT_LIGHTS[j];
+            Vector3 target = Vector3Add(l.position, l.direction);
+            float fovy = 2.0 * DEG2RAD * l.half_angle;
+            Frustum cone = get_frustum_of_view_proj(
+                MatrixLookAt(l.position, target, (Vector3){0.0, 1.0, 0.0}),
+                MatrixPerspective(fovy, 1.0, 1e-3 * l.range, l.range)
+            );
+            Vector3 points[MAX_N_FRUSTUMS_INTERSECTION_POINTS];
+            int n_points = get_frustums_intersection_points(cone, c, points);
+
+            Frustum f;
+            bool is_visible = get_frustum_of_spot_light(
+                c, l.position, l.direction, l.half_angle, l.range, &f
+            );
+            n_mismatches += is_visible != (n_points > 0);
+            if (!is_visible) continue;
+            for (int k = 0; k < n_points; ++k) {
+                for (int s = 0; s < 6; ++s) {
+                    Vector4 side = f.sides[s];
+                    Vector3 p = points[k];
+                    float d = side.x * p.x + side.y * p.y + side.z * p.z + side.w;
+                    max_error = fmaxf(max_error, -d);
+                }
+            }
+        }
+    }
+
+    // The cone above the scene, pointing up, misses all the cameras
+    for (int i = 0; i < N_INPUTS; ++i) {
+        Frustum f;
+        Vector3 position = {0.0, 100.0, 0.0};
+        Vector3 direction = {0.0, 1.0, 0.0};
+        n_mismatches += get_frustum_of_spot_light(
+            CAMERA_FRUSTUMS[i], position, direction, 36.0, 8.0, &f
+        );
+    }
+
+    // Point light faces mask must match the brute-force intersection of every
+    // full face with the camera frustum (the spot light positions are reused).
+    // Touching faces (the intersection within the side tolerance) may go
+    // either way
+    for (int i = 0; i < N_INPUTS; ++i) {
+        for (int j = 0; j < N_INPUTS; j += 8) {
+            Frustum c = CAMERA_FRUSTUMS[i];
+            Light l = SPOT_LIGHTS[j];
+            PointLightFaces faces = get_point_light_faces(c, l.position, l.range);
+            for (int k = 0; k < N_POINT_LIGHT_FACES; ++k) {
+                Vector3 target = Vector3Add(l.position, POINT_LIGHT_FACE_DIRECTIONS[k]);
+                Frustum face = get_frustum_of_view_proj(
+                    MatrixLookAt(l.position, target, POINT_LIGHT_FACE_UPS[k]),
+                    MatrixPerspective(0.5 * PI, 1.0, 1e-3 * l.range, l.range)
+                );
+                float depth = get_frustums_intersection_depth(face, c);
+                bool is_masked = (faces.mask >> k) & 1;
+                n_mismatches += is_masked ? depth == -1.0 : depth > FRUSTUM_SIDE_EPSILON;
+            }
+        }
+    }
+
+    // Z-bin lights of a view point must include all of its cluster lights (the
+    // z-bins are conservative, they may add the lights of the neighbour bins)
+    FrameInput *in = &INPUTS[0];
+    Matrix view = MatrixLookAt(in->camera.position, in->camera.target, in->camera.up);
+    update_cluster_grid(&CLUSTER_GRID, in->camera, in->aspect, 0.1, 64.0);
+    assign_lights_to_clusters(&CLUSTER_LIGHTS, &CLUSTER_GRID, view, LIGHTS, 10000, &POOL);
+    assign_lights_to_zbins(&ZBIN_LIGHTS, &CLUSTER_GRID, view, LIGHTS, 10000, &POOL);
+    float tan_y = tanf(0.5 * DEG2RAD * in->camera.fovy);
+    float tan_x = tan_y * in->aspect;
+    int stamp = 0;
+    for (int z = 0; z < 32; ++z) {
+        float depth = 0.1 * powf(640.0, (z + 0.5) / 32.0);
+        for (int y = 0; y < 16; ++y) {
+            for (int x = 0; x < 16; ++x) {
+                Vector3 point = {
+                    ((x + 0.5) / 8.0 - 1.0) * tan_x * depth,
+                    ((y + 0.5) / 8.0 - 1.0) * tan_y * depth,
+                    -depth};
+                int n_cluster = get_cluster_lights_of_view_point(
+                    &CLUSTER_LIGHTS, &CLUSTER_GRID, point, CLUSTER_LIGHT_IDS, MAX_N_LIGHTS
+                );
+                int n_zbin = get_zbin_lights_of_view_point(
+                    &ZBIN_LIGHTS, &CLUSTER_GRID, point, ZBIN_LIGHT_IDS, MAX_N_LIGHTS
+                );
+
+                stamp += 1;
+                for (int i = 0; i < n_zbin; ++i) {
+                    ZBIN_LIGHT_STAMPS[ZBIN_LIGHT_IDS[i]] = stamp;
+                }
+                for (int i = 0; i < n_cluster; ++i) {
+                    n_mismatches += ZBIN_LIGHT_STAMPS[CLUSTER_LIGHT_IDS[i]] != stamp;
+                }
+            }
+        }
+    }
+
+    // A tile which got a smaller block because of the fragmentation must stay
+    // in place while its target size is the same: fill the atlas with 16 tiles,
+    // keep one in each quadrant and request a quadrant sized tile
+    ShadowAtlas atlas = shadow_atlas_load(1024, 128, 32);
+    ShadowAtlasRequest atlas_requests[16];
+    for (int i = 0; i < 16; ++i) atlas_requests[i] = (ShadowAtlasRequest){i, 256.0};
+    update_shadow_atlas(&atlas, atlas_requests, 16, 1024 * 1024);
+    for (int i = 0; i < 4; ++i) atlas_requests[i] = (ShadowAtlasRequest){4 * i, 256.0};
+    atlas_requests[4] = (ShadowAtlasRequest){20, 512.0};
+    for (int frame = 0; frame < 4; ++frame) {
+        update_shadow_atlas(&atlas, atlas_requests, 5, 1024 * 1024);
+        for (int i = 0; i < 5 && frame > 0; ++i) {
+            n_mismatches += atlas.tiles[atlas_requests[i].key].is_new;
+        }
+    }
+    shadow_atlas_unload(&atlas);
+
+    fprintf(stderr, "max error of fast replacements: %g\n", max_error);
+    if (max_error > 1e-3 || n_mismatches > 0) {
+        fprintf(stderr, "ERROR: Fast replacements diverged from the reference ones\n");
+        exit(1);
+    }
+}
+
+static void write_json(FILE *file, BenchmarkStats *stats, int n_stats, int n_reps) {
+    fprintf(file, "{\n");
+    fprintf(file, "  \"n_reps\": %d,\n", n_reps);
+    fprintf(file, "  \"has_cycle_counter\": %s,\n", HAS_CYCLE_COUNTER ? "true" : "false");
+    fprintf(file, "  \"benchmarks\": [\n");
+    for (int i = 0; i < n_stats; ++i) {
+        BenchmarkStats s = stats[i];
+        fprintf(
+            file,
+            "    {\"name\": \"%s\", \"median_ns\": %.3f, \"p99_ns\": %.3f, "
+            "\"min_ns\": %.3f, \"median_cycles\": %.1f, \"n_calls_per_rep\": %d}%s\n",
+            s.name,
+            s.median_ns,
+            s.p99_ns,
+            s.min_ns,
+            s.median_cycles,
+            s.n_calls_per_rep,
+            i == n_stats - 1 ? "" : ","
+        );
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+}
+
+static int load_baseline(const char *file_path, BaselineEntry *entries) {
+    // Only the format written by write_json is supported: one benchmark per line
+    FILE *file = fopen(file_path, "r");
+    if (!file) {
+        fprintf(stderr, "ERROR: Failed to open baseline file %s\n", file_path);
+        exit(1);
+    }
+
+    int n_entries = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file) && n_entries < MAX_N_BASELINE_BENCHMARKS) {
+        BaselineEntry *e = &entries[n_entries];
+        if (sscanf(
+                line,
+                " {\"name\": \"%63[^\"]\", \"median_ns\": %lf",
+                e->name,
+                &e->median_ns
+            )
+            == 2) {
+            n_entries += 1;
+        }
+    }
+    fclose(file);
+
+    return n_entries;
+}
+
+static int compare_with_baseline(
+    BenchmarkStats *stats, int n_stats, const char *file_path, double threshold_pct
+) {
+    static BaselineEntry entries[MAX_N_BASELINE_BENCHMARKS];
+    int n_entries = load_baseline(file_path, entries);
+
+    int n_regressions = 0;
+    printf("\n%-44s %12s %12s %9s\n", "benchmark", "base ns", "new ns", "diff");
+    for (int i = 0; i < n_stats; ++i) {
+        BaselineEntry *e = NULL;
+        for (int j = 0; j < n_entries && !e; ++j) {
+            if (strcmp(entries[j].name, stats[i].name) == 0) e = &entries[j];
+        }
+        if (!e) {
+            printf(
+                "%-44s %12s %12.1f %9s\n", stats[i].name, "-", stats[i].median_ns, "new"
+            );
+            continue;
+        }
+
+        double diff_pct = 100.0 * (stats[i].median_ns - e->median_ns) / e->median_ns;
+        bool is_regression = diff_pct > threshold_pct;
+        n_regressions += is_regression;
+        printf(
+            "%-44s %12.1f %12.1f %+8.1f%%%s\n",
+            stats[i].name,
+            e->median_ns,
+            stats[i].median_ns,
+            diff_pct,
+            is_regression ? "  REGRESSION" : ""
+        );
+    }
+
+    return n_regressions;
+}
+
+int main(int argc, char **argv) {
+    int n_reps = DEFAULT_N_REPS;
+    double threshold_pct = DEFAULT_THRESHOLD_PCT;
+    const char *json_file_path = NULL;
+    const char *baseline_file_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--reps") == 0 && has_value) n_reps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0 && has_value) json_file_path = argv[++i];
+        else if (strcmp(argv[i], "--compare") == 0 && has_value)
+            baseline_file_path = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && has_value)
+            threshold_pct = atof(argv[++i]);
+        else {
+            fprintf(
+                stderr,
+                "Usage: %s [--reps N] [--json FILE] [--compare BASELINE_JSON] "
+                "[--threshold PCT]\n",
+                argv[0]
+            );
+            exit(1);
+        }
+    }
+
+    if (n_reps < 1 || n_reps > MAX_N_REPS) {
+        fprintf(stderr, "ERROR: Number of repetitions must be in [1, %d]\n", MAX_N_REPS);
+        exit(1);
+    }
+
+    create_inputs();
+    check_replacement_errors();
+
+    BenchmarkStats stats[N_BENCHMARKS];
+    printf(
+        "%-44s %12s %12s %12s %12s\n",
+        "benchmark",
+        "median ns",
+        "p99 ns",
+        "min ns",
+        HAS_CYCLE_COUNTER ? "cycles" : "cycles (n/a)"
+    );
+    for (int i = 0; i < N_BENCHMARKS; ++i) {
+        stats[i] = run_benchmark(BENCHMARKS[i], n_reps);
+        printf(
+            "%-44s %12.1f %12.1f %12.1f %12.0f\n",
+            stats[i].name,
+            stats[i].median_ns,
+            stats[i].p99_ns,
+            stats[i].min_ns,
+            stats[i].median_cycles
+        );
+    }
+    job_pool_stop(&POOL);
+    depth_raster_unload(&SHADOW_MAP);
+    occlusion_culler_unload(&OCCLUSION_CULLER);
+    cluster_lights_unload(&CLUSTER_LIGHTS);
+    zbin_lights_unload(&ZBIN_LIGHTS);
+    shadow_atlas_unload(&SHADOW_ATLAS);
+    shadow_scheduler_unload(&SHADOW_SCHEDULER);
+    virtual_shadow_map_unload(&VIRTUAL_SHADOW_MAP);
+    cluster_grid_unload(&CLUSTER_GRID);
+
+    if (json_file_path) {
+        FILE *file = fopen(json_file_path, "w");
+        if (!file) {
+            fprintf(stderr, "ERROR: Failed to open %s for writing\n", json_file_path);
+            exit(1);
+        }
+        write_json(file, stats, N_BENCHMARKS, n_reps);
+        fclose(file);
+    }
+
+    if (baseline_file_path) {
+        int n_regressions = compare_with_baseline(
+            stats, N_BENCHMARKS, baseline_file_path, threshold_pct
+        );
+        if (n_regressions > 0) {
+            printf(
+                "\n%d benchmark(s) regressed by more than %.1f%%\n",
+                n_regressions,
+                threshold_pct
+            );
+            return 1;
+        }
+    }
+
+    return 0;
+}
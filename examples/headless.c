@@ -0,0 +1,452 @@
+#define _POSIX_C_SOURCE 200809L
+
+#define RAYMATH_STATIC_INLINE
+#define RAYFRUSTUM_IMPLEMENTATION
+#include "../include/rayfrustum.h"
+#include "../include/rfalloc.h"
+#include "../include/rfjobs.h"
+#include "../include/rfmetrics.h"
+#include "../include/rfocclusion.h"
+#include "../include/rfprofiler.h"
+#include "../include/rfraster.h"
+#include "../include/rftrajectory.h"
+
+#include "raylib.h"
+#include "raymath.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Headless driver of the camera cascade -> light cascade -> culling pipeline.
+// No window and no GL context are created: raylib is used only for its types
+// and raymath, so this target runs on GPU-less machines.
+//
+// Frames come either from the built-in script or from the recorded trajectory
+// (--replay), and the scripted frames can be recorded too (--record).
+//
+// With --occlusion the camera-visible boxes are also culled by the software
+// occlusion culling, the largest of them being the occluders.
+//
+// With --shadow-maps the boxes (and the ground) are also rendered into the
+// depth maps of the light cascade frustums by the CPU rasterizer.
+//
+// With --cascade-metrics the texel efficiency of every light cascade frustum
+// (see ../include/rfmetrics.h) is averaged over the frames, the pixel sizes
+// are of the METRICS_SCREEN_HEIGHT screen.
+//
+// With `make headless AUDIT_ALLOCS=1` every frame is also checked to be free
+// of the heap allocations.
+//
+// Usage: ./headless [n_frames] [n_boxes] [--json] [--record FILE] [--replay FILE]
+//                   [--occlusion N_OCCLUDERS] [--shadow-maps RESOLUTION]
+//                   [--cascade-metrics RESOLUTION]
+
+#define DEFAULT_N_FRAMES 100000
+#define DEFAULT_N_BOXES 1024
+#define MAX_N_SHADOW_CASTER_TRIANGLES (MAX_N_CULLED_BOXES * RASTER_N_BOX_TRIANGLES + 2)
+#define MAX_SHADOW_MAP_RESOLUTION 4096
+#define METRICS_SCREEN_HEIGHT 1080
+
+typedef enum Stage {
+    STAGE_CAMERA_CASCADE,
+    STAGE_LIGHT_CASCADE,
+    STAGE_CULLING,
+    STAGE_OCCLUSION,
+    STAGE_SHADOW_MAPS,
+    N_STAGES
+} Stage;
+
+static const char *STAGE_NAMES[N_STAGES] = {
+    "camera_cascade", "light_cascade", "culling", "occlusion", "shadow_maps"};
+
+static BoundingBox BOXES[MAX_N_CULLED_BOXES];
+static FrameResult RESULT;
+
+static Vector3 SHADOW_CASTERS[3 * MAX_N_SHADOW_CASTER_TRIANGLES];
+static DepthRaster SHADOW_MAPS[MAX_N_FRUSTUMS_IN_CASCADE];
+static OcclusionCuller OCCLUSION_CULLER;
+static CascadeMetrics METRICS[MAX_N_FRUSTUMS_IN_CASCADE];
+static CascadeMetrics METRICS_SUMS[MAX_N_FRUSTUMS_IN_CASCADE];
+static JobPool POOL;
+
+static void create_boxes(int n_boxes);
+static int create_shadow_casters(int n_boxes);
+
+int main(int argc, char **argv) {
+    int n_frames = DEFAULT_N_FRAMES;
+    int n_boxes = DEFAULT_N_BOXES;
+    bool is_json = false;
+    const char *record_file_path = NULL;
+    const char *replay_file_path = NULL;
+    int shadow_map_resolution = 0;
+    int n_occluders = 0;
+    int metrics_resolution = 0;
+
+    int n_positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--json") == 0) is_json = true;
+        else if (strcmp(argv[i], "--record") == 0 && has_value)
+            record_file_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && has_value)
+            replay_file_path = argv[++i];
+        else if (strcmp(argv[i], "--cascade-metrics") == 0 && has_value)
+            metrics_resolution = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--occlusion") == 0 && has_value)
+            n_occluders = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--shadow-maps") == 0 && has_value)
+            shadow_map_resolution = atoi(argv[++i]);
+        else if (strncmp(argv[i], "--", 2) != 0 && n_positional < 2) {
+            if (n_positional++ == 0) n_frames = atoi(argv[i]);
+            else n_boxes = atoi(argv[i]);
+        } else {
+            fprintf(
+                stderr,
+                "Usage: %s [n_frames] [n_boxes] [--json] [--record FILE] [--replay FILE] "
+                "[--occlusion N_OCCLUDERS] [--shadow-maps RESOLUTION] "
+                "[--cascade-metrics RESOLUTION]\n",
+                argv[0]
+            );
+            exit(1);
+        }
+    }
+
+    // By default the whole recorded trajectory is replayed once
+    TrajectoryReader reader = {0};
+    if (replay_file_path) {
+        reader = trajectory_reader_open(replay_file_path);
+        if (n_positional == 0) n_frames = reader.n_frames;
+    }
+    TrajectoryWriter writer = {0};
+    if (record_file_path) writer = trajectory_writer_open(record_file_path);
+
+    if (n_frames <= 0 || n_boxes < 0 || n_boxes > MAX_N_CULLED_BOXES) {
+        fprintf(
+            stderr,
+            "ERROR: Number of frames must be > 0 and number of boxes must be in "
+            "[0, %d]\n",
+            MAX_N_CULLED_BOXES
+        );
+        exit(1);
+    }
+
+    create_boxes(n_boxes);
+
+    // Occlusion buffer and shadow maps are loaded once: the frames must not allocate
+    bool is_occlusion = n_occluders != 0;
+    if (is_occlusion) {
+        OCCLUSION_CULLER = occlusion_culler_load(
+            OCCLUSION_DEFAULT_WIDTH, OCCLUSION_DEFAULT_HEIGHT, n_occluders
+        );
+    }
+
+    bool is_shadow_maps = shadow_map_resolution != 0;
+    int n_shadow_caster_triangles = 0;
+    if (is_shadow_maps) {
+        if (shadow_map_resolution < 4 || shadow_map_resolution > MAX_SHADOW_MAP_RESOLUTION
+            || shadow_map_resolution % 4 != 0) {
+            fprintf(
+                stderr,
+                "ERROR: Shadow map resolution must be a multiple of 4 in [4, %d]\n",
+                MAX_SHADOW_MAP_RESOLUTION
+            );
+            exit(1);
+        }
+        n_shadow_caster_triangles = create_shadow_casters(n_boxes);
+        int n_tiles = (shadow_map_resolution + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        n_tiles *= n_tiles;
+        for (int i = 0; i < MAX_N_FRUSTUMS_IN_CASCADE; ++i) {
+            SHADOW_MAPS[i] = depth_raster_load(
+                shadow_map_resolution,
+                shadow_map_resolution,
+                n_shadow_caster_triangles,
+                8 * n_shadow_caster_triangles + 4 * n_tiles
+            );
+        }
+    }
+
+    // Workers plus the main thread use all cores
+    bool is_stage_enabled[N_STAGES] = {true, true, true, is_occlusion, is_shadow_maps};
+    if (is_occlusion || is_shadow_maps) {
+        int n_workers = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+        if (n_workers < 0) n_workers = 0;
+        if (n_workers > JOB_POOL_MAX_N_WORKERS) n_workers = JOB_POOL_MAX_N_WORKERS;
+        job_pool_start(&POOL, n_workers);
+    }
+
+    // -------------------------------------------------------------------
+    // Run the pipeline stage by stage (the same calls as in compute_frame_result)
+    long long stage_ns[N_STAGES] = {0};
+    long long n_visible = 0;
+    long long n_occluded = 0;
+    int n_metrics_frustums = 0;
+    long long n_shadow_map_triangles = 0;
+    for (int frame = 0; frame < n_frames; ++frame) {
+        ALLOC_AUDIT_BEGIN_FRAME();
+
+        TrajectoryFrame trajectory_frame;
+        if (replay_file_path) {
+            trajectory_frame = trajectory_reader_get_frame(reader, frame);
+        } else {
+            trajectory_frame = get_orbit_trajectory_frame(frame, n_frames);
+        }
+        if (record_file_path) trajectory_writer_push(&writer, trajectory_frame);
+        FrameInput input = get_frame_input_of_trajectory_frame(trajectory_frame);
+
+        long long t0 = get_time_ns();
+        RESULT.camera_cascade = get_frustums_cascade_of_camera(
+            input.camera, input.aspect, input.planes, input.n_planes
+        );
+
+        long long t1 = get_time_ns();
+        RESULT.light_cascade = get_frustums_cascade_of_directional_light(
+            RESULT.camera_cascade, input.light_direction
+        );
+
+        long long t2 = get_time_ns();
+        RESULT.n_boxes = n_boxes;
+        cull_boxes_by_cascade(RESULT.camera_cascade, BOXES, n_boxes, RESULT.camera_masks);
+        cull_boxes_by_cascade(RESULT.light_cascade, BOXES, n_boxes, RESULT.light_masks);
+
+        long long t3 = get_time_ns();
+        if (is_occlusion) {
+            // One frustum over all camera slices
+            Frustum camera_frustum = get_frustum_of_camera(
+                input.camera,
+                input.aspect,
+                input.planes[0],
+                input.planes[input.n_planes - 1]
+            );
+            occlusion_culler_render(
+                &OCCLUSION_CULLER,
+                camera_frustum,
+                BOXES,
+                RESULT.camera_masks,
+                n_boxes,
+                &POOL
+            );
+            n_occluded += cull_boxes_by_occlusion(
+                &OCCLUSION_CULLER, BOXES, n_boxes, RESULT.camera_masks, &POOL
+            );
+        }
+
+        long long t4 = get_time_ns();
+        if (is_shadow_maps) {
+            for (int i = 0; i < RESULT.light_cascade.n_frustums; ++i) {
+                Frustum *frustum = &RESULT.light_cascade.frustums[i];
+                depth_raster_clear(&SHADOW_MAPS[i]);
+                depth_raster_render(
+                    &SHADOW_MAPS[i],
+                    frustum->view,
+                    frustum->proj,
+                    SHADOW_CASTERS,
+                    n_shadow_caster_triangles,
+                    &POOL
+                );
+            }
+            n_shadow_map_triangles += (long long)RESULT.light_cascade.n_frustums
+                                      * n_shadow_caster_triangles;
+        }
+
+        long long t5 = get_time_ns();
+        stage_ns[STAGE_CAMERA_CASCADE] += t1 - t0;
+        stage_ns[STAGE_LIGHT_CASCADE] += t2 - t1;
+        stage_ns[STAGE_CULLING] += t3 - t2;
+        stage_ns[STAGE_OCCLUSION] += t4 - t3;
+        stage_ns[STAGE_SHADOW_MAPS] += t5 - t4;
+
+        // Metrics are not a pipeline stage, so they are not timed
+        if (metrics_resolution > 0) {
+            get_cascades_metrics(
+                RESULT.camera_cascade,
+                RESULT.light_cascade,
+                BOXES,
+                n_boxes,
+                metrics_resolution,
+                METRICS_SCREEN_HEIGHT,
+                METRICS
+            );
+            n_metrics_frustums = RESULT.light_cascade.n_frustums;
+            for (int i = 0; i < n_metrics_frustums; ++i) {
+                CascadeMetrics m = METRICS[i];
+                CascadeMetrics *sum = &METRICS_SUMS[i];
+                sum->coverage += m.coverage;
+                sum->texel_size = Vector2Add(sum->texel_size, m.texel_size);
+                sum->depth_utilization += m.depth_utilization;
+                sum->near_pixel_texel_ratio += m.near_pixel_texel_ratio;
+                sum->far_pixel_texel_ratio += m.far_pixel_texel_ratio;
+            }
+        }
+
+        // Consume the results, so the work can't be optimized away
+        for (int i = 0; i < n_boxes; ++i) n_visible += RESULT.camera_masks[i] != 0;
+
+        ALLOC_AUDIT_END_FRAME();
+    }
+
+    if (record_file_path) trajectory_writer_close(&writer);
+    if (replay_file_path) trajectory_reader_close(&reader);
+    if (is_occlusion || is_shadow_maps) job_pool_stop(&POOL);
+    if (is_occlusion) occlusion_culler_unload(&OCCLUSION_CULLER);
+    if (is_shadow_maps) {
+        for (int i = 0; i < MAX_N_FRUSTUMS_IN_CASCADE; ++i) {
+            depth_raster_unload(&SHADOW_MAPS[i]);
+        }
+    }
+
+    // -------------------------------------------------------------------
+    // Report
+    int last_stage = 0;
+    long long total_ns = 0;
+    for (int i = 0; i < N_STAGES; ++i) {
+        if (is_stage_enabled[i]) last_stage = i;
+        total_ns += stage_ns[i];
+    }
+    double views_per_sec = n_frames / (total_ns * 1e-9);
+    double shadow_map_triangles_per_sec = n_shadow_map_triangles
+                                          / (stage_ns[STAGE_SHADOW_MAPS] * 1e-9);
+
+    if (is_json) {
+        printf("{\n");
+        printf("  \"n_frames\": %d,\n", n_frames);
+        printf("  \"n_boxes\": %d,\n", n_boxes);
+        printf("  \"n_visible_per_frame\": %.2f,\n", (double)n_visible / n_frames);
+        if (is_occlusion) {
+            printf("  \"n_occluders\": %d,\n", n_occluders);
+            printf("  \"n_occluded_per_frame\": %.2f,\n", (double)n_occluded / n_frames);
+        }
+        printf("  \"stages\": {\n");
+        for (int i = 0; i < N_STAGES; ++i) {
+            if (!is_stage_enabled[i]) continue;
+            printf(
+                "    \"%s\": {\"ns_per_op\": %.1f}%s\n",
+                STAGE_NAMES[i],
+                (double)stage_ns[i] / n_frames,
+                i == last_stage ? "" : ","
+            );
+        }
+        printf("  },\n");
+        if (metrics_resolution > 0) {
+            printf("  \"cascade_metrics_resolution\": %d,\n", metrics_resolution);
+            printf("  \"cascade_metrics_screen_height\": %d,\n", METRICS_SCREEN_HEIGHT);
+            printf("  \"cascade_metrics\": [\n");
+            for (int i = 0; i < n_metrics_frustums; ++i) {
+                CascadeMetrics m = METRICS_SUMS[i];
+                printf(
+                    "    {\"coverage\": %.4f, \"texel_size\": [%.6f, %.6f], "
+                    "\"depth_utilization\": %.4f, \"near_pixel_texel_ratio\": %.4f, "
+                    "\"far_pixel_texel_ratio\": %.4f}%s\n",
+                    m.coverage / n_frames,
+                    m.texel_size.x / n_frames,
+                    m.texel_size.y / n_frames,
+                    m.depth_utilization / n_frames,
+                    m.near_pixel_texel_ratio / n_frames,
+                    m.far_pixel_texel_ratio / n_frames,
+                    i == n_metrics_frustums - 1 ? "" : ","
+                );
+            }
+            printf("  ],\n");
+        }
+        if (is_shadow_maps) {
+            printf("  \"shadow_map_resolution\": %d,\n", shadow_map_resolution);
+            printf(
+                "  \"shadow_map_triangles_per_sec\": %.1f,\n",
+                shadow_map_triangles_per_sec
+            );
+        }
+        printf("  \"ns_per_view\": %.1f,\n", (double)total_ns / n_frames);
+        printf("  \"views_per_sec\": %.1f\n", views_per_sec);
+        printf("}\n");
+    } else {
+        printf("frames: %d, boxes: %d\n", n_frames, n_boxes);
+        if (is_occlusion) {
+            printf(
+                "occluders: %d, occluded per frame: %.2f\n",
+                n_occluders,
+                (double)n_occluded / n_frames
+            );
+        }
+        for (int i = 0; i < N_STAGES; ++i) {
+            if (!is_stage_enabled[i]) continue;
+            printf(
+                "%-16s %10.1f ns/op\n", STAGE_NAMES[i], (double)stage_ns[i] / n_frames
+            );
+        }
+        printf("%-16s %10.1f ns/op\n", "total", (double)total_ns / n_frames);
+        printf("%-16s %10.1f views/sec\n", "throughput", views_per_sec);
+        if (metrics_resolution > 0) {
+            printf(
+                "cascade metrics (%dx%d shadow maps, %d px screen height):\n",
+                metrics_resolution,
+                metrics_resolution,
+                METRICS_SCREEN_HEIGHT
+            );
+            printf(
+                "%-8s %10s %12s %10s %12s %12s\n",
+                "cascade",
+                "coverage",
+                "texel size",
+                "depth use",
+                "near px/tx",
+                "far px/tx"
+            );
+            for (int i = 0; i < n_metrics_frustums; ++i) {
+                CascadeMetrics m = METRICS_SUMS[i];
+                printf(
+                    "%-8d %10.3f %12.5f %10.3f %12.3f %12.3f\n",
+                    i,
+                    m.coverage / n_frames,
+                    fmaxf(m.texel_size.x, m.texel_size.y) / n_frames,
+                    m.depth_utilization / n_frames,
+                    m.near_pixel_texel_ratio / n_frames,
+                    m.far_pixel_texel_ratio / n_frames
+                );
+            }
+        }
+        if (is_shadow_maps) {
+            printf(
+                "%-16s %10.1f Mtris/sec\n",
+                "shadow_maps",
+                shadow_map_triangles_per_sec * 1e-6
+            );
+        }
+    }
+
+    return 0;
+}
+
+static void create_boxes(int n_boxes) {
+    // Boxes are scattered on the ground grid around the origin
+    int n_per_side = 1;
+    while (n_per_side * n_per_side < n_boxes) ++n_per_side;
+
+    float spacing = 2.0;
+    float offset = -0.5 * spacing * (n_per_side - 1);
+    for (int i = 0; i < n_boxes; ++i) {
+        int x = i % n_per_side;
+        int z = i / n_per_side;
+        Vector3 center = {offset + spacing * x, 0.0, offset + spacing * z};
+        float height = 0.5 + 0.3 * ((3 * x + 7 * z) % 5);
+        BOXES[i] = (BoundingBox){
+            (Vector3){center.x - 0.3, 0.0, center.z - 0.3},
+            (Vector3){center.x + 0.3, height, center.z + 0.3}};
+    }
+}
+
+static int create_shadow_casters(int n_boxes) {
+    // 12 triangles per box plus the ground quad
+    Vector3 *v = SHADOW_CASTERS;
+    for (int i = 0; i < n_boxes; ++i) {
+        get_box_triangles(BOXES[i], v);
+        v += 3 * RASTER_N_BOX_TRIANGLES;
+    }
+
+    float size = 64.0;
+    Vector3 ground[4] = {
+        {-size, 0.0, -size}, {-size, 0.0, size}, {size, 0.0, size}, {size, 0.0, -size}};
+    *v++ = ground[0], *v++ = ground[1], *v++ = ground[2];
+    *v++ = ground[0], *v++ = ground[2], *v++ = ground[3];
+
+    return (int)(v - SHADOW_CASTERS) / 3;
+}
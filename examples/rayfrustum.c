@@ -1,4 +1,14 @@
+#define _POSIX_C_SOURCE 200809L
+
+#define RAYFRUSTUM_IMPLEMENTATION
+// The profiler goes first: the frame stages are stamped only if it's included
+#include "../include/rfprofiler.h"
 #include "../include/rayfrustum.h"
+#include "../include/rfalloc.h"
+#include "../include/rfdraw.h"
+#include "../include/rfmetrics.h"
+#include "../include/rfpipeline.h"
+#include "../include/rftrajectory.h"
 
 #include "raylib.h"
 #include "raymath.h"
@@ -33,22 +43,6 @@ typedef struct CameraShell {
     Model model;
 } CameraShell;
 
-typedef struct Frustum {
-    // near_left_bot, near_left_top, near_right_top, near_right_bot
-    // far_left_bot, far_left_top, far_right_top, far_right_bot
-    Vector3 corners[8];
-
-    Matrix view;
-    Matrix proj;
-} Frustum;
-
-#define MAX_N_FRUSTUMS_IN_CASCADE 9
-typedef struct FrustumsCascade {
-    int n_frustums;
-    Frustum frustums[MAX_N_FRUSTUMS_IN_CASCADE];
-    float planes[MAX_N_FRUSTUMS_IN_CASCADE + 1];
-} FrustumsCascade;
-
 typedef struct Triangle {
     Vector3 v1;
     Vector3 v2;
@@ -56,6 +50,49 @@ typedef struct Triangle {
 } Triangle;
 
 static Color CLEAR_COLOR = SKYBLUE;
+static Color FRUSTUM_COLORS[MAX_N_FRUSTUMS_IN_CASCADE] = {
+    (Color){255, 0, 0, 80},  // Red
+    (Color){0, 255, 0, 80},  // Green
+    (Color){0, 0, 255, 80},  // Blue
+    (Color){255, 255, 0, 80},  // Yellow
+    (Color){255, 0, 255, 80},  // Magenta
+    (Color){0, 255, 255, 80},  // Cyan
+    (Color){255, 128, 0, 80},  // Orange
+    (Color){128, 0, 128, 80},  // Purple
+    (Color){0, 128, 128, 80}  // Teal
+};
+
+typedef enum Stage {
+    STAGE_CAMERA_CASCADE = FRAME_STAGE_CAMERA_CASCADE,
+    STAGE_LIGHT_CASCADE = FRAME_STAGE_LIGHT_CASCADE,
+    STAGE_CULLING = FRAME_STAGE_CULLING,
+    STAGE_RGIZMO_UPDATE = N_FRAME_STAGES,
+    STAGE_DRAW_FRUSTUMS_CASCADE,
+    STAGE_DRAW_GUI,
+    N_STAGES
+} Stage;
+
+static const char *STAGE_NAMES[N_STAGES] = {
+    "camera_cascade",
+    "light_cascade",
+    "culling",
+    "rgizmo_update",
+    "draw_frustums_cascade",
+    "draw_gui"};
+
+typedef enum FrustumsDrawMode {
+    FRUSTUMS_DRAW_MODE_IMMEDIATE,
+    FRUSTUMS_DRAW_MODE_RETAINED,
+    FRUSTUMS_DRAW_MODE_INSTANCED,
+} FrustumsDrawMode;
+
+#define TRACE_FILE_PATH "./rayfrustum_trace.json"
+
+// Shadow map resolution the cascade metrics are computed for
+#define SHADOW_MAP_RESOLUTION 2048
+
+#define N_BOXES_PER_SIDE 8
+#define N_BOXES (N_BOXES_PER_SIDE * N_BOXES_PER_SIDE)
 
 static DirectionalLight LIGHT;
 static Camera3D CAMERA_0;
@@ -63,37 +100,62 @@ static Camera3D CAMERA_1;
 static CameraShell CAMERA_1_SHELL;
 static Model CAMERA_MODEL;
 static RGizmo GIZMO;
+static BoundingBox BOXES[N_BOXES];
+static FramePipeline PIPELINE;
+static FrameResult FRAME_RESULT;
+static FrustumsMesh FRUSTUMS_MESH;
+static FrustumsInstances FRUSTUMS_INSTANCES;
+
+// Cascade metrics of the drawn result, updated only when its cascades change
+static CascadeMetrics METRICS[MAX_N_FRUSTUMS_IN_CASCADE];
+static FrustumsCascade METRICS_LIGHT_CASCADE;
+static int METRICS_SCREEN_HEIGHT = 0;
 
 static bool IS_CAMERA_PICKED = false;
+static bool IS_PIPELINED = false;
+static int FRUSTUMS_DRAW_MODE = FRUSTUMS_DRAW_MODE_RETAINED;
+
+// Frames in which the cascades and culling were not recomputed, since the
+// frame input didn't change
+static long long N_SKIPPED_RECOMPUTES = 0;
+static long long N_FRAMES = 0;
 
 static CameraShell create_camera_shell(Camera3D *camera);
+static void create_boxes(void);
 static Matrix get_transform_matrix(Transform transform);
-static Frustum get_frustum_of_camera(
-    Camera3D camera, float aspect, float near, float far
-);
-static Frustum get_frustum_of_view_proj(Matrix view, Matrix proj);
-static Frustum get_frustum_of_directional_light(
-    Frustum camera_frustum, Vector3 light_direction
-);
-static FrustumsCascade get_frustums_cascade_of_camera(
-    Camera3D camera,
-    float aspect,
-    float planes[MAX_N_FRUSTUMS_IN_CASCADE + 1],
-    int n_planes
-);
-static FrustumsCascade get_frustums_cascade_of_directional_light(
-    FrustumsCascade camera_frustums_cascade, Vector3 light_direction
-);
-static Vector3 get_direction_from_azimuth_attitude(float azimuth, float attitude);
 static void update_free_orbit_camera(Camera3D *camera);
 static void draw_camera_shell(CameraShell shell);
 static void draw_frustum(Frustum frustum, Color color);
 static void draw_frustum_wires(Frustum frustum, Color color);
+static void get_frustums_cascade_draw_order(
+    FrustumsCascade cascade, Vector3 eye, int order[MAX_N_FRUSTUMS_IN_CASCADE]
+);
 static void draw_frustums_cascade(FrustumsCascade cascade, Vector3 eye);
 static void draw_frustums_cascade_wires(FrustumsCascade cascade);
+static void draw_boxes(const FrameResult *result);
 static void draw_gui(void);
+#ifndef RFPROFILER_DISABLE
+static void draw_profiler_gui(Rectangle bounds);
+#endif
+static void draw_cascade_metrics_gui(
+    Rectangle bounds, const CascadeMetrics *metrics, int n_cascades
+);
+
+// Usage: ./rayfrustum [--record FILE] [--replay FILE]
+int main(int argc, char **argv) {
+    const char *record_file_path = NULL;
+    const char *replay_file_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--record") == 0 && has_value) record_file_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && has_value)
+            replay_file_path = argv[++i];
+        else {
+            fprintf(stderr, "Usage: %s [--record FILE] [--replay FILE]\n", argv[0]);
+            exit(1);
+        }
+    }
 
-int main(void) {
     SetConfigFlags(FLAG_MSAA_4X_HINT);
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "rayfrustum");
     SetTargetFPS(60);
@@ -102,6 +164,8 @@ int main(void) {
     LIGHT.azimuth = 45.0;
     CAMERA_MODEL = LoadModel("./resources/camera.glb");
     GIZMO = rgizmo_create();
+    frustums_mesh_load(&FRUSTUMS_MESH);
+    frustums_instances_load(&FRUSTUMS_INSTANCES);
 
     CAMERA_0.fovy = 70.0;
     CAMERA_0.up = (Vector3){0.0, 1.0, 0.0};
@@ -116,12 +180,34 @@ int main(void) {
     CAMERA_1.projection = CAMERA_PERSPECTIVE;
 
     CAMERA_1_SHELL = create_camera_shell(&CAMERA_1);
-
-    while (!WindowShouldClose()) {
+    create_boxes();
+    profiler_init(STAGE_NAMES, N_STAGES);
+
+    TrajectoryReader reader = {0};
+    if (replay_file_path) reader = trajectory_reader_open(replay_file_path);
+    TrajectoryWriter writer = {0};
+    if (record_file_path) writer = trajectory_writer_open(record_file_path);
+
+    bool is_pipeline_running = false;
+    bool has_last_input = false;
+    FrameInput last_input = {0};
+    for (int frame = 0; !WindowShouldClose(); ++frame) {
+        ALLOC_AUDIT_BEGIN_FRAME();
+        PROFILE_BEGIN_FRAME();
         update_free_orbit_camera(&CAMERA_0);
 
         if (IS_CAMERA_PICKED) {
-            rgizmo_update(&GIZMO, CAMERA_0, CAMERA_1_SHELL.transform.translation);
+            PROFILE_SCOPE(STAGE_RGIZMO_UPDATE) {
+#ifdef RAYGIZMO_FBO_PICKING
+                // The fbo picking reads back a pixel via rlReadTexturePixels,
+                // which allocates the (tiny) pixels buffer
+                ALLOC_AUDIT_IGNORE_BEGIN();
+#endif
+                rgizmo_update(&GIZMO, CAMERA_0, CAMERA_1_SHELL.transform.translation);
+#ifdef RAYGIZMO_FBO_PICKING
+                ALLOC_AUDIT_IGNORE_END();
+#endif
+            }
         }
         CAMERA_1_SHELL.transform.translation = Vector3Add(
             CAMERA_1_SHELL.transform.translation, GIZMO.update.translation
@@ -131,21 +217,113 @@ int main(void) {
             CAMERA_1_SHELL.transform.rotation
         );
 
+        // -------------------------------------------------------------------
+        // Take the camera and the light from the live scene or from the
+        // replayed trajectory (which overrides the scene)
+        TrajectoryFrame trajectory_frame = {
+            .translation = CAMERA_1_SHELL.transform.translation,
+            .rotation = CAMERA_1_SHELL.transform.rotation,
+            .fovy = CAMERA_1.fovy,
+            .aspect = (float)GetScreenWidth() / GetScreenHeight(),
+            .light_azimuth = LIGHT.azimuth,
+            .light_attitude = LIGHT.attitude,
+            .n_planes = 4,
+            .planes = {0.01, 2.0, 4.0, 16.0}};
+        if (replay_file_path) {
+            trajectory_frame = trajectory_reader_get_frame(reader, frame);
+            CAMERA_1_SHELL.transform.translation = trajectory_frame.translation;
+            CAMERA_1_SHELL.transform.rotation = trajectory_frame.rotation;
+            CAMERA_1.fovy = trajectory_frame.fovy;
+            LIGHT.azimuth = trajectory_frame.light_azimuth;
+            LIGHT.attitude = trajectory_frame.light_attitude;
+        }
+        if (record_file_path) trajectory_writer_push(&writer, trajectory_frame);
+
         CAMERA_1_SHELL.camera->position = CAMERA_1_SHELL.transform.translation;
         Vector3 dir = Vector3RotateByQuaternion(
             (Vector3){0.0, 0.0, -1.0}, CAMERA_1_SHELL.transform.rotation
         );
         CAMERA_1_SHELL.camera->target = Vector3Add(CAMERA_1_SHELL.camera->position, dir);
 
-        float aspect = (float)GetScreenWidth() / GetScreenHeight();
-        float planes[4] = {0.01, 2.0, 4.0, 16.0};
-        FrustumsCascade camera_cascade = get_frustums_cascade_of_camera(
-            CAMERA_1, aspect, planes, 4
-        );
-        FrustumsCascade light_cascade = get_frustums_cascade_of_directional_light(
-            camera_cascade,
-            get_direction_from_azimuth_attitude(LIGHT.azimuth, LIGHT.attitude)
-        );
+        FrameInput input = get_frame_input_of_trajectory_frame(trajectory_frame);
+
+        // -------------------------------------------------------------------
+        // Compute cascades and culling results. In the pipelined mode they
+        // are computed by the worker while the current frame is rendered,
+        // so the drawn result lags the input by (at least) one frame
+        if (IS_PIPELINED != is_pipeline_running) {
+            // Starting and stopping the worker thread allocates its stack
+            ALLOC_AUDIT_IGNORE_BEGIN();
+            if (IS_PIPELINED) frame_pipeline_start(&PIPELINE, BOXES, N_BOXES);
+            else frame_pipeline_stop(&PIPELINE);
+            ALLOC_AUDIT_IGNORE_END();
+            is_pipeline_running = IS_PIPELINED;
+            has_last_input = false;
+        }
+
+        // The boxes are static, so the results depend only on the input and
+        // they are recomputed only when the input changes
+        bool is_input_changed = !has_last_input
+                                || !is_frame_input_equal(input, last_input);
+        last_input = input;
+        has_last_input = true;
+        N_SKIPPED_RECOMPUTES += !is_input_changed;
+        N_FRAMES += 1;
+
+        const FrameResult *result = NULL;
+        if (is_pipeline_running) {
+            if (is_input_changed) frame_pipeline_publish(&PIPELINE, input);
+            result = frame_pipeline_consume(&PIPELINE);
+        }
+        if (!result) {
+            // Until the first pipelined result arrives, the input is also
+            // computed here
+            if (is_input_changed || is_pipeline_running) {
+                compute_frame_result(input, BOXES, N_BOXES, &FRAME_RESULT);
+            }
+            result = &FRAME_RESULT;
+        }
+
+#ifndef RFPROFILER_DISABLE
+        // Frame stages are timestamped by the thread which computed them.
+        // The same pipelined result can be consumed several times, so its
+        // stages are pushed to the profiler only once
+        static long long last_result_begin_ns = 0;
+        if (result->stage_begin_ns[0] != last_result_begin_ns) {
+            int thread = result == &FRAME_RESULT ? 0 : 1;
+            for (int i = 0; i < N_FRAME_STAGES; ++i) {
+                profiler_push(
+                    i, thread, result->stage_begin_ns[i], result->stage_end_ns[i]
+                );
+            }
+            last_result_begin_ns = result->stage_begin_ns[0];
+        }
+#endif
+        FrustumsCascade camera_cascade = result->camera_cascade;
+        FrustumsCascade light_cascade = result->light_cascade;
+
+        // The metrics test all boxes against every light frustum, so they are
+        // updated with the result. A pipelined result arrives frames after its
+        // input, so it's detected by its light cascade (fitted to the camera
+        // one and the light direction)
+        bool is_result_changed = is_input_changed || is_pipeline_running;
+        if (result != &FRAME_RESULT) {
+            const void *last = &METRICS_LIGHT_CASCADE;
+            is_result_changed = memcmp(&light_cascade, last, sizeof(light_cascade)) != 0;
+        }
+        if (is_result_changed || GetScreenHeight() != METRICS_SCREEN_HEIGHT) {
+            get_cascades_metrics(
+                camera_cascade,
+                light_cascade,
+                BOXES,
+                N_BOXES,
+                SHADOW_MAP_RESOLUTION,
+                GetScreenHeight(),
+                METRICS
+            );
+            METRICS_LIGHT_CASCADE = light_cascade;
+            METRICS_SCREEN_HEIGHT = GetScreenHeight();
+        }
 
         BeginDrawing();
         {
@@ -154,8 +332,20 @@ int main(void) {
             BeginMode3D(CAMERA_0);
             {
                 draw_camera_shell(CAMERA_1_SHELL);
-                draw_frustums_cascade_wires(light_cascade);
-                draw_frustums_cascade(camera_cascade, CAMERA_0.position);
+                draw_boxes(result);
+                PROFILE_SCOPE(STAGE_DRAW_FRUSTUMS_CASCADE) {
+                    // In the retained and instanced modes the frustums are
+                    // only pushed here, and all of them are drawn at once
+                    frustums_mesh_begin(&FRUSTUMS_MESH);
+                    frustums_instances_begin(&FRUSTUMS_INSTANCES);
+                    draw_frustums_cascade_wires(light_cascade);
+                    draw_frustums_cascade(camera_cascade, CAMERA_0.position);
+                    if (FRUSTUMS_DRAW_MODE == FRUSTUMS_DRAW_MODE_RETAINED) {
+                        frustums_mesh_draw(&FRUSTUMS_MESH, 1.0);
+                    } else if (FRUSTUMS_DRAW_MODE == FRUSTUMS_DRAW_MODE_INSTANCED) {
+                        frustums_instances_draw(&FRUSTUMS_INSTANCES, 1.0);
+                    }
+                }
             }
             EndMode3D();
 
@@ -172,27 +362,25 @@ int main(void) {
                 EndMode3D();
             }
 
-            draw_gui();
+            PROFILE_SCOPE(STAGE_DRAW_GUI) {
+                draw_gui();
+                draw_cascade_metrics_gui(
+                    (Rectangle){GetScreenWidth() - 302, 2, 300, 0},
+                    METRICS,
+                    light_cascade.n_frustums
+                );
+            }
         }
         EndDrawing();
+        PROFILE_END_FRAME();
+        ALLOC_AUDIT_END_FRAME();
     }
-}
 
-static Frustum get_frustum_of_view_proj(Matrix view, Matrix proj) {
-    Frustum frustum = {
-        .corners
-        = {Vector3Unproject((Vector3){-1.0, -1.0, -1.0}, proj, view),
-           Vector3Unproject((Vector3){-1.0, 1.0, -1.0}, proj, view),
-           Vector3Unproject((Vector3){1.0, 1.0, -1.0}, proj, view),
-           Vector3Unproject((Vector3){1.0, -1.0, -1.0}, proj, view),
-           Vector3Unproject((Vector3){-1.0, -1.0, 1.0}, proj, view),
-           Vector3Unproject((Vector3){-1.0, 1.0, 1.0}, proj, view),
-           Vector3Unproject((Vector3){1.0, 1.0, 1.0}, proj, view),
-           Vector3Unproject((Vector3){1.0, -1.0, 1.0}, proj, view)},
-        .view = view,
-        .proj = proj};
-
-    return frustum;
+    if (is_pipeline_running) frame_pipeline_stop(&PIPELINE);
+    frustums_mesh_unload(&FRUSTUMS_MESH);
+    frustums_instances_unload(&FRUSTUMS_INSTANCES);
+    if (record_file_path) trajectory_writer_close(&writer);
+    if (replay_file_path) trajectory_reader_close(&reader);
 }
 
 static CameraShell create_camera_shell(Camera3D *camera) {
@@ -210,6 +398,20 @@ static CameraShell create_camera_shell(Camera3D *camera) {
     return shell;
 }
 
+static void create_boxes(void) {
+    float spacing = 2.0;
+    float offset = -0.5 * spacing * (N_BOXES_PER_SIDE - 1);
+    for (int i = 0; i < N_BOXES_PER_SIDE; ++i) {
+        for (int j = 0; j < N_BOXES_PER_SIDE; ++j) {
+            Vector3 center = {offset + spacing * i, 0.0, offset + spacing * j};
+            float height = 0.5 + 0.3 * ((3 * i + 7 * j) % 5);
+            BOXES[i * N_BOXES_PER_SIDE + j] = (BoundingBox){
+                (Vector3){center.x - 0.3, 0.0, center.z - 0.3},
+                (Vector3){center.x + 0.3, height, center.z + 0.3}};
+        }
+    }
+}
+
 static Matrix get_transform_matrix(Transform transform) {
     Vector3 t = transform.translation;
     Vector3 s = transform.scale;
@@ -223,151 +425,6 @@ static Matrix get_transform_matrix(Transform transform) {
     return m;
 }
 
-static Frustum get_frustum_of_camera(
-    Camera3D camera, float aspect, float near, float far
-) {
-    Matrix view = MatrixLookAt(camera.position, camera.target, camera.up);
-    Matrix proj = {0};
-
-    if (camera.projection == CAMERA_PERSPECTIVE) {
-        proj = MatrixPerspective(DEG2RAD * camera.fovy, aspect, near, far);
-    } else if (camera.projection == CAMERA_ORTHOGRAPHIC) {
-        double top = camera.fovy / 2.0;
-        double right = top * aspect;
-        proj = MatrixOrtho(-right, right, -top, top, near, far);
-    }
-
-    return get_frustum_of_view_proj(view, proj);
-}
-
-static Frustum get_frustum_of_directional_light(
-    Frustum camera_frustum, Vector3 light_direction
-) {
-    light_direction = Vector3Normalize(light_direction);
-
-    // Calculate frustum bounding box in the light space
-    Matrix light_view = MatrixLookAt(
-        Vector3Zero(), light_direction, (Vector3){0.0, 1.0, 0.0}
-    );
-    float min_x = FLT_MAX, min_y = FLT_MAX, min_z = FLT_MAX, max_x = -FLT_MAX,
-          max_y = -FLT_MAX, max_z = -FLT_MAX;
-
-    for (int i = 0; i < 8; ++i) {
-        // Project frustum to the light space
-        Vector3 corner = Vector3Transform(camera_frustum.corners[i], light_view);
-
-        min_x = min(min_x, corner.x);
-        min_y = min(min_y, corner.y);
-        min_z = min(min_z, corner.z);
-        max_x = max(max_x, corner.x);
-        max_y = max(max_y, corner.y);
-        max_z = max(max_z, corner.z);
-    }
-
-    // Calculate light position in the light space
-    Vector3 light_pos = {
-        (min_x + max_x) / 2.0,
-        (min_y + max_y) / 2.0,
-        (min_z + max_z) / 2.0,
-    };
-
-    // Calculate light position in the world space
-    light_pos = Vector3Transform(light_pos, MatrixInvert(light_view));
-
-    // Calculate frustum bounding box in the light space (now with light position known)
-    light_view = MatrixLookAt(
-        light_pos, Vector3Add(light_pos, light_direction), (Vector3){0.0, 1.0, 0.0}
-    );
-    min_x = FLT_MAX, min_y = FLT_MAX, min_z = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX,
-    max_z = -FLT_MAX;
-    for (int i = 0; i < 8; ++i) {
-        // Project frustum to the light space
-        Vector3 corner = Vector3Transform(camera_frustum.corners[i], light_view);
-
-        min_x = min(min_x, corner.x);
-        min_y = min(min_y, corner.y);
-        min_z = min(min_z, corner.z);
-        max_x = max(max_x, corner.x);
-        max_y = max(max_y, corner.y);
-        max_z = max(max_z, corner.z);
-    }
-    Matrix light_proj = MatrixOrtho(min_x, max_x, min_y, max_y, min_z, max_z);
-    Frustum light_frustum = get_frustum_of_view_proj(light_view, light_proj);
-
-    return light_frustum;
-}
-
-static FrustumsCascade get_frustums_cascade_of_camera(
-    Camera3D camera,
-    float aspect,
-    float planes[MAX_N_FRUSTUMS_IN_CASCADE + 1],
-    int n_planes
-) {
-    if (n_planes < 2 || n_planes > MAX_N_FRUSTUMS_IN_CASCADE + 1) {
-        fprintf(
-            stderr,
-            "ERROR: Number of frustum planes must be >= 2 and <= %d, but you passed %d\n",
-            MAX_N_FRUSTUMS_IN_CASCADE + 1,
-            n_planes
-        );
-        exit(1);
-    }
-
-    FrustumsCascade cascade = {0};
-    memcpy(cascade.planes, planes, sizeof(planes[0]) * n_planes);
-
-    for (int i = 0; i < n_planes - 1; ++i) {
-        float near = planes[i];
-        float far = planes[i + 1];
-        if (far <= near) {
-            fprintf(stderr, "ERROR: Frustum planes must be in ascending order\n");
-            exit(1);
-        }
-
-        cascade.frustums[cascade.n_frustums++] = get_frustum_of_camera(
-            camera, aspect, near, far
-        );
-    }
-
-    return cascade;
-}
-
-static FrustumsCascade get_frustums_cascade_of_directional_light(
-    FrustumsCascade camera_frustums_cascade, Vector3 light_direction
-) {
-    FrustumsCascade cascade = {0};
-    int n_planes = camera_frustums_cascade.n_frustums + 1;
-    memcpy(
-        cascade.planes,
-        camera_frustums_cascade.planes,
-        sizeof(camera_frustums_cascade.planes[0]) * n_planes
-    );
-    cascade.n_frustums = camera_frustums_cascade.n_frustums;
-
-    for (int i = 0; i < cascade.n_frustums; ++i) {
-        Frustum camera_frustum = camera_frustums_cascade.frustums[i];
-        cascade.frustums[i] = get_frustum_of_directional_light(
-            camera_frustum, light_direction
-        );
-    }
-
-    return cascade;
-}
-
-static Vector3 get_direction_from_azimuth_attitude(
-    float azimuth_deg, float attitude_deg
-) {
-    Vector3 result;
-    double azimuth_rad = DEG2RAD * azimuth_deg;
-    double attitude_rad = DEG2RAD * attitude_deg;
-
-    result.x = cos(azimuth_rad) * cos(attitude_rad);
-    result.y = sin(azimuth_rad) * cos(attitude_rad);
-    result.z = sin(attitude_rad);
-
-    return Vector3Normalize(result);
-}
-
 static void update_free_orbit_camera(Camera3D *camera) {
     static float rot_speed = 0.003f;
     static float move_speed = 0.01f;
@@ -449,7 +506,9 @@ static void draw_frustum_wires(Frustum frustum, Color color) {
     DrawLine3D(corners[3], corners[7], color);
 }
 
-static void draw_frustums_cascade(FrustumsCascade cascade, Vector3 eye) {
+static void get_frustums_cascade_draw_order(
+    FrustumsCascade cascade, Vector3 eye, int order[MAX_N_FRUSTUMS_IN_CASCADE]
+) {
     // -------------------------------------------------------------------
     // Get the distance of the eye on the z (view) axis of the cascade
     Matrix view = cascade.frustums[0].view;
@@ -474,40 +533,74 @@ static void draw_frustums_cascade(FrustumsCascade cascade, Vector3 eye) {
     }
 
     // -------------------------------------------------------------------
-    // Draw frustums in the order furthest -> nearest
-    static Color frustum_colors[MAX_N_FRUSTUMS_IN_CASCADE] = {
-        (Color){255, 0, 0, 80},  // Red
-        (Color){0, 255, 0, 80},  // Green
-        (Color){0, 0, 255, 80},  // Blue
-        (Color){255, 255, 0, 80},  // Yellow
-        (Color){255, 0, 255, 80},  // Magenta
-        (Color){0, 255, 255, 80},  // Cyan
-        (Color){255, 128, 0, 80},  // Orange
-        (Color){128, 0, 128, 80},  // Purple
-        (Color){0, 128, 128, 80}  // Teal
-    };
+    // Order frustums furthest -> nearest
+    int n = 0;
+    for (int i = 0; i < nearest_frustum_idx; i++) order[n++] = i;
+    for (int i = cascade.n_frustums - 1; i > nearest_frustum_idx; i--) order[n++] = i;
+    order[n++] = nearest_frustum_idx;
+}
 
-    for (int i = 0; i < nearest_frustum_idx; i++) {
-        draw_frustum(cascade.frustums[i], frustum_colors[i]);
-    }
+static void draw_frustums_cascade(FrustumsCascade cascade, Vector3 eye) {
+    int order[MAX_N_FRUSTUMS_IN_CASCADE];
+    get_frustums_cascade_draw_order(cascade, eye, order);
 
-    for (int i = cascade.n_frustums - 1; i > nearest_frustum_idx; i--) {
-        draw_frustum(cascade.frustums[i], frustum_colors[i]);
+    for (int i = 0; i < cascade.n_frustums; ++i) {
+        int idx = order[i];
+        Frustum *frustum = &cascade.frustums[idx];
+        switch (FRUSTUMS_DRAW_MODE) {
+            case FRUSTUMS_DRAW_MODE_IMMEDIATE:
+                draw_frustum(*frustum, FRUSTUM_COLORS[idx]);
+                break;
+            case FRUSTUMS_DRAW_MODE_RETAINED:
+                frustums_mesh_push_faces(&FRUSTUMS_MESH, frustum, FRUSTUM_COLORS[idx]);
+                break;
+            case FRUSTUMS_DRAW_MODE_INSTANCED:
+                frustums_instances_push_faces(
+                    &FRUSTUMS_INSTANCES,
+                    get_frustum_inv_view_proj(frustum),
+                    FRUSTUM_COLORS[idx]
+                );
+                break;
+        }
     }
-
-    draw_frustum(
-        cascade.frustums[nearest_frustum_idx], frustum_colors[nearest_frustum_idx]
-    );
 }
 
 static void draw_frustums_cascade_wires(FrustumsCascade cascade) {
     for (int i = 0; i < cascade.n_frustums; ++i) {
-        draw_frustum_wires(cascade.frustums[i], YELLOW);
+        Frustum *frustum = &cascade.frustums[i];
+        switch (FRUSTUMS_DRAW_MODE) {
+            case FRUSTUMS_DRAW_MODE_IMMEDIATE:
+                draw_frustum_wires(*frustum, YELLOW);
+                break;
+            case FRUSTUMS_DRAW_MODE_RETAINED:
+                frustums_mesh_push_wires(&FRUSTUMS_MESH, frustum, YELLOW);
+                break;
+            case FRUSTUMS_DRAW_MODE_INSTANCED:
+                frustums_instances_push_wires(
+                    &FRUSTUMS_INSTANCES, get_frustum_inv_view_proj(frustum), YELLOW
+                );
+                break;
+        }
+    }
+}
+
+static void draw_boxes(const FrameResult *result) {
+    // Boxes visible by the camera are colored by their nearest cascade frustum
+    for (int i = 0; i < result->n_boxes; ++i) {
+        unsigned short mask = result->camera_masks[i];
+        Color color = DARKGRAY;
+        for (int j = 0; j < MAX_N_FRUSTUMS_IN_CASCADE; ++j) {
+            if (mask & (1 << j)) {
+                color = ColorAlpha(FRUSTUM_COLORS[j], 1.0);
+                break;
+            }
+        }
+        DrawBoundingBox(BOXES[i], color);
     }
 }
 
 static void draw_gui(void) {
-    GuiPanel((Rectangle){2, 2, 220, 200}, "Controls");
+    GuiPanel((Rectangle){2, 2, 220, 228}, "Controls");
     GuiSliderBar(
         (Rectangle){55, 35, 130, 20},
         "Light    \nazimuth ",
@@ -534,4 +627,125 @@ static void draw_gui(void) {
     );
 
     GuiCheckBox((Rectangle){8, 145, 20, 20}, "Pick camera", &IS_CAMERA_PICKED);
+    GuiCheckBox((Rectangle){8, 172, 20, 20}, "Pipelined", &IS_PIPELINED);
+    GuiToggleGroup(
+        (Rectangle){8, 199, 68, 20}, "Immediate;Retained;Instanced", &FRUSTUMS_DRAW_MODE
+    );
+
+#ifndef RFPROFILER_DISABLE
+    draw_profiler_gui((Rectangle){2, 234, 220, 270});
+#endif
+}
+
+#ifndef RFPROFILER_DISABLE
+static void draw_profiler_gui(Rectangle bounds) {
+    GuiPanel(bounds, "Profiler");
+    float x = bounds.x + 6;
+    float y = bounds.y + 28;
+    float width = bounds.width - 12;
+
+    GuiLabel(
+        (Rectangle){x, y, width, 16},
+        TextFormat(
+            "Frame: %.2f ms avg, %.2f ms max",
+            profiler_get_frame_average_ms(),
+            profiler_get_frame_max_ms()
+        )
+    );
+    y += 20;
+    GuiLabel(
+        (Rectangle){x, y, width, 16},
+        TextFormat(
+            "Skipped recomputes: %lld/%lld", N_SKIPPED_RECOMPUTES, N_FRAMES
+        )
+    );
+    y += 20;
+
+    // -------------------------------------------------------------------
+    // Rolling frame time graph (the most recent frame is on the right)
+    Rectangle graph = {x, y, width, 50};
+    float graph_max_ms = fmaxf(profiler_get_frame_max_ms(), 1000.0 / 30.0);
+    float bar_width = graph.width / PROFILER_N_HISTORY_FRAMES;
+    DrawRectangleRec(graph, Fade(BLACK, 0.2));
+    for (int age = 0; age < PROFILER_N_HISTORY_FRAMES; ++age) {
+        float height = graph.height * profiler_get_frame_history_ms(age) / graph_max_ms;
+        DrawRectangleRec(
+            (Rectangle){
+                graph.x + graph.width - (age + 1) * bar_width,
+                graph.y + graph.height - height,
+                bar_width,
+                height},
+            DARKBLUE
+        );
+    }
+    y += graph.height + 6;
+
+    // -------------------------------------------------------------------
+    // Per-stage averages
+    for (int i = 0; i < profiler_get_n_stages(); ++i) {
+        GuiLabel(
+            (Rectangle){x, y, width, 16},
+            TextFormat(
+                "%s: %.3f ms",
+                profiler_get_stage_name(i),
+                profiler_get_stage_average_ms(i)
+            )
+        );
+        y += 16;
+    }
+
+    if (GuiButton((Rectangle){x, y + 6, width, 20}, "Save Chrome trace")) {
+        // Explicit user action, the file stream allocation is fine here
+        ALLOC_AUDIT_IGNORE_BEGIN();
+        if (profiler_save_chrome_trace(TRACE_FILE_PATH)) {
+            TraceLog(LOG_INFO, "RAYFRUSTUM: Chrome trace saved to %s", TRACE_FILE_PATH);
+        }
+        ALLOC_AUDIT_IGNORE_END();
+    }
+}
+#endif
+
+static void draw_cascade_metrics_gui(
+    Rectangle bounds, const CascadeMetrics *metrics, int n_cascades
+) {
+    // The height is fitted to the number of cascades
+    static const char *columns[6] = {"#", "cover", "texel", "depth", "near", "far"};
+    static const float column_widths[6] = {20, 50, 60, 50, 50, 50};
+    int n_columns = 6;
+
+    bounds.height = 28 + 16 * (n_cascades + 2) + 6;
+    int resolution = SHADOW_MAP_RESOLUTION;
+    GuiPanel(bounds, TextFormat("Cascade metrics (%dx%d)", resolution, resolution));
+    float y = bounds.y + 28;
+
+    float x = bounds.x + 6;
+    for (int c = 0; c < n_columns; ++c) {
+        GuiLabel((Rectangle){x, y, column_widths[c], 16}, columns[c]);
+        x += column_widths[c];
+    }
+    y += 16;
+
+    for (int i = 0; i < n_cascades; ++i) {
+        // TextFormat has only a few rotating buffers, so the row is formatted here
+        CascadeMetrics m = metrics[i];
+        char values[6][16];
+        snprintf(values[0], 16, "%d", i);
+        snprintf(values[1], 16, "%.2f", m.coverage);
+        snprintf(values[2], 16, "%.4f", fmaxf(m.texel_size.x, m.texel_size.y));
+        snprintf(values[3], 16, "%.2f", m.depth_utilization);
+        snprintf(values[4], 16, "%.2f", m.near_pixel_texel_ratio);
+        snprintf(values[5], 16, "%.2f", m.far_pixel_texel_ratio);
+
+        x = bounds.x + 6;
+        for (int c = 0; c < n_columns; ++c) {
+            GuiLabel((Rectangle){x, y, column_widths[c], 16}, values[c]);
+            x += column_widths[c];
+        }
+        y += 16;
+    }
+
+    GuiLabel(
+        (Rectangle){bounds.x + 6, y, bounds.width - 12, 16},
+        "near/far: screen pixel / texel size"
+    );
 }
@@ -0,0 +1,522 @@
+#define _POSIX_C_SOURCE 200809L
+
+#define RAYMATH_STATIC_INLINE
+#define RAYFRUSTUM_IMPLEMENTATION
+#include "../include/rayfrustum.h"
+#include "../include/rfbvh.h"
+#include "../include/rfjobs.h"
+#include "../include/rfprofiler.h"
+#include "../include/rfraster.h"
+#include "../include/rftrajectory.h"
+#include "../include/rfunproject.h"
+
+#include "raylib.h"
+#include "raymath.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Compares the shadow maps implied by the light cascades with the ground
+// truth sun visibility, traced against the BVH of the scene on the CPU.
+//
+// Each frame:
+//     - boxes and the ground are rasterized into the shadow maps of the
+//       light cascade frustums (as the GPU would do, with the depth clamp)
+//     - the camera depth is rasterized and unprojected into the receiver
+//       points (the visible surfaces)
+//     - every receiver is classified by the shadow map of its camera slice
+//       and by the shadow ray traced towards the sun from the receiver
+//       lifted along its normal
+// Disagreements are counted per cascade (false-lit: the ray is blocked, but
+// the shadow map says lit; false-shadowed: the other way around) and per the
+// camera view distance.
+//
+// Usage: ./shadowcmp [n_frames] [n_boxes] [--resolution N] [--bias B] [--json]
+//                    [--replay FILE]
+
+#define DEFAULT_N_FRAMES 32
+#define DEFAULT_N_BOXES 1024
+#define DEFAULT_RESOLUTION 1024
+// Depth bias in the world units of the light space
+#define DEFAULT_BIAS 0.02
+#define RECEIVERS_WIDTH 320
+#define RECEIVERS_HEIGHT 240
+#define N_RECEIVERS (RECEIVERS_WIDTH * RECEIVERS_HEIGHT)
+#define N_DISTANCE_BINS 16
+#define RECEIVERS_CHUNK_SIZE 1024
+#define N_RECEIVERS_CHUNKS \
+    ((N_RECEIVERS + RECEIVERS_CHUNK_SIZE - 1) / RECEIVERS_CHUNK_SIZE)
+#define MAX_N_TRIANGLES (MAX_N_CULLED_BOXES * RASTER_N_BOX_TRIANGLES + 2)
+// Shadow rays start off the surface along its normal, by this fraction of the
+// camera distance (the depth reconstruction error grows with it), so they
+// don't hit the receiver itself
+#define RAY_NORMAL_OFFSET 1e-3
+#define RAY_MIN_T 1e-4
+#define RAY_MAX_T 1e4
+
+typedef struct ShadowErrors {
+    long long n_receivers;
+    long long n_false_lit;
+    long long n_false_shadowed;
+} ShadowErrors;
+
+typedef struct ComparisonJob {
+    const FrustumsCascade *camera_cascade;
+    const FrustumsCascade *light_cascade;
+    const DepthRaster *shadow_maps;
+    // View-projection of every light frustum, multiplied once per cascade
+    Matrix light_view_projs[MAX_N_FRUSTUMS_IN_CASCADE];
+    const Bvh *bvh;
+    const Vector3 *receivers;
+    const float *receivers_depth;
+    Vector3 to_light;
+    Vector3 camera_position;
+    float bias;
+
+    ShadowErrors cascade_errors[N_RECEIVERS_CHUNKS][MAX_N_FRUSTUMS_IN_CASCADE];
+    ShadowErrors distance_errors[N_RECEIVERS_CHUNKS][N_DISTANCE_BINS];
+} ComparisonJob;
+
+static BoundingBox BOXES[MAX_N_CULLED_BOXES];
+static Vector3 TRIANGLES[3 * MAX_N_TRIANGLES];
+static DepthRaster SHADOW_MAPS[MAX_N_FRUSTUMS_IN_CASCADE];
+static DepthRaster CAMERA_DEPTH;
+static Vector3 RECEIVERS[N_RECEIVERS];
+static ComparisonJob JOB;
+static JobPool POOL;
+
+static int create_scene(int n_boxes);
+static void add_shadow_errors(ShadowErrors *dst, ShadowErrors src);
+static bool is_shadowed_by_map(
+    const DepthRaster *map,
+    Frustum light_frustum,
+    Matrix light_view_proj,
+    Vector3 p,
+    float bias
+);
+static Vector3 get_shadow_ray_origin(const ComparisonJob *job, int receiver);
+static void run_comparison_chunk(void *ctx, int chunk);
+
+int main(int argc, char **argv) {
+    int n_frames = DEFAULT_N_FRAMES;
+    int n_boxes = DEFAULT_N_BOXES;
+    int resolution = DEFAULT_RESOLUTION;
+    float bias = DEFAULT_BIAS;
+    bool is_json = false;
+    const char *replay_file_path = NULL;
+
+    int n_positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--json") == 0) is_json = true;
+        else if (strcmp(argv[i], "--resolution") == 0 && has_value)
+            resolution = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bias") == 0 && has_value) bias = atof(argv[++i]);
+        else if (strcmp(argv[i], "--replay") == 0 && has_value)
+            replay_file_path = argv[++i];
+        else if (strncmp(argv[i], "--", 2) != 0 && n_positional < 2) {
+            if (n_positional++ == 0) n_frames = atoi(argv[i]);
+            else n_boxes = atoi(argv[i]);
+        } else {
+            fprintf(
+                stderr,
+                "Usage: %s [n_frames] [n_boxes] [--resolution N] [--bias B] [--json] "
+                "[--replay FILE]\n",
+                argv[0]
+            );
+            exit(1);
+        }
+    }
+
+    TrajectoryReader reader = {0};
+    if (replay_file_path) {
+        reader = trajectory_reader_open(replay_file_path);
+        if (n_positional == 0) n_frames = reader.n_frames;
+    }
+
+    if (n_frames <= 0 || n_boxes < 0 || n_boxes > MAX_N_CULLED_BOXES || resolution <= 0
+        || resolution % 4 != 0) {
+        fprintf(
+            stderr,
+            "ERROR: Number of frames must be > 0, number of boxes must be in [0, %d] "
+            "and resolution must be a positive multiple of 4\n",
+            MAX_N_CULLED_BOXES
+        );
+        exit(1);
+    }
+
+    // -------------------------------------------------------------------
+    // Scene, its BVH, and the buffers
+    int n_triangles = create_scene(n_boxes);
+    long long t0 = get_time_ns();
+    Bvh bvh = bvh_build(TRIANGLES, n_triangles);
+    long long bvh_build_ns = get_time_ns() - t0;
+
+    int n_tiles = (resolution + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    for (int i = 0; i < MAX_N_FRUSTUMS_IN_CASCADE; ++i) {
+        SHADOW_MAPS[i] = depth_raster_load(
+            resolution, resolution, n_triangles, 8 * n_triangles + 4 * n_tiles * n_tiles
+        );
+        // Light frustums are fitted to the camera slices, the casters in front
+        // of them are pancaked onto the near plane
+        SHADOW_MAPS[i].is_depth_clamped = true;
+    }
+    CAMERA_DEPTH = depth_raster_load(
+        RECEIVERS_WIDTH, RECEIVERS_HEIGHT, n_triangles, 8 * n_triangles + 1024
+    );
+
+    int n_workers = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (n_workers < 0) n_workers = 0;
+    if (n_workers > JOB_POOL_MAX_N_WORKERS) n_workers = JOB_POOL_MAX_N_WORKERS;
+    job_pool_start(&POOL, n_workers);
+
+    // -------------------------------------------------------------------
+    // Compare frame by frame
+    ShadowErrors cascade_errors[MAX_N_FRUSTUMS_IN_CASCADE] = {0};
+    ShadowErrors distance_errors[N_DISTANCE_BINS] = {0};
+    int n_cascades = 0;
+    float min_distance = 0.0;
+    float max_distance = 0.0;
+    long long trace_ns = 0;
+    for (int frame = 0; frame < n_frames; ++frame) {
+        TrajectoryFrame trajectory_frame;
+        if (replay_file_path) {
+            trajectory_frame = trajectory_reader_get_frame(reader, frame);
+        } else {
+            trajectory_frame = get_orbit_trajectory_frame(frame, n_frames);
+        }
+        FrameInput input = get_frame_input_of_trajectory_frame(trajectory_frame);
+
+        FrustumsCascade camera_cascade = get_frustums_cascade_of_camera(
+            input.camera, input.aspect, input.planes, input.n_planes
+        );
+        FrustumsCascade light_cascade = get_frustums_cascade_of_directional_light(
+            camera_cascade, input.light_direction
+        );
+        n_cascades = light_cascade.n_frustums;
+        min_distance = camera_cascade.planes[0];
+        max_distance = camera_cascade.planes[camera_cascade.n_frustums];
+
+        for (int i = 0; i < light_cascade.n_frustums; ++i) {
+            Frustum *f = &light_cascade.frustums[i];
+            depth_raster_clear(&SHADOW_MAPS[i]);
+            depth_raster_render(
+                &SHADOW_MAPS[i], f->view, f->proj, TRIANGLES, n_triangles, &POOL
+            );
+        }
+
+        // Receivers are the visible surface points of the whole camera cascade
+        Frustum camera_frustum = get_frustum_of_camera(
+            input.camera, input.aspect, min_distance, max_distance
+        );
+        depth_raster_clear(&CAMERA_DEPTH);
+        depth_raster_render(
+            &CAMERA_DEPTH,
+            camera_frustum.view,
+            camera_frustum.proj,
+            TRIANGLES,
+            n_triangles,
+            &POOL
+        );
+        DepthImage camera_depth = {
+            CAMERA_DEPTH.depth, RECEIVERS_WIDTH, RECEIVERS_HEIGHT, DEPTH_FORMAT_FLOAT32};
+        unproject_depth_image(
+            camera_depth,
+            camera_frustum.view,
+            camera_frustum.proj,
+            MatrixIdentity(),
+            RECEIVERS,
+            NULL,
+            &POOL
+        );
+
+        JOB = (ComparisonJob){
+            .camera_cascade = &camera_cascade,
+            .light_cascade = &light_cascade,
+            .shadow_maps = SHADOW_MAPS,
+            .bvh = &bvh,
+            .receivers = RECEIVERS,
+            .receivers_depth = CAMERA_DEPTH.depth,
+            .to_light = Vector3Negate(Vector3Normalize(input.light_direction)),
+            .camera_position = input.camera.position,
+            .bias = bias};
+        for (int i = 0; i < light_cascade.n_frustums; ++i) {
+            Frustum f = light_cascade.frustums[i];
+            JOB.light_view_projs[i] = MatrixMultiply(f.view, f.proj);
+        }
+        long long t1 = get_time_ns();
+        job_pool_run(&POOL, N_RECEIVERS_CHUNKS, run_comparison_chunk, &JOB);
+        trace_ns += get_time_ns() - t1;
+
+        for (int c = 0; c < N_RECEIVERS_CHUNKS; ++c) {
+            for (int i = 0; i < MAX_N_FRUSTUMS_IN_CASCADE; ++i) {
+                add_shadow_errors(&cascade_errors[i], JOB.cascade_errors[c][i]);
+            }
+            for (int i = 0; i < N_DISTANCE_BINS; ++i) {
+                add_shadow_errors(&distance_errors[i], JOB.distance_errors[c][i]);
+            }
+        }
+    }
+
+    job_pool_stop(&POOL);
+    bvh_unload(&bvh);
+    for (int i = 0; i < MAX_N_FRUSTUMS_IN_CASCADE; ++i) {
+        depth_raster_unload(&SHADOW_MAPS[i]);
+    }
+    depth_raster_unload(&CAMERA_DEPTH);
+    if (replay_file_path) trajectory_reader_close(&reader);
+
+    // -------------------------------------------------------------------
+    // Report (the distance bins are of the last frame planes)
+    long long n_rays = 0;
+    for (int i = 0; i < n_cascades; ++i) n_rays += cascade_errors[i].n_receivers;
+    float bin_size = (max_distance - min_distance) / N_DISTANCE_BINS;
+
+    if (is_json) {
+        printf("{\n");
+        printf("  \"n_frames\": %d,\n", n_frames);
+        printf("  \"n_triangles\": %d,\n", n_triangles);
+        printf("  \"resolution\": %d,\n", resolution);
+        printf("  \"bias\": %g,\n", bias);
+        printf("  \"bvh_build_ms\": %.3f,\n", bvh_build_ns * 1e-6);
+        printf("  \"rays_per_sec\": %.1f,\n", n_rays / (trace_ns * 1e-9));
+        printf("  \"cascades\": [\n");
+        for (int i = 0; i < n_cascades; ++i) {
+            ShadowErrors e = cascade_errors[i];
+            double n = e.n_receivers > 0 ? e.n_receivers : 1;
+            printf(
+                "    {\"n_receivers\": %lld, \"false_lit_rate\": %.5f, "
+                "\"false_shadowed_rate\": %.5f}%s\n",
+                e.n_receivers,
+                e.n_false_lit / n,
+                e.n_false_shadowed / n,
+                i == n_cascades - 1 ? "" : ","
+            );
+        }
+        printf("  ],\n");
+        printf("  \"distance_bins\": [\n");
+        for (int i = 0; i < N_DISTANCE_BINS; ++i) {
+            ShadowErrors e = distance_errors[i];
+            double n = e.n_receivers > 0 ? e.n_receivers : 1;
+            printf(
+                "    {\"distance\": %.3f, \"n_receivers\": %lld, "
+                "\"error_rate\": %.5f}%s\n",
+                min_distance + (i + 0.5) * bin_size,
+                e.n_receivers,
+                (e.n_false_lit + e.n_false_shadowed) / n,
+                i == N_DISTANCE_BINS - 1 ? "" : ","
+            );
+        }
+        printf("  ]\n");
+        printf("}\n");
+    } else {
+        printf(
+            "frames: %d, triangles: %d, resolution: %d, bias: %g\n",
+            n_frames,
+            n_triangles,
+            resolution,
+            bias
+        );
+        printf(
+            "bvh build: %.3f ms, shadow rays: %.1f Mrays/sec\n",
+            bvh_build_ns * 1e-6,
+            n_rays / (trace_ns * 1e-9) * 1e-6
+        );
+        printf(
+            "%-8s %12s %12s %16s\n", "cascade", "receivers", "false-lit", "false-shadowed"
+        );
+        for (int i = 0; i < n_cascades; ++i) {
+            ShadowErrors e = cascade_errors[i];
+            double n = e.n_receivers > 0 ? e.n_receivers : 1;
+            printf(
+                "%-8d %12lld %11.3f%% %15.3f%%\n",
+                i,
+                e.n_receivers,
+                100.0 * e.n_false_lit / n,
+                100.0 * e.n_false_shadowed / n
+            );
+        }
+        printf("%-10s %12s %10s\n", "distance", "receivers", "error");
+        for (int i = 0; i < N_DISTANCE_BINS; ++i) {
+            ShadowErrors e = distance_errors[i];
+            double n = e.n_receivers > 0 ? e.n_receivers : 1;
+            printf(
+                "%-10.2f %12lld %9.3f%%\n",
+                min_distance + (i + 0.5) * bin_size,
+                e.n_receivers,
+                100.0 * (e.n_false_lit + e.n_false_shadowed) / n
+            );
+        }
+    }
+
+    return 0;
+}
+
+static void add_shadow_errors(ShadowErrors *dst, ShadowErrors src) {
+    dst->n_receivers += src.n_receivers;
+    dst->n_false_lit += src.n_false_lit;
+    dst->n_false_shadowed += src.n_false_shadowed;
+}
+
+static bool is_shadowed_by_map(
+    const DepthRaster *map,
+    Frustum light_frustum,
+    Matrix light_view_proj,
+    Vector3 p,
+    float bias
+) {
+    // Outside of the map nothing is shadowed (as with the clamp-to-border 1.0)
+    Vector3 ndc = Vector3Transform(p, light_view_proj);
+    if (ndc.x < -1.0 || ndc.x > 1.0 || ndc.y < -1.0 || ndc.y > 1.0) return false;
+
+    int x = (int)((ndc.x * 0.5 + 0.5) * map->width);
+    int y = (int)((ndc.y * 0.5 + 0.5) * map->height);
+    x = x >= map->width ? map->width - 1 : x;
+    y = y >= map->height ? map->height - 1 : y;
+
+    // Ortho depth is linear: the window depth is the light space z over the range
+    float depth = ndc.z * 0.5 + 0.5;
+    float depth_bias = bias * 0.5 * fabsf(light_frustum.proj.m10);
+
+    return depth - depth_bias > map->depth[y * map->width + x];
+}
+
+static Vector3 get_shadow_ray_origin(const ComparisonJob *job, int receiver) {
+    const Vector3 *points = job->receivers;
+    const float *depth = job->receivers_depth;
+    int x = receiver % RECEIVERS_WIDTH;
+    int y = receiver / RECEIVERS_WIDTH;
+    Vector3 p = points[receiver];
+
+    // -------------------------------------------------------------------
+    // Tangents by the neighbour receivers closer to p on each axis (the
+    // farther ones may be across a depth discontinuity)
+    Vector3 tangents[2];
+    for (int axis = 0; axis < 2; ++axis) {
+        int step = axis == 0 ? 1 : RECEIVERS_WIDTH;
+        int coord = axis == 0 ? x : y;
+        int size = axis == 0 ? RECEIVERS_WIDTH : RECEIVERS_HEIGHT;
+        bool has_prev = coord > 0 && depth[receiver - step] < 1.0;
+        bool has_next = coord + 1 < size && depth[receiver + step] < 1.0;
+        Vector3 prev = has_prev ? Vector3Subtract(p, points[receiver - step]) : p;
+        Vector3 next = has_next ? Vector3Subtract(points[receiver + step], p) : p;
+
+        tangents[axis] = Vector3Zero();
+        if (has_prev && has_next) {
+            bool is_prev_closer = Vector3LengthSqr(prev) < Vector3LengthSqr(next);
+            tangents[axis] = is_prev_closer ? prev : next;
+        } else if (has_prev || has_next) {
+            tangents[axis] = has_prev ? prev : next;
+        }
+    }
+
+    // -------------------------------------------------------------------
+    // Normal facing the camera, the isolated receivers go towards the camera
+    Vector3 to_camera = Vector3Subtract(job->camera_position, p);
+    Vector3 normal = Vector3CrossProduct(tangents[0], tangents[1]);
+    if (Vector3DotProduct(normal, to_camera) < 0.0) normal = Vector3Negate(normal);
+    if (Vector3LengthSqr(normal) == 0.0) normal = to_camera;
+    float offset = RAY_NORMAL_OFFSET * Vector3Length(to_camera);
+
+    return Vector3Add(p, Vector3Scale(Vector3Normalize(normal), offset));
+}
+
+static void run_comparison_chunk(void *ctx, int chunk) {
+    ComparisonJob *job = ctx;
+    ShadowErrors *cascade_errors = job->cascade_errors[chunk];
+    ShadowErrors *distance_errors = job->distance_errors[chunk];
+    memset(cascade_errors, 0, sizeof(job->cascade_errors[chunk]));
+    memset(distance_errors, 0, sizeof(job->distance_errors[chunk]));
+
+    const FrustumsCascade *camera_cascade = job->camera_cascade;
+    Matrix view = camera_cascade->frustums[0].view;
+    float min_distance = camera_cascade->planes[0];
+    float max_distance = camera_cascade->planes[camera_cascade->n_frustums];
+
+    int begin = chunk * RECEIVERS_CHUNK_SIZE;
+    int end = begin + RECEIVERS_CHUNK_SIZE;
+    if (end > N_RECEIVERS) end = N_RECEIVERS;
+
+    // -------------------------------------------------------------------
+    // Gather the packets of 4 receivers (background samples are skipped)
+    int ids[4];
+    int n = 0;
+    for (int i = begin; i <= end; ++i) {
+        bool is_flush = i == end || n == 4;
+        if (is_flush && n > 0) {
+            Vector3 origins[4];
+            for (int j = 0; j < 4; ++j) {
+                origins[j] = get_shadow_ray_origin(job, ids[j < n ? j : 0]);
+            }
+            int mask = get_bvh_occluded_mask_x4(
+                job->bvh, origins, job->to_light, RAY_MIN_T, RAY_MAX_T
+            );
+
+            for (int j = 0; j < n; ++j) {
+                Vector3 p = job->receivers[ids[j]];
+                float distance = -Vector3Transform(p, view).z;
+
+                int cascade = camera_cascade->n_frustums - 1;
+                for (int k = 0; k < camera_cascade->n_frustums; ++k) {
+                    if (distance < camera_cascade->planes[k + 1]) {
+                        cascade = k;
+                        break;
+                    }
+                }
+                bool is_map_shadowed = is_shadowed_by_map(
+                    &job->shadow_maps[cascade],
+                    job->light_cascade->frustums[cascade],
+                    job->light_view_projs[cascade],
+                    p,
+                    job->bias
+                );
+                bool is_ray_shadowed = (mask >> j) & 1;
+
+                int bin = (int)((distance - min_distance) / (max_distance - min_distance)
+                                * N_DISTANCE_BINS);
+                bin = bin < 0 ? 0 : (bin >= N_DISTANCE_BINS ? N_DISTANCE_BINS - 1 : bin);
+
+                ShadowErrors *errors[2] = {
+                    &cascade_errors[cascade], &distance_errors[bin]};
+                for (int e = 0; e < 2; ++e) {
+                    errors[e]->n_receivers += 1;
+                    errors[e]->n_false_lit += is_ray_shadowed && !is_map_shadowed;
+                    errors[e]->n_false_shadowed += !is_ray_shadowed && is_map_shadowed;
+                }
+            }
+            n = 0;
+        }
+
+        if (i < end && job->receivers_depth[i] < 1.0) ids[n++] = i;
+    }
+}
+
+static int create_scene(int n_boxes) {
+    // Boxes are scattered on the ground grid around the origin (as in headless)
+    int n_per_side = 1;
+    while (n_per_side * n_per_side < n_boxes) ++n_per_side;
+
+    float spacing = 2.0;
+    float offset = -0.5 * spacing * (n_per_side - 1);
+    Vector3 *v = TRIANGLES;
+    for (int i = 0; i < n_boxes; ++i) {
+        int x = i % n_per_side;
+        int z = i / n_per_side;
+        Vector3 center = {offset + spacing * x, 0.0, offset + spacing * z};
+        float height = 0.5 + 0.3 * ((3 * x + 7 * z) % 5);
+        BOXES[i] = (BoundingBox){
+            (Vector3){center.x - 0.3, 0.0, center.z - 0.3},
+            (Vector3){center.x + 0.3, height, center.z + 0.3}};
+        get_box_triangles(BOXES[i], v);
+        v += 3 * RASTER_N_BOX_TRIANGLES;
+    }
+
+    float size = 64.0;
+    Vector3 ground[4] = {
+        {-size, 0.0, -size}, {-size, 0.0, size}, {size, 0.0, size}, {size, 0.0, -size}};
+    *v++ = ground[0], *v++ = ground[1], *v++ = ground[2];
+    *v++ = ground[0], *v++ = ground[2], *v++ = ground[3];
+
+    return (int)(v - TRIANGLES) / 3;
+}
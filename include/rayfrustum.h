@@ -0,0 +1,676 @@
+#ifndef RAYFRUSTUM_H
+#define RAYFRUSTUM_H
+
+#include "raylib.h"
+
+typedef struct Frustum {
+    // near_left_bot, near_left_top, near_right_top, near_right_bot
+    // far_left_bot, far_left_top, far_right_top, far_right_bot
+    Vector3 corners[8];
+
+    // left, right, bot, top, near, far
+    // (xyz - inward unit normal, w - offset, inside points have dot(n, p) + w >= 0)
+    Vector4 sides[6];
+
+    Matrix view;
+    Matrix proj;
+} Frustum;
+
+#define MAX_N_FRUSTUMS_IN_CASCADE 9
+typedef struct FrustumsCascade {
+    int n_frustums;
+    Frustum frustums[MAX_N_FRUSTUMS_IN_CASCADE];
+    float planes[MAX_N_FRUSTUMS_IN_CASCADE + 1];
+} FrustumsCascade;
+
+// Everything the cascades of a single frame depend on
+typedef struct FrameInput {
+    Camera3D camera;
+    float aspect;
+    int n_planes;
+    float planes[MAX_N_FRUSTUMS_IN_CASCADE + 1];
+    Vector3 light_direction;
+} FrameInput;
+
+typedef enum FrameStage {
+    FRAME_STAGE_CAMERA_CASCADE,
+    FRAME_STAGE_LIGHT_CASCADE,
+    FRAME_STAGE_CULLING,
+    N_FRAME_STAGES
+} FrameStage;
+
+// Cascades of a single frame plus the culling results of the scene boxes.
+// i-th bit of the box mask is set if the box intersects i-th frustum of the cascade
+#define MAX_N_CULLED_BOXES 4096
+typedef struct FrameResult {
+    FrustumsCascade camera_cascade;
+    FrustumsCascade light_cascade;
+    int n_boxes;
+    unsigned short camera_masks[MAX_N_CULLED_BOXES];
+    unsigned short light_masks[MAX_N_CULLED_BOXES];
+
+    // Stage timestamps (see rfprofiler.h), taken on the computing thread. They
+    // stay 0 unless rfprofiler.h is included before the implementation
+    long long stage_begin_ns[N_FRAME_STAGES];
+    long long stage_end_ns[N_FRAME_STAGES];
+} FrameResult;
+
+Frustum get_frustum_of_camera(Camera3D camera, float aspect, float near, float far);
+Frustum get_frustum_of_view_proj(Matrix view, Matrix proj);
+Frustum get_frustum_of_directional_light(Frustum camera_frustum, Vector3 light_direction);
+
+// Perspective frustum of the spot light (the cone with the half angle in
+// degrees, less than 90, and the range), tightened to the part of the cone
+// inside the camera frustum. The cone is bounded by its circumscribing square
+// pyramid, so the near/far and asymmetric FOV are a conservative bound of the
+// pyramid part inside the camera frustum, not of the cone itself. Returns
+// false (and leaves the light frustum untouched) if the pyramid doesn't reach
+// the camera frustum at all
+bool get_frustum_of_spot_light(
+    Frustum camera_frustum,
+    Vector3 position,
+    Vector3 direction,
+    float half_angle,
+    float range,
+    Frustum *light_frustum
+);
+
+// Vertices of the intersection of two frustums (convex polyhedrons): the
+// corners of each one inside the other and the crossings of the edges of each
+// one with the sides of the other. Returns their number, 0 if the frustums
+// don't intersect
+#define MAX_N_FRUSTUMS_INTERSECTION_POINTS (2 * 8 + 2 * 12 * 6)
+int get_frustums_intersection_points(
+    Frustum a, Frustum b, Vector3 points[MAX_N_FRUSTUMS_INTERSECTION_POINTS]
+);
+
+// Exact test of two frustums with the separating axis theorem: the axes are
+// the side normals of both and the cross products of their edge directions.
+// The corners are projected 4 at a time, the cheapest axes go first
+bool are_frustums_intersecting(Frustum a, Frustum b);
+
+float get_frustum_volume(Frustum f);
+
+// Cheap estimate of the a and b intersection volume (e.g. to prioritize the
+// lights): the fraction of the FRUSTUMS_OVERLAP_N_SAMPLES^3 grid cells of a
+// with the centers inside of b times the volume of a
+#define FRUSTUMS_OVERLAP_N_SAMPLES 8
+float get_frustums_overlap_volume(Frustum a, Frustum b);
+
+FrustumsCascade get_frustums_cascade_of_camera(
+    Camera3D camera,
+    float aspect,
+    float planes[MAX_N_FRUSTUMS_IN_CASCADE + 1],
+    int n_planes
+);
+FrustumsCascade get_frustums_cascade_of_directional_light(
+    FrustumsCascade camera_frustums_cascade, Vector3 light_direction
+);
+
+Vector3 get_direction_from_azimuth_attitude(float azimuth_deg, float attitude_deg);
+
+bool is_box_in_frustum(Frustum frustum, BoundingBox box);
+void cull_boxes_by_cascade(
+    FrustumsCascade cascade, BoundingBox *boxes, int n_boxes, unsigned short *masks
+);
+void compute_frame_result(
+    FrameInput input, BoundingBox *boxes, int n_boxes, FrameResult *result
+);
+bool is_frame_input_equal(FrameInput a, FrameInput b);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raylib.h"
+#include "raymath.h"
+#include "rfsimd.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The profiler needs _POSIX_C_SOURCE (clock_gettime), so the core header
+// doesn't include it and stamps the stages only if it's already included
+#if defined(RFPROFILER_H) && !defined(RFPROFILER_DISABLE)
+#define FRAME_STAGE_STAMP(time_ns) PROFILE_STAMP(time_ns)
+#else
+#define FRAME_STAGE_STAMP(time_ns)
+#endif
+
+Frustum get_frustum_of_view_proj(Matrix view, Matrix proj) {
+    Frustum frustum = {.view = view, .proj = proj};
+    Matrix m = MatrixMultiply(view, proj);
+
+    // -------------------------------------------------------------------
+    // Unproject NDC cube corners (same as Vector3Unproject, but the
+    // view-projection matrix is inverted only once for all 8 corners)
+    static const Vector3 ndc_corners[8] = {
+        {-1.0, -1.0, -1.0},
+        {-1.0, 1.0, -1.0},
+        {1.0, 1.0, -1.0},
+        {1.0, -1.0, -1.0},
+        {-1.0, -1.0, 1.0},
+        {-1.0, 1.0, 1.0},
+        {1.0, 1.0, 1.0},
+        {1.0, -1.0, 1.0}};
+    Matrix inv = MatrixInvert(m);
+    for (int i = 0; i < 8; ++i) {
+        Vector3 p = ndc_corners[i];
+        float x = inv.m0 * p.x + inv.m4 * p.y + inv.m8 * p.z + inv.m12;
+        float y = inv.m1 * p.x + inv.m5 * p.y + inv.m9 * p.z + inv.m13;
+        float z = inv.m2 * p.x + inv.m6 * p.y + inv.m10 * p.z + inv.m14;
+        float w = inv.m3 * p.x + inv.m7 * p.y + inv.m11 * p.z + inv.m15;
+        frustum.corners[i] = (Vector3){x / w, y / w, z / w};
+    }
+
+    // -------------------------------------------------------------------
+    // Extract clipping planes from the rows of the view-projection matrix
+    Vector4 rows[4] = {
+        {m.m0, m.m4, m.m8, m.m12},
+        {m.m1, m.m5, m.m9, m.m13},
+        {m.m2, m.m6, m.m10, m.m14},
+        {m.m3, m.m7, m.m11, m.m15}};
+
+    for (int i = 0; i < 6; ++i) {
+        // Sides come in pairs: w + x, w - x, w + y, w - y, w + z, w - z
+        Vector4 r = rows[i / 2];
+        float sign = i % 2 == 0 ? 1.0 : -1.0;
+        Vector4 s = {
+            rows[3].x + sign * r.x,
+            rows[3].y + sign * r.y,
+            rows[3].z + sign * r.z,
+            rows[3].w + sign * r.w};
+        float length = sqrtf(s.x * s.x + s.y * s.y + s.z * s.z);
+        frustum.sides[i] = (Vector4){
+            s.x / length, s.y / length, s.z / length, s.w / length};
+    }
+
+    return frustum;
+}
+
+Frustum get_frustum_of_camera(Camera3D camera, float aspect, float near, float far) {
+    Matrix view = MatrixLookAt(camera.position, camera.target, camera.up);
+    Matrix proj = {0};
+
+    if (camera.projection == CAMERA_PERSPECTIVE) {
+        proj = MatrixPerspective(DEG2RAD * camera.fovy, aspect, near, far);
+    } else if (camera.projection == CAMERA_ORTHOGRAPHIC) {
+        double top = camera.fovy / 2.0;
+        double right = top * aspect;
+        proj = MatrixOrtho(-right, right, -top, top, near, far);
+    }
+
+    return get_frustum_of_view_proj(view, proj);
+}
+
+Frustum get_frustum_of_directional_light(
+    Frustum camera_frustum, Vector3 light_direction
+) {
+    light_direction = Vector3Normalize(light_direction);
+
+    // Calculate frustum bounding box in the light space
+    Matrix light_view = MatrixLookAt(
+        Vector3Zero(), light_direction, (Vector3){0.0, 1.0, 0.0}
+    );
+    float min_x = FLT_MAX, min_y = FLT_MAX, min_z = FLT_MAX, max_x = -FLT_MAX,
+          max_y = -FLT_MAX, max_z = -FLT_MAX;
+
+    for (int i = 0; i < 8; ++i) {
+        // Project frustum to the light space
+        Vector3 corner = Vector3Transform(camera_frustum.corners[i], light_view);
+
+        min_x = fminf(min_x, corner.x);
+        min_y = fminf(min_y, corner.y);
+        min_z = fminf(min_z, corner.z);
+        max_x = fmaxf(max_x, corner.x);
+        max_y = fmaxf(max_y, corner.y);
+        max_z = fmaxf(max_z, corner.z);
+    }
+
+    // Calculate light position in the light space
+    Vector3 light_pos = {
+        (min_x + max_x) / 2.0,
+        (min_y + max_y) / 2.0,
+        (min_z + max_z) / 2.0,
+    };
+
+    // Calculate light position in the world space. The light view has no
+    // translation, so its inverse is just the transposed rotation
+    Matrix r = light_view;
+    light_pos = (Vector3){
+        r.m0 * light_pos.x + r.m1 * light_pos.y + r.m2 * light_pos.z,
+        r.m4 * light_pos.x + r.m5 * light_pos.y + r.m6 * light_pos.z,
+        r.m8 * light_pos.x + r.m9 * light_pos.y + r.m10 * light_pos.z};
+
+    // Moving the light changes only the translation of its view, so the
+    // frustum bounding box in the new light space is the same box centered
+    // at the origin and there is no need to project the corners again
+    light_view = MatrixLookAt(
+        light_pos, Vector3Add(light_pos, light_direction), (Vector3){0.0, 1.0, 0.0}
+    );
+    float half_x = (max_x - min_x) / 2.0;
+    float half_y = (max_y - min_y) / 2.0;
+    float half_z = (max_z - min_z) / 2.0;
+    Matrix light_proj = MatrixOrtho(-half_x, half_x, -half_y, half_y, -half_z, half_z);
+    Frustum light_frustum = get_frustum_of_view_proj(light_view, light_proj);
+
+    return light_frustum;
+}
+
+// Corner pairs of the 12 frustum edges: near quad, far quad, near to far
+static const int FRUSTUM_EDGES[12][2] = {
+    {0, 1}, {1, 2}, {2, 3}, {3, 0}, {4, 5}, {5, 6},
+    {6, 7}, {7, 4}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+// Tolerance of the points lying on the sides
+#define FRUSTUM_SIDE_EPSILON 1e-4
+
+static bool is_point_inside_sides(const Vector4 sides[6], Vector3 p) {
+    for (int i = 0; i < 6; ++i) {
+        Vector4 s = sides[i];
+        if (s.x * p.x + s.y * p.y + s.z * p.z + s.w < -FRUSTUM_SIDE_EPSILON) return false;
+    }
+
+    return true;
+}
+
+static int add_frustum_intersection_points(Frustum a, Frustum b, Vector3 *points) {
+    int n = 0;
+
+    // Corners of a inside b
+    for (int i = 0; i < 8; ++i) {
+        if (is_point_inside_sides(b.sides, a.corners[i])) points[n++] = a.corners[i];
+    }
+
+    // Edges of a crossing the sides of b
+    for (int i = 0; i < 12; ++i) {
+        Vector3 p = a.corners[FRUSTUM_EDGES[i][0]];
+        Vector3 q = a.corners[FRUSTUM_EDGES[i][1]];
+        for (int j = 0; j < 6; ++j) {
+            Vector4 s = b.sides[j];
+            float dp = s.x * p.x + s.y * p.y + s.z * p.z + s.w;
+            float dq = s.x * q.x + s.y * q.y + s.z * q.z + s.w;
+            if ((dp < 0.0) == (dq < 0.0)) continue;
+
+            Vector3 x = Vector3Lerp(p, q, dp / (dp - dq));
+            if (is_point_inside_sides(b.sides, x)) points[n++] = x;
+        }
+    }
+
+    return n;
+}
+
+int get_frustums_intersection_points(
+    Frustum a, Frustum b, Vector3 points[MAX_N_FRUSTUMS_INTERSECTION_POINTS]
+) {
+    // The edge crossings of a are inside a by construction (and so for b)
+    int n = add_frustum_intersection_points(a, b, points);
+    n += add_frustum_intersection_points(b, a, points + n);
+
+    return n;
+}
+
+// Frustum corners in the SIMD layout: 2 vectors of 4 corners per coordinate
+typedef struct FrustumCornersX4 {
+    f32x4 x[2];
+    f32x4 y[2];
+    f32x4 z[2];
+} FrustumCornersX4;
+
+static FrustumCornersX4 get_frustum_corners_x4(Frustum f) {
+    FrustumCornersX4 c;
+    for (int i = 0; i < 2; ++i) {
+        const Vector3 *p = &f.corners[4 * i];
+        c.x[i] = (f32x4){p[0].x, p[1].x, p[2].x, p[3].x};
+        c.y[i] = (f32x4){p[0].y, p[1].y, p[2].y, p[3].y};
+        c.z[i] = (f32x4){p[0].z, p[1].z, p[2].z, p[3].z};
+    }
+
+    return c;
+}
+
+static bool is_side_separating(Vector4 side, const FrustumCornersX4 *c) {
+    // All corners are outside of the side
+    f32x4 d0 = c->x[0] * side.x + c->y[0] * side.y + c->z[0] * side.z + side.w;
+    f32x4 d1 = c->x[1] * side.x + c->y[1] * side.y + c->z[1] * side.z + side.w;
+
+    return !i32x4_any((d0 >= 0.0f) | (d1 >= 0.0f));
+}
+
+static bool is_axis_separating(
+    Vector3 axis, const FrustumCornersX4 *a, const FrustumCornersX4 *b
+) {
+    f32x4 a0 = a->x[0] * axis.x + a->y[0] * axis.y + a->z[0] * axis.z;
+    f32x4 a1 = a->x[1] * axis.x + a->y[1] * axis.y + a->z[1] * axis.z;
+    f32x4 b0 = b->x[0] * axis.x + b->y[0] * axis.y + b->z[0] * axis.z;
+    f32x4 b1 = b->x[1] * axis.x + b->y[1] * axis.y + b->z[1] * axis.z;
+
+    return f32x4_reduce_max(f32x4_max(a0, a1)) < f32x4_reduce_min(f32x4_min(b0, b1))
+           || f32x4_reduce_max(f32x4_max(b0, b1)) < f32x4_reduce_min(f32x4_min(a0, a1));
+}
+
+static void get_frustum_edge_directions(Frustum f, Vector3 directions[6]) {
+    // The far quad edges are parallel to the near quad ones
+    directions[0] = Vector3Subtract(f.corners[3], f.corners[0]);
+    directions[1] = Vector3Subtract(f.corners[1], f.corners[0]);
+    for (int i = 0; i < 4; ++i) {
+        directions[2 + i] = Vector3Subtract(f.corners[4 + i], f.corners[i]);
+    }
+}
+
+bool are_frustums_intersecting(Frustum a, Frustum b) {
+    FrustumCornersX4 ca = get_frustum_corners_x4(a);
+    FrustumCornersX4 cb = get_frustum_corners_x4(b);
+
+    // -------------------------------------------------------------------
+    // Early-outs, from the cheapest: the world axes (bounding boxes), then
+    // the side normals
+    static const Vector3 world_axes[3] = {
+        {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+    for (int i = 0; i < 3; ++i) {
+        if (is_axis_separating(world_axes[i], &ca, &cb)) return false;
+    }
+    for (int i = 0; i < 6; ++i) {
+        if (is_side_separating(a.sides[i], &cb)) return false;
+        if (is_side_separating(b.sides[i], &ca)) return false;
+    }
+
+    // -------------------------------------------------------------------
+    // Edge cross products, the (nearly) parallel edges are skipped: their axes
+    // are covered by the side normals
+    Vector3 edges_a[6], edges_b[6];
+    get_frustum_edge_directions(a, edges_a);
+    get_frustum_edge_directions(b, edges_b);
+    for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 6; ++j) {
+            Vector3 axis = Vector3CrossProduct(edges_a[i], edges_b[j]);
+            float min_length_sqr = 1e-10 * Vector3LengthSqr(edges_a[i])
+                                   * Vector3LengthSqr(edges_b[j]);
+            if (Vector3LengthSqr(axis) <= min_length_sqr) continue;
+            if (is_axis_separating(axis, &ca, &cb)) return false;
+        }
+    }
+
+    return true;
+}
+
+float get_frustum_volume(Frustum f) {
+    // The frustum is split into 6 tetrahedrons along the 0-6 diagonal
+    static const int tets[6][2] = {{1, 2}, {2, 3}, {3, 7}, {7, 4}, {4, 5}, {5, 1}};
+    Vector3 o = f.corners[0];
+    Vector3 d = Vector3Subtract(f.corners[6], o);
+    float volume = 0.0;
+    for (int i = 0; i < 6; ++i) {
+        Vector3 p = Vector3Subtract(f.corners[tets[i][0]], o);
+        Vector3 q = Vector3Subtract(f.corners[tets[i][1]], o);
+        volume += Vector3DotProduct(d, Vector3CrossProduct(p, q));
+    }
+
+    return fabsf(volume) / 6.0;
+}
+
+float get_frustums_overlap_volume(Frustum a, Frustum b) {
+    if (!are_frustums_intersecting(a, b)) return 0.0;
+
+    // -------------------------------------------------------------------
+    // Cell centers of the regular grid in the (x, y, depth) parameters of a
+    // are tested against the sides of b. A cell volume grows with the square
+    // of the slice size along the depth, so the cells are weighted by it
+    int n = FRUSTUMS_OVERLAP_N_SAMPLES;
+    float near_size = Vector3Distance(a.corners[0], a.corners[1]);
+    float far_size = Vector3Distance(a.corners[4], a.corners[5]);
+    float k = near_size > 0.0 ? far_size / near_size : 1.0;
+
+    float inside_weight = 0.0;
+    float total_weight = 0.0;
+    for (int iz = 0; iz < n; ++iz) {
+        float t = (iz + 0.5) / n;
+        float size = 1.0 + t * (k - 1.0);
+        float weight = size * size;
+
+        // Slice corners: left-bot, left-top, right-top, right-bot
+        Vector3 s[4];
+        for (int i = 0; i < 4; ++i) s[i] = Vector3Lerp(a.corners[i], a.corners[4 + i], t);
+
+        for (int iy = 0; iy < n; ++iy) {
+            float v = (iy + 0.5) / n;
+            Vector3 left = Vector3Lerp(s[0], s[1], v);
+            Vector3 right = Vector3Lerp(s[3], s[2], v);
+            Vector3 step = Vector3Scale(Vector3Subtract(right, left), 1.0 / n);
+            Vector3 first = Vector3Add(left, Vector3Scale(step, 0.5));
+
+            for (int ix = 0; ix < n; ix += 4) {
+                f32x4 u = (f32x4){ix, ix + 1, ix + 2, ix + 3};
+                f32x4 x = first.x + u * step.x;
+                f32x4 y = first.y + u * step.y;
+                f32x4 z = first.z + u * step.z;
+                i32x4 is_inside = u < (float)n;
+                for (int i = 0; i < 6; ++i) {
+                    Vector4 side = b.sides[i];
+                    is_inside &= x * side.x + y * side.y + z * side.z + side.w >= 0.0f;
+                }
+                inside_weight += weight * __builtin_popcount(i32x4_get_mask(is_inside));
+            }
+            total_weight += weight * n;
+        }
+    }
+
+    return get_frustum_volume(a) * inside_weight / total_weight;
+}
+
+bool get_frustum_of_spot_light(
+    Frustum camera_frustum,
+    Vector3 position,
+    Vector3 direction,
+    float half_angle,
+    float range,
+    Frustum *light_frustum
+) {
+    if (half_angle <= 0.0 || half_angle >= 90.0 || range <= 0.0) {
+        fprintf(
+            stderr,
+            "ERROR: Spot light half angle must be in (0, 90) and range must be "
+            "positive, but you passed %f and %f\n",
+            half_angle,
+            range
+        );
+        exit(1);
+    }
+    direction = Vector3Normalize(direction);
+
+    // -------------------------------------------------------------------
+    // Whole cone bounded by the square pyramid, up is switched for the
+    // vertical lights
+    Vector3 up = fabsf(direction.y) > 0.99 ? (Vector3){0.0, 0.0, 1.0}
+                                           : (Vector3){0.0, 1.0, 0.0};
+    Matrix view = MatrixLookAt(position, Vector3Add(position, direction), up);
+    float min_near = 1e-3 * range;
+    Frustum cone_frustum = get_frustum_of_view_proj(
+        view, MatrixPerspective(2.0 * DEG2RAD * half_angle, 1.0, min_near, range)
+    );
+
+    Vector3 points[MAX_N_FRUSTUMS_INTERSECTION_POINTS];
+    int n_points = get_frustums_intersection_points(camera_frustum, cone_frustum, points);
+    if (n_points == 0) return false;
+
+    // -------------------------------------------------------------------
+    // Tight depth range and the tangents of the view angles (the points are
+    // in front of the light, beyond its min near)
+    float near = FLT_MAX, far = 0.0;
+    float left = FLT_MAX, right = -FLT_MAX, bottom = FLT_MAX, top = -FLT_MAX;
+    for (int i = 0; i < n_points; ++i) {
+        Vector3 p = Vector3Transform(points[i], view);
+        float depth = fmaxf(-p.z, min_near);
+        near = fminf(near, depth);
+        far = fmaxf(far, depth);
+        left = fminf(left, p.x / depth);
+        right = fmaxf(right, p.x / depth);
+        bottom = fminf(bottom, p.y / depth);
+        top = fmaxf(top, p.y / depth);
+    }
+
+    // Degenerate (touching) intersections still get a valid frustum
+    far = fmaxf(far, near * (1.0 + FRUSTUM_SIDE_EPSILON));
+    float tan_angle = tanf(DEG2RAD * half_angle);
+    float min_size = FRUSTUM_SIDE_EPSILON * tan_angle;
+    right = fmaxf(right, left + min_size);
+    top = fmaxf(top, bottom + min_size);
+
+    Matrix proj = MatrixFrustum(
+        left * near, right * near, bottom * near, top * near, near, far
+    );
+    *light_frustum = get_frustum_of_view_proj(view, proj);
+
+    return true;
+}
+
+FrustumsCascade get_frustums_cascade_of_camera(
+    Camera3D camera,
+    float aspect,
+    float planes[MAX_N_FRUSTUMS_IN_CASCADE + 1],
+    int n_planes
+) {
+    if (n_planes < 2 || n_planes > MAX_N_FRUSTUMS_IN_CASCADE + 1) {
+        fprintf(
+            stderr,
+            "ERROR: Number of frustum planes must be >= 2 and <= %d, but you passed %d\n",
+            MAX_N_FRUSTUMS_IN_CASCADE + 1,
+            n_planes
+        );
+        exit(1);
+    }
+
+    FrustumsCascade cascade = {0};
+    memcpy(cascade.planes, planes, sizeof(planes[0]) * n_planes);
+
+    for (int i = 0; i < n_planes - 1; ++i) {
+        float near = planes[i];
+        float far = planes[i + 1];
+        if (far <= near) {
+            fprintf(stderr, "ERROR: Frustum planes must be in ascending order\n");
+            exit(1);
+        }
+
+        cascade.frustums[cascade.n_frustums++] = get_frustum_of_camera(
+            camera, aspect, near, far
+        );
+    }
+
+    return cascade;
+}
+
+FrustumsCascade get_frustums_cascade_of_directional_light(
+    FrustumsCascade camera_frustums_cascade, Vector3 light_direction
+) {
+    FrustumsCascade cascade = {0};
+    int n_planes = camera_frustums_cascade.n_frustums + 1;
+    memcpy(
+        cascade.planes,
+        camera_frustums_cascade.planes,
+        sizeof(camera_frustums_cascade.planes[0]) * n_planes
+    );
+    cascade.n_frustums = camera_frustums_cascade.n_frustums;
+
+    for (int i = 0; i < cascade.n_frustums; ++i) {
+        Frustum camera_frustum = camera_frustums_cascade.frustums[i];
+        cascade.frustums[i] = get_frustum_of_directional_light(
+            camera_frustum, light_direction
+        );
+    }
+
+    return cascade;
+}
+
+Vector3 get_direction_from_azimuth_attitude(float azimuth_deg, float attitude_deg) {
+    Vector3 result;
+    double azimuth_rad = DEG2RAD * azimuth_deg;
+    double attitude_rad = DEG2RAD * attitude_deg;
+
+    result.x = cos(azimuth_rad) * cos(attitude_rad);
+    result.y = sin(azimuth_rad) * cos(attitude_rad);
+    result.z = sin(attitude_rad);
+
+    return Vector3Normalize(result);
+}
+
+static bool is_box_inside_sides(const Vector4 sides[6], BoundingBox box) {
+    // Conservative test: the box is rejected only if its most inner corner
+    // (with respect to the side normal) is outside of some side
+    for (int i = 0; i < 6; ++i) {
+        Vector4 s = sides[i];
+        float x = s.x >= 0.0 ? box.max.x : box.min.x;
+        float y = s.y >= 0.0 ? box.max.y : box.min.y;
+        float z = s.z >= 0.0 ? box.max.z : box.min.z;
+        if (s.x * x + s.y * y + s.z * z + s.w < 0.0) return false;
+    }
+
+    return true;
+}
+
+bool is_box_in_frustum(Frustum frustum, BoundingBox box) {
+    return is_box_inside_sides(frustum.sides, box);
+}
+
+void cull_boxes_by_cascade(
+    FrustumsCascade cascade, BoundingBox *boxes, int n_boxes, unsigned short *masks
+) {
+    for (int i = 0; i < n_boxes; ++i) {
+        unsigned short mask = 0;
+        for (int j = 0; j < cascade.n_frustums; ++j) {
+            if (is_box_inside_sides(cascade.frustums[j].sides, boxes[i])) mask |= 1 << j;
+        }
+        masks[i] = mask;
+    }
+}
+
+void compute_frame_result(
+    FrameInput input, BoundingBox *boxes, int n_boxes, FrameResult *result
+) {
+    if (n_boxes > MAX_N_CULLED_BOXES) {
+        fprintf(
+            stderr,
+            "ERROR: Number of culled boxes must be <= %d, but you passed %d\n",
+            MAX_N_CULLED_BOXES,
+            n_boxes
+        );
+        exit(1);
+    }
+
+    FRAME_STAGE_STAMP(result->stage_begin_ns[FRAME_STAGE_CAMERA_CASCADE]);
+    result->camera_cascade = get_frustums_cascade_of_camera(
+        input.camera, input.aspect, input.planes, input.n_planes
+    );
+    FRAME_STAGE_STAMP(result->stage_end_ns[FRAME_STAGE_CAMERA_CASCADE]);
+
+    FRAME_STAGE_STAMP(result->stage_begin_ns[FRAME_STAGE_LIGHT_CASCADE]);
+    result->light_cascade = get_frustums_cascade_of_directional_light(
+        result->camera_cascade, input.light_direction
+    );
+    FRAME_STAGE_STAMP(result->stage_end_ns[FRAME_STAGE_LIGHT_CASCADE]);
+
+    FRAME_STAGE_STAMP(result->stage_begin_ns[FRAME_STAGE_CULLING]);
+    result->n_boxes = n_boxes;
+    cull_boxes_by_cascade(result->camera_cascade, boxes, n_boxes, result->camera_masks);
+    cull_boxes_by_cascade(result->light_cascade, boxes, n_boxes, result->light_masks);
+    FRAME_STAGE_STAMP(result->stage_end_ns[FRAME_STAGE_CULLING]);
+}
+
+bool is_frame_input_equal(FrameInput a, FrameInput b) {
+    // Exact comparison: any change of the input must lead to the recomputation.
+    // Split planes beyond n_planes are not used and not compared
+    Camera3D ca = a.camera;
+    Camera3D cb = b.camera;
+    bool is_camera_equal = memcmp(&ca.position, &cb.position, sizeof(Vector3)) == 0
+                           && memcmp(&ca.target, &cb.target, sizeof(Vector3)) == 0
+                           && memcmp(&ca.up, &cb.up, sizeof(Vector3)) == 0
+                           && ca.fovy == cb.fovy && ca.projection == cb.projection;
+    if (!is_camera_equal || a.aspect != b.aspect || a.n_planes != b.n_planes) {
+        return false;
+    }
+    if (memcmp(&a.light_direction, &b.light_direction, sizeof(Vector3)) != 0) {
+        return false;
+    }
+    return memcmp(a.planes, b.planes, a.n_planes * sizeof(float)) == 0;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RAYFRUSTUM_H
@@ -0,0 +1,104 @@
+#ifndef RFALLOC_H
+#define RFALLOC_H
+
+// Heap allocation auditing for the debug builds.
+//
+// Build with -DRFALLOC_AUDIT and link with
+//     -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+// so every allocation of the program (including the statically linked raylib)
+// goes through the counting wrappers below. After the warmup frames the
+// steady-state frame must not allocate at all, otherwise the program aborts.
+//
+// Allocations which are known and accepted (explicit user actions, raylib
+// calls which can't avoid them) are wrapped with ALLOC_AUDIT_IGNORE_BEGIN/END.
+// The ignore scope is per thread.
+//
+// Without RFALLOC_AUDIT all ALLOC_AUDIT_* macros compile to nothing.
+
+#define ALLOC_AUDIT_N_WARMUP_FRAMES 120
+
+#ifdef RFALLOC_AUDIT
+#define ALLOC_AUDIT_BEGIN_FRAME() alloc_audit_begin_frame()
+#define ALLOC_AUDIT_END_FRAME() alloc_audit_end_frame()
+#define ALLOC_AUDIT_IGNORE_BEGIN() alloc_audit_ignore_begin()
+#define ALLOC_AUDIT_IGNORE_END() alloc_audit_ignore_end()
+#else
+#define ALLOC_AUDIT_BEGIN_FRAME()
+#define ALLOC_AUDIT_END_FRAME()
+#define ALLOC_AUDIT_IGNORE_BEGIN()
+#define ALLOC_AUDIT_IGNORE_END()
+#endif
+
+long alloc_audit_get_n_allocs(void);
+void alloc_audit_begin_frame(void);
+void alloc_audit_end_frame(void);
+void alloc_audit_ignore_begin(void);
+void alloc_audit_ignore_end(void);
+
+#if defined(RAYFRUSTUM_IMPLEMENTATION) && defined(RFALLOC_AUDIT)
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static atomic_long N_ALLOCS;
+static _Thread_local int IGNORE_DEPTH;
+
+static long FRAME_BEGIN_N_ALLOCS;
+static int N_AUDITED_FRAMES;
+
+static void count_alloc(void) {
+    if (IGNORE_DEPTH == 0) atomic_fetch_add_explicit(&N_ALLOCS, 1, memory_order_relaxed);
+}
+
+void *__wrap_malloc(size_t size) {
+    count_alloc();
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    count_alloc();
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    count_alloc();
+    return __real_realloc(ptr, size);
+}
+
+long alloc_audit_get_n_allocs(void) {
+    return atomic_load_explicit(&N_ALLOCS, memory_order_relaxed);
+}
+
+void alloc_audit_begin_frame(void) {
+    FRAME_BEGIN_N_ALLOCS = alloc_audit_get_n_allocs();
+}
+
+void alloc_audit_end_frame(void) {
+    long n_allocs = alloc_audit_get_n_allocs() - FRAME_BEGIN_N_ALLOCS;
+    int frame = N_AUDITED_FRAMES++;
+    if (frame < ALLOC_AUDIT_N_WARMUP_FRAMES || n_allocs == 0) return;
+
+    fprintf(
+        stderr,
+        "ERROR: %ld heap allocation(s) in the steady-state frame %d\n",
+        n_allocs,
+        frame
+    );
+    abort();
+}
+
+void alloc_audit_ignore_begin(void) {
+    IGNORE_DEPTH += 1;
+}
+
+void alloc_audit_ignore_end(void) {
+    IGNORE_DEPTH -= 1;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION && RFALLOC_AUDIT
+#endif  // RFALLOC_H
@@ -0,0 +1,480 @@
+#ifndef RFATLAS_H
+#define RFATLAS_H
+
+#include "rayfrustum.h"
+#include <stdbool.h>
+
+// Shadow atlas: the shadow maps of all lights (cascades, spot frustums, point
+// light faces) are the square power-of-two tiles of one big texture.
+//
+// Every frame the caller requests the tiles by the keys (any ids in
+// [0, max_n_keys), e.g. light * N_POINT_LIGHT_FACES + face) with their ideal
+// sizes in texels (see get_shadow_tile_size). The atlas then:
+//     - rounds the ideal sizes to the powers of two with the hysteresis: a
+//       tile grows as soon as its ideal size is well above the current one,
+//       but shrinks only after SHADOW_ATLAS_SHRINK_N_FRAMES frames in a row
+//       well below it, so the sizes don't thrash around the rounding points
+//     - halves all tiles at once until the total area fits into the texel
+//       budget, dropping the least important ones (the smallest ideal sizes)
+//       if even the minimal sizes don't fit, then doubles back the most
+//       important ones while the budget allows
+//     - keeps the tiles which didn't change the size in place, frees the
+//       others and packs the new ones with the quadtree (buddy) allocator,
+//       the largest first. If the fragmentation leaves no block of the
+//       target size, the tile takes a smaller one and keeps it until its
+//       target size changes
+// Tiles which moved or changed the size are marked as new, so their shadow
+// maps have to be rendered even if the light is static.
+//
+// All memory is allocated in shadow_atlas_load.
+
+#define SHADOW_ATLAS_MAX_N_LEVELS 12
+#define SHADOW_ATLAS_SHRINK_N_FRAMES 8
+// Margin (in log2 of the size) around the rounding point of the ideal size
+#define SHADOW_ATLAS_HYSTERESIS 0.25
+
+typedef struct ShadowAtlasRequest {
+    int key;
+    // Ideal tile size in texels, also the priority of the request
+    float size;
+} ShadowAtlasRequest;
+
+typedef struct ShadowAtlasTile {
+    // Texel rectangle in the atlas, size is 0 if the tile is not allocated
+    int x;
+    int y;
+    int size;
+    bool is_new;
+} ShadowAtlasTile;
+
+typedef struct ShadowAtlas {
+    int resolution;
+    int min_tile_size;
+    int n_levels;
+    int max_n_keys;
+
+    // Quadtree nodes, level by level (the root first) and in the Morton order
+    // within a level. Descendants of the free nodes are free
+    unsigned char *nodes;
+    int n_nodes;
+
+    // Per key: the allocated tile, its node, the rounded ideal size (with the
+    // hysteresis, before the budget), the size the tile should have, the one
+    // it had when it was packed (the tile may be smaller, see the packing)
+    // and the number of frames it wanted to shrink
+    ShadowAtlasTile *tiles;
+    int *tile_nodes;
+    int *rounded_sizes;
+    int *target_sizes;
+    int *tile_target_sizes;
+    int *n_shrink_frames;
+    int *request_frames;
+
+    // Requests of the current frame, sorted by the ideal size
+    ShadowAtlasRequest *requests;
+
+    int frame;
+    long long n_used_texels;
+} ShadowAtlas;
+
+// Both sizes must be powers of two
+ShadowAtlas shadow_atlas_load(int resolution, int min_tile_size, int max_n_keys);
+void shadow_atlas_unload(ShadowAtlas *atlas);
+
+// Tiles of the keys which are not requested are freed
+void update_shadow_atlas(
+    ShadowAtlas *atlas,
+    const ShadowAtlasRequest *requests,
+    int n_requests,
+    long long texel_budget
+);
+
+// Screen height in pixels of the camera and light frustums intersection (its
+// bounding sphere, projected at its center depth): roughly the shadow map
+// size which gives one texel per pixel. 0 if the frustums don't intersect
+float get_shadow_tile_size(
+    Frustum camera_frustum, Frustum light_frustum, int screen_height
+);
+
+// Same, but for the already found intersection points (see
+// get_frustums_intersection_points), 0 if there are none
+float get_shadow_tile_size_of_points(
+    Frustum camera_frustum, const Vector3 *points, int n_points, int screen_height
+);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SHADOW_ATLAS_NODE_FREE 0
+#define SHADOW_ATLAS_NODE_SPLIT 1
+#define SHADOW_ATLAS_NODE_USED 2
+
+static bool is_power_of_two(int x) {
+    return x > 0 && (x & (x - 1)) == 0;
+}
+
+static int get_shadow_atlas_level_offset(int level) {
+    return ((1 << (2 * level)) - 1) / 3;
+}
+
+ShadowAtlas shadow_atlas_load(int resolution, int min_tile_size, int max_n_keys) {
+    if (!is_power_of_two(resolution) || !is_power_of_two(min_tile_size)
+        || min_tile_size > resolution || max_n_keys <= 0) {
+        fprintf(
+            stderr,
+            "ERROR: Shadow atlas resolution and min tile size must be powers of two "
+            "(the min tile size <= the resolution) and the max number of keys must "
+            "be positive\n"
+        );
+        exit(1);
+    }
+
+    int n_levels = 1;
+    while ((min_tile_size << (n_levels - 1)) < resolution) n_levels += 1;
+    if (n_levels > SHADOW_ATLAS_MAX_N_LEVELS) {
+        fprintf(
+            stderr,
+            "ERROR: Shadow atlas can't have more than %d levels of tiles\n",
+            SHADOW_ATLAS_MAX_N_LEVELS
+        );
+        exit(1);
+    }
+
+    ShadowAtlas atlas = {
+        .resolution = resolution,
+        .min_tile_size = min_tile_size,
+        .n_levels = n_levels,
+        .max_n_keys = max_n_keys,
+        .n_nodes = get_shadow_atlas_level_offset(n_levels)};
+    int n = max_n_keys;
+    atlas.nodes = calloc(atlas.n_nodes, 1);
+    atlas.tiles = calloc(n, sizeof(ShadowAtlasTile));
+    atlas.tile_nodes = malloc(sizeof(int) * 6 * n);
+    atlas.requests = malloc(sizeof(ShadowAtlasRequest) * n);
+    if (!atlas.nodes || !atlas.tiles || !atlas.tile_nodes || !atlas.requests) {
+        fprintf(stderr, "ERROR: Failed to allocate shadow atlas\n");
+        exit(1);
+    }
+    atlas.rounded_sizes = atlas.tile_nodes + n;
+    atlas.target_sizes = atlas.tile_nodes + 2 * n;
+    atlas.n_shrink_frames = atlas.tile_nodes + 3 * n;
+    atlas.request_frames = atlas.tile_nodes + 4 * n;
+    atlas.tile_target_sizes = atlas.tile_nodes + 5 * n;
+    for (int i = 0; i < n; ++i) {
+        atlas.tile_nodes[i] = -1;
+        atlas.rounded_sizes[i] = 0;
+        atlas.target_sizes[i] = 0;
+        atlas.n_shrink_frames[i] = 0;
+        atlas.request_frames[i] = -1;
+        atlas.tile_target_sizes[i] = 0;
+    }
+
+    return atlas;
+}
+
+void shadow_atlas_unload(ShadowAtlas *atlas) {
+    free(atlas->nodes);
+    free(atlas->tiles);
+    free(atlas->tile_nodes);
+    free(atlas->requests);
+    *atlas = (ShadowAtlas){0};
+}
+
+// -----------------------------------------------------------------------
+// Quadtree
+static int allocate_shadow_atlas_node(
+    ShadowAtlas *atlas, int level, int idx, int target_level
+) {
+    int node = get_shadow_atlas_level_offset(level) + idx;
+    unsigned char *state = &atlas->nodes[node];
+    if (*state == SHADOW_ATLAS_NODE_USED) return -1;
+    if (level == target_level) {
+        if (*state != SHADOW_ATLAS_NODE_FREE) return -1;
+        *state = SHADOW_ATLAS_NODE_USED;
+        return node;
+    }
+    *state = SHADOW_ATLAS_NODE_SPLIT;
+
+    // Already split children go first, so the free space stays in big blocks
+    int child_offset = get_shadow_atlas_level_offset(level + 1);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < 4; ++i) {
+            int child = 4 * idx + i;
+            bool is_split = atlas->nodes[child_offset + child] == SHADOW_ATLAS_NODE_SPLIT;
+            if (is_split != (pass == 0)) continue;
+            int result = allocate_shadow_atlas_node(
+                atlas, level + 1, child, target_level
+            );
+            if (result >= 0) return result;
+        }
+    }
+
+    return -1;
+}
+
+static void free_shadow_atlas_node(ShadowAtlas *atlas, int node) {
+    atlas->nodes[node] = SHADOW_ATLAS_NODE_FREE;
+
+    // Merge the free siblings up
+    int level = 0;
+    while (get_shadow_atlas_level_offset(level + 1) <= node) level += 1;
+    int idx = node - get_shadow_atlas_level_offset(level);
+    while (level > 0) {
+        int first = get_shadow_atlas_level_offset(level) + (idx & ~3);
+        for (int i = 0; i < 4; ++i) {
+            if (atlas->nodes[first + i] != SHADOW_ATLAS_NODE_FREE) return;
+        }
+        level -= 1;
+        idx >>= 2;
+        atlas->nodes[get_shadow_atlas_level_offset(level) + idx] = SHADOW_ATLAS_NODE_FREE;
+    }
+}
+
+static ShadowAtlasTile get_shadow_atlas_node_tile(const ShadowAtlas *atlas, int node) {
+    int level = 0;
+    while (get_shadow_atlas_level_offset(level + 1) <= node) level += 1;
+    int idx = node - get_shadow_atlas_level_offset(level);
+
+    // Morton index: x in the even bits, y in the odd ones
+    int size = atlas->resolution >> level;
+    ShadowAtlasTile tile = {.size = size};
+    for (int i = 0; i < level; ++i) {
+        tile.x |= ((idx >> (2 * i)) & 1) << i;
+        tile.y |= ((idx >> (2 * i + 1)) & 1) << i;
+    }
+    tile.x *= size;
+    tile.y *= size;
+
+    return tile;
+}
+
+static int get_shadow_atlas_level_of_size(const ShadowAtlas *atlas, int size) {
+    int level = 0;
+    while ((atlas->resolution >> level) > size) level += 1;
+    return level;
+}
+
+static void free_shadow_atlas_tile(ShadowAtlas *atlas, int key) {
+    int node = atlas->tile_nodes[key];
+    if (node < 0) return;
+
+    free_shadow_atlas_node(atlas, node);
+    long long size = atlas->tiles[key].size;
+    atlas->n_used_texels -= size * size;
+    atlas->tile_nodes[key] = -1;
+    atlas->tile_target_sizes[key] = 0;
+    atlas->tiles[key] = (ShadowAtlasTile){0};
+}
+
+// -----------------------------------------------------------------------
+// Update
+static int compare_shadow_atlas_requests(const void *a, const void *b) {
+    const ShadowAtlasRequest *ra = a, *rb = b;
+    if (ra->size != rb->size) return ra->size < rb->size ? 1 : -1;
+    return ra->key - rb->key;
+}
+
+static int get_shadow_atlas_rounded_size(ShadowAtlas *atlas, int key, float ideal_size) {
+    float max_log = log2f(atlas->resolution);
+    float min_log = log2f(atlas->min_tile_size);
+    float ideal_log = fminf(fmaxf(log2f(fmaxf(ideal_size, 1.0)), min_log), max_log);
+    int rounded_size = 1 << (int)roundf(ideal_log);
+
+    int size = atlas->rounded_sizes[key];
+    if (size == 0) {
+        atlas->n_shrink_frames[key] = 0;
+        return rounded_size;
+    }
+
+    float current_log = log2f(size);
+    if (ideal_log > current_log + 0.5 + SHADOW_ATLAS_HYSTERESIS) {
+        atlas->n_shrink_frames[key] = 0;
+        return rounded_size;
+    }
+    if (ideal_log < current_log - 0.5 - SHADOW_ATLAS_HYSTERESIS) {
+        atlas->n_shrink_frames[key] += 1;
+        if (atlas->n_shrink_frames[key] >= SHADOW_ATLAS_SHRINK_N_FRAMES) {
+            atlas->n_shrink_frames[key] = 0;
+            return rounded_size;
+        }
+    } else {
+        atlas->n_shrink_frames[key] = 0;
+    }
+
+    return size;
+}
+
+void update_shadow_atlas(
+    ShadowAtlas *atlas,
+    const ShadowAtlasRequest *requests,
+    int n_requests,
+    long long texel_budget
+) {
+    if (n_requests > atlas->max_n_keys) {
+        fprintf(
+            stderr,
+            "ERROR: Number of shadow atlas requests must be <= %d\n",
+            atlas->max_n_keys
+        );
+        exit(1);
+    }
+    atlas->frame += 1;
+    long long atlas_area = (long long)atlas->resolution * atlas->resolution;
+    texel_budget = texel_budget < atlas_area ? texel_budget : atlas_area;
+
+    // -------------------------------------------------------------------
+    // Target sizes
+    int n = 0;
+    for (int i = 0; i < n_requests; ++i) {
+        int key = requests[i].key;
+        if (key < 0 || key >= atlas->max_n_keys) {
+            fprintf(
+                stderr,
+                "ERROR: Shadow atlas key must be in [0, %d)\n",
+                atlas->max_n_keys
+            );
+            exit(1);
+        }
+        if (atlas->request_frames[key] == atlas->frame) continue;
+        if (atlas->request_frames[key] != atlas->frame - 1) atlas->rounded_sizes[key] = 0;
+        atlas->request_frames[key] = atlas->frame;
+        atlas->requests[n++] = requests[i];
+    }
+    qsort(atlas->requests, n, sizeof(ShadowAtlasRequest), compare_shadow_atlas_requests);
+
+    for (int i = 0; i < n; ++i) {
+        int key = atlas->requests[i].key;
+        atlas->rounded_sizes[key] = get_shadow_atlas_rounded_size(
+            atlas, key, atlas->requests[i].size
+        );
+        atlas->target_sizes[key] = atlas->rounded_sizes[key];
+    }
+
+    // Over the budget all tiles are halved (down to the min size) at once, so
+    // they keep their proportions. If that's not enough, the least important
+    // ones are dropped
+    int n_halvings = 0;
+    long long n_budget_texels;
+    while (true) {
+        n_budget_texels = 0;
+        for (int i = 0; i < n; ++i) {
+            int size = atlas->target_sizes[atlas->requests[i].key] >> n_halvings;
+            size = size > atlas->min_tile_size ? size : atlas->min_tile_size;
+            n_budget_texels += (long long)size * size;
+        }
+        if (n_budget_texels <= texel_budget || n_halvings + 1 >= atlas->n_levels) break;
+        n_halvings += 1;
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        int *size = &atlas->target_sizes[atlas->requests[i].key];
+        *size >>= n_halvings;
+        *size = *size > atlas->min_tile_size ? *size : atlas->min_tile_size;
+        if (n_budget_texels > texel_budget) {
+            n_budget_texels -= (long long)*size * *size;
+            *size = 0;
+        }
+    }
+
+    // The halving frees up to 3/4 of the budget, the most important tiles
+    // take it back. The ones which already have the doubled size go first,
+    // so the noise in the importance doesn't move it between the tiles
+    for (int pass = 0; pass < 2 && n_halvings > 0; ++pass) {
+        for (int i = 0; i < n; ++i) {
+            int key = atlas->requests[i].key;
+            long long size = atlas->target_sizes[key];
+            if (size == 0 || size >= atlas->rounded_sizes[key]) continue;
+            if ((atlas->tiles[key].size == 2 * size) != (pass == 0)) continue;
+            if (n_budget_texels + 3 * size * size > texel_budget) continue;
+            n_budget_texels += 3 * size * size;
+            atlas->target_sizes[key] *= 2;
+        }
+    }
+
+    // -------------------------------------------------------------------
+    // Free the tiles which are not requested anymore or changed the target
+    // size. The tile size is not compared: a smaller tile packed after the
+    // fragmentation would be freed and packed again every frame
+    for (int key = 0; key < atlas->max_n_keys; ++key) {
+        atlas->tiles[key].is_new = false;
+        if (atlas->tile_nodes[key] < 0) continue;
+        if (atlas->request_frames[key] != atlas->frame
+            || atlas->target_sizes[key] != atlas->tile_target_sizes[key]) {
+            free_shadow_atlas_tile(atlas, key);
+        }
+    }
+
+    // -------------------------------------------------------------------
+    // Pack the new tiles, the largest first. The budget fits the atlas area,
+    // but the fragmentation may not, then a tile tries the smaller sizes
+    for (int i = 0; i < n; ++i) {
+        int key = atlas->requests[i].key;
+        if (atlas->tile_nodes[key] >= 0 || atlas->target_sizes[key] == 0) continue;
+
+        int level = get_shadow_atlas_level_of_size(atlas, atlas->target_sizes[key]);
+        int node = -1;
+        for (; level < atlas->n_levels && node < 0; ++level) {
+            node = allocate_shadow_atlas_node(atlas, 0, 0, level);
+        }
+        if (node < 0) continue;
+
+        ShadowAtlasTile tile = get_shadow_atlas_node_tile(atlas, node);
+        tile.is_new = true;
+        atlas->tiles[key] = tile;
+        atlas->tile_nodes[key] = node;
+        atlas->tile_target_sizes[key] = atlas->target_sizes[key];
+        atlas->n_used_texels += (long long)tile.size * tile.size;
+    }
+}
+
+// -----------------------------------------------------------------------
+// Importance
+float get_shadow_tile_size(
+    Frustum camera_frustum, Frustum light_frustum, int screen_height
+) {
+    Vector3 points[MAX_N_FRUSTUMS_INTERSECTION_POINTS];
+    int n_points = get_frustums_intersection_points(
+        camera_frustum, light_frustum, points
+    );
+
+    return get_shadow_tile_size_of_points(
+        camera_frustum, points, n_points, screen_height
+    );
+}
+
+float get_shadow_tile_size_of_points(
+    Frustum camera_frustum, const Vector3 *points, int n_points, int screen_height
+) {
+    if (n_points == 0) return 0.0;
+
+    Vector3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+    Vector3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int i = 0; i < n_points; ++i) {
+        min = Vector3Min(min, points[i]);
+        max = Vector3Max(max, points[i]);
+    }
+    Vector3 center = Vector3Scale(Vector3Add(min, max), 0.5);
+    float radius = 0.0;
+    for (int i = 0; i < n_points; ++i) {
+        radius = fmaxf(radius, Vector3Distance(center, points[i]));
+    }
+
+    // Projected diameter: proj.m5 is the y scale, the perspective divides
+    // it by the depth (clamped to the near plane)
+    Matrix proj = camera_frustum.proj;
+    float scale = proj.m5 * screen_height;
+    if (proj.m15 == 0.0) {
+        float depth = -Vector3Transform(center, camera_frustum.view).z;
+        float near = proj.m14 / (proj.m10 - 1.0);
+        scale /= fmaxf(depth, near);
+    }
+
+    return radius * scale;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFATLAS_H
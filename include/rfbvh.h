@@ -0,0 +1,244 @@
+#ifndef RFBVH_H
+#define RFBVH_H
+
+#include "raylib.h"
+#include <stdbool.h>
+
+// Bounding volume hierarchy over a triangle soup for the shadow rays.
+//
+// The BVH is built once (midpoint split of the centroid bounds on the longest
+// axis, up to BVH_MAX_LEAF_SIZE triangles per leaf) and then traversed with
+// the packets of 4 rays sharing the same direction, which is exactly the case
+// of the directional light. Each traversal step tests the node bounds (and the
+// leaf triangles) against all 4 rays at once with the SIMD vector extensions.
+//
+// Only the occlusion (any hit) is computed, not the nearest hit.
+
+#define BVH_MAX_LEAF_SIZE 4
+#define BVH_MAX_DEPTH 64
+
+typedef struct BvhNode {
+    Vector3 min;
+    // Leaf: index of the first triangle, inner: index of the left child
+    // (the right one goes right after it)
+    int first;
+    Vector3 max;
+    // 0 for the inner nodes
+    int count;
+} BvhNode;
+
+typedef struct BvhTriangle {
+    Vector3 v0;
+    Vector3 e1;
+    Vector3 e2;
+} BvhTriangle;
+
+typedef struct Bvh {
+    BvhNode *nodes;
+    int n_nodes;
+    BvhTriangle *triangles;
+    int n_triangles;
+} Bvh;
+
+Bvh bvh_build(const Vector3 *vertices, int n_triangles);
+void bvh_unload(Bvh *bvh);
+
+// Returns the 4-bit mask of the rays (origins[i] + t * direction) which hit
+// anything with t in (min_t, max_t)
+int get_bvh_occluded_mask_x4(
+    const Bvh *bvh, const Vector3 origins[4], Vector3 direction, float min_t, float max_t
+);
+bool is_bvh_ray_occluded(
+    const Bvh *bvh, Vector3 origin, Vector3 direction, float min_t, float max_t
+);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include "rfsimd.h"
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct BvhBuildTask {
+    int node;
+    int begin;
+    int end;
+    int depth;
+} BvhBuildTask;
+
+Bvh bvh_build(const Vector3 *vertices, int n_triangles) {
+    Bvh bvh = {0};
+    int max_n_nodes = 2 * n_triangles + 1;
+    bvh.nodes = malloc(sizeof(BvhNode) * max_n_nodes);
+    bvh.triangles = malloc(sizeof(BvhTriangle) * (n_triangles + 1));
+    int *ids = malloc(sizeof(int) * (n_triangles + 1));
+    Vector3 *centroids = malloc(sizeof(Vector3) * (n_triangles + 1));
+    if (!bvh.nodes || !bvh.triangles || !ids || !centroids) {
+        fprintf(stderr, "ERROR: Failed to allocate BVH\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < n_triangles; ++i) {
+        const Vector3 *v = &vertices[3 * i];
+        ids[i] = i;
+        centroids[i] = Vector3Scale(Vector3Add(Vector3Add(v[0], v[1]), v[2]), 1.0 / 3.0);
+    }
+
+    // -------------------------------------------------------------------
+    // Top-down build with the explicit stack
+    BvhBuildTask stack[BVH_MAX_DEPTH];
+    int n_stack = 0;
+    bvh.n_nodes = 1;
+    stack[n_stack++] = (BvhBuildTask){0, 0, n_triangles, 0};
+    while (n_stack > 0) {
+        BvhBuildTask task = stack[--n_stack];
+        BvhNode *node = &bvh.nodes[task.node];
+
+        Vector3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+        Vector3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+        Vector3 c_min = min, c_max = max;
+        for (int i = task.begin; i < task.end; ++i) {
+            const Vector3 *v = &vertices[3 * ids[i]];
+            for (int j = 0; j < 3; ++j) {
+                min = Vector3Min(min, v[j]);
+                max = Vector3Max(max, v[j]);
+            }
+            c_min = Vector3Min(c_min, centroids[ids[i]]);
+            c_max = Vector3Max(c_max, centroids[ids[i]]);
+        }
+        node->min = min;
+        node->max = max;
+
+        int n = task.end - task.begin;
+        if (n <= BVH_MAX_LEAF_SIZE || task.depth + 2 >= BVH_MAX_DEPTH) {
+            node->first = task.begin;
+            node->count = n;
+            continue;
+        }
+
+        // Midpoint split on the longest centroid axis, if all centroids end
+        // up on one side, the range is just halved
+        Vector3 extent = Vector3Subtract(c_max, c_min);
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                       : (extent.y > extent.z ? 1 : 2);
+        float split = 0.5 * ((&c_min.x)[axis] + (&c_max.x)[axis]);
+        int mid = task.begin;
+        for (int i = task.begin; i < task.end; ++i) {
+            if ((&centroids[ids[i]].x)[axis] < split) {
+                int id = ids[i];
+                ids[i] = ids[mid];
+                ids[mid++] = id;
+            }
+        }
+        if (mid == task.begin || mid == task.end) mid = task.begin + n / 2;
+
+        node->first = bvh.n_nodes;
+        node->count = 0;
+        bvh.n_nodes += 2;
+        stack[n_stack++] = (BvhBuildTask){node->first, task.begin, mid, task.depth + 1};
+        stack[n_stack++] = (BvhBuildTask){node->first + 1, mid, task.end, task.depth + 1};
+    }
+
+    // -------------------------------------------------------------------
+    // Triangles in the leaf order, prepared for Moller-Trumbore
+    for (int i = 0; i < n_triangles; ++i) {
+        const Vector3 *v = &vertices[3 * ids[i]];
+        bvh.triangles[i] = (BvhTriangle){
+            v[0], Vector3Subtract(v[1], v[0]), Vector3Subtract(v[2], v[0])};
+    }
+    bvh.n_triangles = n_triangles;
+
+    free(ids);
+    free(centroids);
+
+    return bvh;
+}
+
+void bvh_unload(Bvh *bvh) {
+    free(bvh->nodes);
+    free(bvh->triangles);
+    *bvh = (Bvh){0};
+}
+
+int get_bvh_occluded_mask_x4(
+    const Bvh *bvh, const Vector3 origins[4], Vector3 direction, float min_t, float max_t
+) {
+    if (bvh->n_triangles == 0) return 0;
+
+    f32x4 ox = {origins[0].x, origins[1].x, origins[2].x, origins[3].x};
+    f32x4 oy = {origins[0].y, origins[1].y, origins[2].y, origins[3].y};
+    f32x4 oz = {origins[0].z, origins[1].z, origins[2].z, origins[3].z};
+    Vector3 inv_dir = {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+    f32x4 zero = f32x4_splat(0.0);
+    f32x4 one = f32x4_splat(1.0);
+    f32x4 t_lo = f32x4_splat(min_t);
+    f32x4 t_hi = f32x4_splat(max_t);
+
+    i32x4 is_active = {-1, -1, -1, -1};
+    int stack[BVH_MAX_DEPTH];
+    int n_stack = 0;
+    stack[n_stack++] = 0;
+
+    while (n_stack > 0) {
+        const BvhNode *node = &bvh->nodes[stack[--n_stack]];
+
+        // -------------------------------------------------------------------
+        // Slab test of the node bounds
+        f32x4 t1x = (node->min.x - ox) * inv_dir.x, t2x = (node->max.x - ox) * inv_dir.x;
+        f32x4 t1y = (node->min.y - oy) * inv_dir.y, t2y = (node->max.y - oy) * inv_dir.y;
+        f32x4 t1z = (node->min.z - oz) * inv_dir.z, t2z = (node->max.z - oz) * inv_dir.z;
+        f32x4 t_enter = f32x4_max(
+            f32x4_max(f32x4_min(t1x, t2x), f32x4_min(t1y, t2y)),
+            f32x4_max(f32x4_min(t1z, t2z), t_lo)
+        );
+        f32x4 t_exit = f32x4_min(
+            f32x4_min(f32x4_max(t1x, t2x), f32x4_max(t1y, t2y)),
+            f32x4_min(f32x4_max(t1z, t2z), t_hi)
+        );
+        if (!i32x4_any(is_active & (t_enter <= t_exit))) continue;
+
+        if (node->count == 0) {
+            stack[n_stack++] = node->first;
+            stack[n_stack++] = node->first + 1;
+            continue;
+        }
+
+        // -------------------------------------------------------------------
+        // Moller-Trumbore, the direction terms are shared by the packet
+        for (int i = node->first; i < node->first + node->count; ++i) {
+            const BvhTriangle *t = &bvh->triangles[i];
+            Vector3 p = Vector3CrossProduct(direction, t->e2);
+            float det = Vector3DotProduct(t->e1, p);
+            if (fabsf(det) < 1e-12f) continue;
+            float inv_det = 1.0f / det;
+
+            f32x4 sx = ox - t->v0.x, sy = oy - t->v0.y, sz = oz - t->v0.z;
+            f32x4 u = (sx * p.x + sy * p.y + sz * p.z) * inv_det;
+            f32x4 qx = sy * t->e1.z - sz * t->e1.y;
+            f32x4 qy = sz * t->e1.x - sx * t->e1.z;
+            f32x4 qz = sx * t->e1.y - sy * t->e1.x;
+            f32x4 v = (qx * direction.x + qy * direction.y + qz * direction.z) * inv_det;
+            f32x4 d = (qx * t->e2.x + qy * t->e2.y + qz * t->e2.z) * inv_det;
+
+            i32x4 is_hit = (u >= zero) & (v >= zero) & (u + v <= one) & (d > t_lo)
+                           & (d < t_hi);
+            is_active &= ~is_hit;
+        }
+        if (!i32x4_any(is_active)) break;
+    }
+
+    int mask = 0;
+    for (int i = 0; i < 4; ++i) mask |= (is_active[i] == 0) << i;
+
+    return mask;
+}
+
+bool is_bvh_ray_occluded(
+    const Bvh *bvh, Vector3 origin, Vector3 direction, float min_t, float max_t
+) {
+    Vector3 origins[4] = {origin, origin, origin, origin};
+    return get_bvh_occluded_mask_x4(bvh, origins, direction, min_t, max_t) != 0;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFBVH_H
@@ -0,0 +1,588 @@
+#ifndef RFCLUSTERS_H
+#define RFCLUSTERS_H
+
+#include "rayfrustum.h"
+#include "rfjobs.h"
+
+// Clustered shading grid: the camera frustum is split into n_x * n_y screen
+// tiles and n_z depth slices, and every cell (froxel) gets its view space
+// bounding box.
+//
+// The slices are exponential (like the cascade planes, the deeper slices are
+// the thicker ones): the k-th slice plane is at near * (far / near)^(k / n_z),
+// so the slice of a view depth is just a log, a mul and an add.
+//
+// The bounds depend only on the projection, not on the camera position and
+// orientation, so update_cluster_grid rebuilds them only when the projection
+// parameters change. They are stored as SoA, with x being the fastest axis:
+//     index = (z * n_y + y) * n_x + x
+// the tile rows go bottom to top (as the DepthImage rows). Every array is
+// padded by 3 floats, so the SIMD loads of the last clusters stay in bounds.
+//
+// Lights (the point light spheres and the spot light cones) are assigned to
+// the clusters by assign_lights_to_clusters. The result is the GPU-ready
+// layout: the offset and count of every cluster in the compact list of the
+// light indices. Depth slices are independent tasks of the job pool, every
+// slice tests its lights against 4 clusters of a tile row at a time.
+//
+// All memory is allocated in cluster_grid_load and cluster_lights_load.
+
+#define CLUSTER_GRID_PADDING 3
+
+typedef struct ClusterGrid {
+    int n_x;
+    int n_y;
+    int n_z;
+    int n_clusters;
+
+    // Projection the bounds are built for
+    bool is_built;
+    int projection;
+    float fovy;
+    float aspect;
+    float near;
+    float far;
+
+    // Half sizes of the view at the unit depth (perspective) or at any depth
+    // (orthographic)
+    float half_x;
+    float half_y;
+
+    // Slice of the view depth d is floor(log(d) * slice_scale + slice_bias)
+    float slice_scale;
+    float slice_bias;
+    // n_z + 1 view depths of the slice planes
+    float *planes;
+
+    // View space bounds (the camera looks along -z, so the z bounds are negative)
+    float *min_x;
+    float *min_y;
+    float *min_z;
+    float *max_x;
+    float *max_y;
+    float *max_z;
+} ClusterGrid;
+
+ClusterGrid cluster_grid_load(int n_x, int n_y, int n_z);
+void cluster_grid_unload(ClusterGrid *grid);
+
+// Rebuilds the bounds if the projection differs from the one they are built
+// for. Returns true if they have been rebuilt
+bool update_cluster_grid(
+    ClusterGrid *grid, Camera3D camera, float aspect, float near, float far
+);
+
+// Depth slice of the view depth (the distance along the view direction) or -1
+// if it's outside of the near and far planes
+int get_cluster_slice(const ClusterGrid *grid, float depth);
+
+// Cluster of the view space point or -1 if it's outside of the frustum
+int get_cluster_of_view_point(const ClusterGrid *grid, Vector3 point);
+
+// -----------------------------------------------------------------------
+// Light assignment
+typedef enum LightType {
+    LIGHT_POINT,
+    LIGHT_SPOT,
+} LightType;
+
+typedef struct Light {
+    LightType type;
+    Vector3 position;
+    float range;
+
+    // Spot lights only: unit direction and the half angle of the cone in degrees
+    Vector3 direction;
+    float half_angle;
+} Light;
+
+typedef struct ClusterLights {
+    int n_clusters;
+    int n_slices;
+    int max_n_lights;
+    int max_n_indices;
+
+    // Lights of the i-th cluster are indices[offsets[i]..offsets[i] + counts[i]]
+    int *offsets;
+    int *counts;
+    int *indices;
+    int n_indices;
+
+    // View space lights of the current assignment (SoA)
+    int n_lights;
+    float *x;
+    float *y;
+    float *z;
+    float *range;
+    float *dir_x;
+    float *dir_y;
+    float *dir_z;
+    float *cos_angle;
+    float *sin_angle;
+    bool *is_spot;
+
+    // Lights of every depth slice (n_slices + 1 offsets into the slice_lights)
+    int *slice_offsets;
+    int *slice_lights;
+    // First and last slice of every light, -1 for the lights out of the grid
+    int *light_slices;
+
+    const ClusterGrid *grid;
+} ClusterLights;
+
+ClusterLights cluster_lights_load(
+    const ClusterGrid *grid, int max_n_lights, int max_n_indices
+);
+void cluster_lights_unload(ClusterLights *cluster_lights);
+
+// Lights are in the world space, the view is the camera view of the grid
+void assign_lights_to_clusters(
+    ClusterLights *cluster_lights,
+    const ClusterGrid *grid,
+    Matrix view,
+    const Light *lights,
+    int n_lights,
+    JobPool *pool
+);
+
+// Writes (up to max_n_light_ids) lights of the view space point and returns
+// the number of them
+int get_cluster_lights_of_view_point(
+    const ClusterLights *cluster_lights,
+    const ClusterGrid *grid,
+    Vector3 point,
+    int *light_ids,
+    int max_n_light_ids
+);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include "rfsimd.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+ClusterGrid cluster_grid_load(int n_x, int n_y, int n_z) {
+    if (n_x <= 0 || n_y <= 0 || n_z <= 0) {
+        fprintf(
+            stderr,
+            "ERROR: Cluster grid size must be positive, but you passed %dx%dx%d\n",
+            n_x,
+            n_y,
+            n_z
+        );
+        exit(1);
+    }
+
+    ClusterGrid grid = {
+        .n_x = n_x, .n_y = n_y, .n_z = n_z, .n_clusters = n_x * n_y * n_z};
+    int n = grid.n_clusters + CLUSTER_GRID_PADDING;
+
+    // Single allocation for all the bounds
+    grid.planes = malloc(sizeof(float) * (n_z + 1));
+    grid.min_x = malloc(sizeof(float) * 6 * n);
+    if (!grid.planes || !grid.min_x) {
+        fprintf(stderr, "ERROR: Failed to allocate cluster grid\n");
+        exit(1);
+    }
+    grid.min_y = grid.min_x + n;
+    grid.min_z = grid.min_y + n;
+    grid.max_x = grid.min_z + n;
+    grid.max_y = grid.max_x + n;
+    grid.max_z = grid.max_y + n;
+    for (int i = 0; i < 6 * n; ++i) grid.min_x[i] = 0.0;
+
+    return grid;
+}
+
+void cluster_grid_unload(ClusterGrid *grid) {
+    free(grid->planes);
+    free(grid->min_x);
+    *grid = (ClusterGrid){0};
+}
+
+bool update_cluster_grid(
+    ClusterGrid *grid, Camera3D camera, float aspect, float near, float far
+) {
+    if (near <= 0.0 || far <= near) {
+        fprintf(stderr, "ERROR: Cluster grid planes must be 0 < near < far\n");
+        exit(1);
+    }
+
+    if (grid->is_built && grid->projection == camera.projection
+        && grid->fovy == camera.fovy && grid->aspect == aspect && grid->near == near
+        && grid->far == far) {
+        return false;
+    }
+
+    grid->is_built = true;
+    grid->projection = camera.projection;
+    grid->fovy = camera.fovy;
+    grid->aspect = aspect;
+    grid->near = near;
+    grid->far = far;
+
+    // -------------------------------------------------------------------
+    // Exponential slice planes
+    int n_x = grid->n_x, n_y = grid->n_y, n_z = grid->n_z;
+    grid->slice_scale = n_z / logf(far / near);
+    grid->slice_bias = -logf(near) * grid->slice_scale;
+    for (int z = 0; z <= n_z; ++z) {
+        grid->planes[z] = near * powf(far / near, (float)z / n_z);
+    }
+    grid->planes[n_z] = far;
+
+    // -------------------------------------------------------------------
+    // View space bounds of the clusters
+    bool is_perspective = camera.projection == CAMERA_PERSPECTIVE;
+    float half_y = is_perspective ? tanf(0.5 * DEG2RAD * camera.fovy) : 0.5 * camera.fovy;
+    float half_x = half_y * aspect;
+    grid->half_x = half_x;
+    grid->half_y = half_y;
+
+    for (int z = 0; z < n_z; ++z) {
+        float d0 = grid->planes[z];
+        float d1 = grid->planes[z + 1];
+
+        // The tile side x = ndc * half_x * d moves outwards with the depth,
+        // so the bounds are the sides at the near or at the far slice plane
+        float s0 = is_perspective ? d0 : 1.0;
+        float s1 = is_perspective ? d1 : 1.0;
+        for (int y = 0; y < n_y; ++y) {
+            float ndc_y0 = -1.0 + 2.0 * y / n_y;
+            float ndc_y1 = -1.0 + 2.0 * (y + 1) / n_y;
+            float min_y = fminf(ndc_y0 * s0, ndc_y0 * s1) * half_y;
+            float max_y = fmaxf(ndc_y1 * s0, ndc_y1 * s1) * half_y;
+
+            for (int x = 0; x < n_x; ++x) {
+                float ndc_x0 = -1.0 + 2.0 * x / n_x;
+                float ndc_x1 = -1.0 + 2.0 * (x + 1) / n_x;
+                int i = (z * n_y + y) * n_x + x;
+
+                grid->min_x[i] = fminf(ndc_x0 * s0, ndc_x0 * s1) * half_x;
+                grid->max_x[i] = fmaxf(ndc_x1 * s0, ndc_x1 * s1) * half_x;
+                grid->min_y[i] = min_y;
+                grid->max_y[i] = max_y;
+                grid->min_z[i] = -d1;
+                grid->max_z[i] = -d0;
+            }
+        }
+    }
+
+    return true;
+}
+
+int get_cluster_slice(const ClusterGrid *grid, float depth) {
+    if (!(depth >= grid->near && depth <= grid->far)) return -1;
+
+    // The log can be off by one near the planes, so it's checked against them
+    int z = (int)(logf(depth) * grid->slice_scale + grid->slice_bias);
+    z = z < 0 ? 0 : (z >= grid->n_z ? grid->n_z - 1 : z);
+    if (z > 0 && depth < grid->planes[z]) z -= 1;
+    else if (z < grid->n_z - 1 && depth >= grid->planes[z + 1]) z += 1;
+
+    return z;
+}
+
+int get_cluster_of_view_point(const ClusterGrid *grid, Vector3 point) {
+    float depth = -point.z;
+    int z = get_cluster_slice(grid, depth);
+    if (z < 0) return -1;
+
+    // Point in the NDC xy
+    float scale = grid->projection == CAMERA_PERSPECTIVE ? depth : 1.0;
+    float ndc_x = point.x / (grid->half_x * scale);
+    float ndc_y = point.y / (grid->half_y * scale);
+    if (ndc_x < -1.0 || ndc_x > 1.0 || ndc_y < -1.0 || ndc_y > 1.0) return -1;
+
+    int x = (int)((ndc_x * 0.5 + 0.5) * grid->n_x);
+    int y = (int)((ndc_y * 0.5 + 0.5) * grid->n_y);
+    x = x >= grid->n_x ? grid->n_x - 1 : x;
+    y = y >= grid->n_y ? grid->n_y - 1 : y;
+
+    return (z * grid->n_y + y) * grid->n_x + x;
+}
+
+// -----------------------------------------------------------------------
+// Light assignment
+ClusterLights cluster_lights_load(
+    const ClusterGrid *grid, int max_n_lights, int max_n_indices
+) {
+    if (max_n_lights <= 0 || max_n_indices <= 0) {
+        fprintf(stderr, "ERROR: Max number of lights and indices must be positive\n");
+        exit(1);
+    }
+
+    ClusterLights cl = {
+        .n_clusters = grid->n_clusters,
+        .n_slices = grid->n_z,
+        .max_n_lights = max_n_lights,
+        .max_n_indices = max_n_indices};
+    int n = max_n_lights;
+
+    cl.offsets = malloc(sizeof(int) * cl.n_clusters);
+    cl.counts = malloc(sizeof(int) * cl.n_clusters);
+    cl.indices = malloc(sizeof(int) * max_n_indices);
+    cl.x = malloc(sizeof(float) * 9 * n);
+    cl.is_spot = malloc(sizeof(bool) * n);
+    cl.slice_offsets = malloc(sizeof(int) * (cl.n_slices + 1));
+    cl.slice_lights = malloc(sizeof(int) * cl.n_slices * n);
+    cl.light_slices = malloc(sizeof(int) * 2 * n);
+    if (!cl.offsets || !cl.counts || !cl.indices || !cl.x || !cl.is_spot
+        || !cl.slice_offsets || !cl.slice_lights || !cl.light_slices) {
+        fprintf(stderr, "ERROR: Failed to allocate cluster lights\n");
+        exit(1);
+    }
+    cl.y = cl.x + n;
+    cl.z = cl.y + n;
+    cl.range = cl.z + n;
+    cl.dir_x = cl.range + n;
+    cl.dir_y = cl.dir_x + n;
+    cl.dir_z = cl.dir_y + n;
+    cl.cos_angle = cl.dir_z + n;
+    cl.sin_angle = cl.cos_angle + n;
+
+    return cl;
+}
+
+void cluster_lights_unload(ClusterLights *cluster_lights) {
+    free(cluster_lights->offsets);
+    free(cluster_lights->counts);
+    free(cluster_lights->indices);
+    free(cluster_lights->x);
+    free(cluster_lights->is_spot);
+    free(cluster_lights->slice_offsets);
+    free(cluster_lights->slice_lights);
+    free(cluster_lights->light_slices);
+    *cluster_lights = (ClusterLights){0};
+}
+
+static bool get_light_tiles(
+    const ClusterGrid *grid,
+    float x,
+    float y,
+    float range,
+    float near_depth,
+    float far_depth,
+    int tiles[4]
+) {
+    // Screen bounds of the view space box of the light sphere between the
+    // depths. The box side over the depth is monotonic, so it's bounded by
+    // its values at the near and at the far depth
+    bool is_perspective = grid->projection == CAMERA_PERSPECTIVE;
+    float inv_a = is_perspective ? 1.0f / near_depth : 1.0f;
+    float inv_b = is_perspective ? 1.0f / far_depth : 1.0f;
+    float inv_half_x = 1.0f / grid->half_x;
+    float inv_half_y = 1.0f / grid->half_y;
+    float ndc_x0 = fminf((x - range) * inv_a, (x - range) * inv_b) * inv_half_x;
+    float ndc_x1 = fmaxf((x + range) * inv_a, (x + range) * inv_b) * inv_half_x;
+    float ndc_y0 = fminf((y - range) * inv_a, (y - range) * inv_b) * inv_half_y;
+    float ndc_y1 = fmaxf((y + range) * inv_a, (y + range) * inv_b) * inv_half_y;
+    if (ndc_x0 > 1.0 || ndc_x1 < -1.0 || ndc_y0 > 1.0 || ndc_y1 < -1.0) return false;
+
+    // Clamped to [-1, 1] first, so the truncation is the floor
+    int n_x = grid->n_x, n_y = grid->n_y;
+    int x0 = (int)((fmaxf(ndc_x0, -1.0) * 0.5 + 0.5) * n_x);
+    int x1 = (int)((fminf(ndc_x1, 1.0) * 0.5 + 0.5) * n_x);
+    int y0 = (int)((fmaxf(ndc_y0, -1.0) * 0.5 + 0.5) * n_y);
+    int y1 = (int)((fminf(ndc_y1, 1.0) * 0.5 + 0.5) * n_y);
+    tiles[0] = x0;
+    tiles[1] = y0;
+    tiles[2] = x1 >= n_x ? n_x - 1 : x1;
+    tiles[3] = y1 >= n_y ? n_y - 1 : y1;
+
+    return true;
+}
+
+static void assign_lights_to_slice(ClusterLights *cl, int z, bool is_writing) {
+    const ClusterGrid *grid = cl->grid;
+    int n_x = grid->n_x, n_y = grid->n_y;
+    float d0 = grid->planes[z];
+    float d1 = grid->planes[z + 1];
+
+    // The counts are recomputed by the writing pass as the cursors
+    int slice_first = z * n_y * n_x;
+    int *counts = cl->counts + slice_first;
+    memset(counts, 0, sizeof(int) * n_x * n_y);
+
+    const i32x4 lanes = {0, 1, 2, 3};
+    f32x4 zero = f32x4_splat(0.0);
+    for (int k = cl->slice_offsets[z]; k < cl->slice_offsets[z + 1]; ++k) {
+        int l = cl->slice_lights[k];
+        float cx = cl->x[l], cy = cl->y[l], cz = cl->z[l], r = cl->range[l];
+
+        // Tiles of the light bounding box within the slice depths
+        int tiles[4];
+        float near_depth = fmaxf(d0, -cz - r);
+        float far_depth = fminf(d1, -cz + r);
+        if (!get_light_tiles(grid, cx, cy, r, near_depth, far_depth, tiles)) continue;
+        int x0 = tiles[0], y0 = tiles[1], x1 = tiles[2], y1 = tiles[3];
+
+        // -------------------------------------------------------------------
+        // Sphere (and cone) against 4 clusters of the tile row at a time
+        f32x4 vcx = f32x4_splat(cx), vcy = f32x4_splat(cy), vcz = f32x4_splat(cz);
+        f32x4 vr = f32x4_splat(r);
+        for (int y = y0; y <= y1; ++y) {
+            int row = slice_first + y * n_x;
+            for (int x = x0; x <= x1; x += 4) {
+                int i = row + x;
+                f32x4 min_x = f32x4_load(&grid->min_x[i]);
+                f32x4 min_y = f32x4_load(&grid->min_y[i]);
+                f32x4 min_z = f32x4_load(&grid->min_z[i]);
+                f32x4 max_x = f32x4_load(&grid->max_x[i]);
+                f32x4 max_y = f32x4_load(&grid->max_y[i]);
+                f32x4 max_z = f32x4_load(&grid->max_z[i]);
+
+                f32x4 dx = f32x4_max(f32x4_max(min_x - vcx, vcx - max_x), zero);
+                f32x4 dy = f32x4_max(f32x4_max(min_y - vcy, vcy - max_y), zero);
+                f32x4 dz = f32x4_max(f32x4_max(min_z - vcz, vcz - max_z), zero);
+                i32x4 is_hit = (dx * dx + dy * dy + dz * dz <= vr * vr)
+                               & (lanes + x <= x1);
+
+                if (cl->is_spot[l] && i32x4_any(is_hit)) {
+                    // Cone against the cluster bounding sphere
+                    f32x4 hx = 0.5f * (max_x - min_x);
+                    f32x4 hy = 0.5f * (max_y - min_y);
+                    f32x4 hz = 0.5f * (max_z - min_z);
+                    f32x4 radius = f32x4_sqrt(hx * hx + hy * hy + hz * hz);
+                    f32x4 vx = min_x + hx - vcx;
+                    f32x4 vy = min_y + hy - vcy;
+                    f32x4 vz = min_z + hz - vcz;
+                    f32x4 v_sq = vx * vx + vy * vy + vz * vz;
+                    f32x4 v_dir = vx * cl->dir_x[l] + vy * cl->dir_y[l]
+                                  + vz * cl->dir_z[l];
+                    f32x4 v_perp = f32x4_sqrt(f32x4_max(v_sq - v_dir * v_dir, zero));
+                    f32x4 closest = v_perp * cl->cos_angle[l] - v_dir * cl->sin_angle[l];
+                    is_hit &= (closest <= radius) & (v_dir <= radius + vr)
+                              & (v_dir >= -radius);
+                }
+
+                int mask = i32x4_get_mask(is_hit);
+                while (mask) {
+                    int j = __builtin_ctz(mask);
+                    int c = i + j - slice_first;
+                    if (is_writing) cl->indices[cl->offsets[i + j] + counts[c]] = l;
+                    counts[c] += 1;
+                    mask &= mask - 1;
+                }
+            }
+        }
+    }
+}
+
+static void count_slice_lights(void *ctx, int z) {
+    assign_lights_to_slice(ctx, z, false);
+}
+
+static void write_slice_lights(void *ctx, int z) {
+    assign_lights_to_slice(ctx, z, true);
+}
+
+void assign_lights_to_clusters(
+    ClusterLights *cluster_lights,
+    const ClusterGrid *grid,
+    Matrix view,
+    const Light *lights,
+    int n_lights,
+    JobPool *pool
+) {
+    ClusterLights *cl = cluster_lights;
+    if (n_lights > cl->max_n_lights || grid->n_clusters != cl->n_clusters
+        || !grid->is_built) {
+        fprintf(
+            stderr,
+            "ERROR: Number of lights must be <= %d and the cluster grid must be "
+            "built and of the same size as the cluster lights\n",
+            cl->max_n_lights
+        );
+        exit(1);
+    }
+    cl->grid = grid;
+    cl->n_lights = n_lights;
+
+    // -------------------------------------------------------------------
+    // Lights to the view space and their slices
+    int n_slices = cl->n_slices;
+    memset(cl->slice_offsets, 0, sizeof(int) * (n_slices + 1));
+    for (int i = 0; i < n_lights; ++i) {
+        Light light = lights[i];
+        Vector3 p = Vector3Transform(light.position, view);
+        Vector3 d = light.direction;
+        cl->x[i] = p.x;
+        cl->y[i] = p.y;
+        cl->z[i] = p.z;
+        cl->range[i] = light.range;
+        cl->dir_x[i] = view.m0 * d.x + view.m4 * d.y + view.m8 * d.z;
+        cl->dir_y[i] = view.m1 * d.x + view.m5 * d.y + view.m9 * d.z;
+        cl->dir_z[i] = view.m2 * d.x + view.m6 * d.y + view.m10 * d.z;
+        cl->cos_angle[i] = cosf(DEG2RAD * light.half_angle);
+        cl->sin_angle[i] = sinf(DEG2RAD * light.half_angle);
+        cl->is_spot[i] = light.type == LIGHT_SPOT;
+
+        float near_depth = -p.z - light.range;
+        float far_depth = -p.z + light.range;
+        int *slices = &cl->light_slices[2 * i];
+        if (far_depth < grid->near || near_depth > grid->far) {
+            slices[0] = slices[1] = -1;
+            continue;
+        }
+        slices[0] = get_cluster_slice(grid, fmaxf(near_depth, grid->near));
+        slices[1] = get_cluster_slice(grid, fminf(far_depth, grid->far));
+        for (int z = slices[0]; z <= slices[1]; ++z) cl->slice_offsets[z + 1] += 1;
+    }
+
+    // Counting sort by the slice, the lights of a slice stay in their order
+    for (int z = 0; z < n_slices; ++z) cl->slice_offsets[z + 1] += cl->slice_offsets[z];
+    for (int i = 0; i < n_lights; ++i) {
+        int *slices = &cl->light_slices[2 * i];
+        for (int z = slices[0]; z <= slices[1] && z >= 0; ++z) {
+            cl->slice_lights[cl->slice_offsets[z]++] = i;
+        }
+    }
+    for (int z = n_slices; z > 0; --z) cl->slice_offsets[z] = cl->slice_offsets[z - 1];
+    cl->slice_offsets[0] = 0;
+
+    // -------------------------------------------------------------------
+    // Count, scan and write
+    job_pool_run(pool, n_slices, count_slice_lights, cl);
+
+    int n_indices = 0;
+    for (int i = 0; i < cl->n_clusters; ++i) {
+        cl->offsets[i] = n_indices;
+        n_indices += cl->counts[i];
+    }
+    if (n_indices > cl->max_n_indices) {
+        fprintf(
+            stderr,
+            "ERROR: Cluster light indices overflow (%d > %d)\n",
+            n_indices,
+            cl->max_n_indices
+        );
+        exit(1);
+    }
+    cl->n_indices = n_indices;
+
+    job_pool_run(pool, n_slices, write_slice_lights, cl);
+}
+
+int get_cluster_lights_of_view_point(
+    const ClusterLights *cluster_lights,
+    const ClusterGrid *grid,
+    Vector3 point,
+    int *light_ids,
+    int max_n_light_ids
+) {
+    int c = get_cluster_of_view_point(grid, point);
+    if (c < 0) return 0;
+
+    int n = cluster_lights->counts[c];
+    n = n < max_n_light_ids ? n : max_n_light_ids;
+    const int *indices = &cluster_lights->indices[cluster_lights->offsets[c]];
+    memcpy(light_ids, indices, sizeof(int) * n);
+
+    return n;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFCLUSTERS_H
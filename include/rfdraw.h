@@ -0,0 +1,864 @@
+#ifndef RFDRAW_H
+#define RFDRAW_H
+
+#include "rayfrustum.h"
+
+// Retained GPU geometry of the frustums (requires the raylib window, i.e. the
+// GL context).
+//
+// Every frame the frustums to draw are pushed into the mesh in the draw
+// order, but the vertex buffers are re-uploaded only if the pushed data
+// differs from the previous frame. Then all wire frustums are drawn with one
+// draw call and all filled frustums with another one (in this order),
+// instead of 12 immediate-mode lines or triangles per frustum.
+//
+// FrustumsInstances draws the frustums without any CPU corners work: a static
+// NDC cube is drawn instanced once per frustum, and the vertex shader
+// unprojects it by the per-instance inverse(view * proj). Thousands of debug
+// frustums cost one draw call for the faces and one for the wires.
+//
+// Wires are expanded to the screen-space quads in the vertex shader (rlgl
+// can draw only the indexed triangles), so their width doesn't depend on
+// the GL line width support.
+
+#define FRUSTUMS_MESH_MAX_N_FRUSTUMS 256
+
+typedef struct FrustumFaceVertex {
+    Vector3 position;
+    Color color;
+} FrustumFaceVertex;
+
+// Each wire edge is a quad: two vertices at each end of the edge, pushed to
+// the opposite sides of the edge's screen-space direction
+typedef struct FrustumWireVertex {
+    Vector3 position;
+    Vector3 other_position;
+    float side;
+    Color color;
+} FrustumWireVertex;
+
+typedef struct FrustumsMesh {
+    int n_faces_frustums;
+    int n_wires_frustums;
+    bool is_faces_dirty;
+    bool is_wires_dirty;
+    FrustumFaceVertex face_vertices[FRUSTUMS_MESH_MAX_N_FRUSTUMS * 8];
+    FrustumWireVertex wire_vertices[FRUSTUMS_MESH_MAX_N_FRUSTUMS * 12 * 4];
+
+    // Number of frustums in the vertex buffers and the number of their
+    // uploads (for the stats)
+    int uploaded_n_faces_frustums;
+    int uploaded_n_wires_frustums;
+    long long n_uploads;
+
+    Shader faces_shader;
+    Shader wires_shader;
+    int faces_mvp_loc;
+    int wires_mvp_loc;
+    int wires_viewport_size_loc;
+    int wires_line_width_loc;
+    int wires_other_position_loc;
+    int wires_side_loc;
+
+    unsigned int faces_vao;
+    unsigned int faces_vbo;
+    unsigned int faces_ibo;
+    unsigned int wires_vao;
+    unsigned int wires_vbo;
+    unsigned int wires_ibo;
+} FrustumsMesh;
+
+#define FRUSTUMS_MAX_N_INSTANCES 16384
+
+typedef struct FrustumInstance {
+    Matrix inv_view_proj;
+    Color color;
+} FrustumInstance;
+
+typedef struct FrustumsInstances {
+    int n_faces_instances;
+    int n_wires_instances;
+    bool is_faces_dirty;
+    bool is_wires_dirty;
+    FrustumInstance faces_instances[FRUSTUMS_MAX_N_INSTANCES];
+    FrustumInstance wires_instances[FRUSTUMS_MAX_N_INSTANCES];
+
+    int uploaded_n_faces_instances;
+    int uploaded_n_wires_instances;
+    long long n_uploads;
+
+    // Instancing needs the vertex array objects support
+    bool is_supported;
+
+    Shader faces_shader;
+    Shader wires_shader;
+    int faces_mvp_loc;
+    int faces_row_locs[4];
+    int wires_mvp_loc;
+    int wires_row_locs[4];
+    int wires_viewport_size_loc;
+    int wires_line_width_loc;
+    int wires_other_position_loc;
+    int wires_side_loc;
+
+    unsigned int faces_vao;
+    unsigned int faces_cube_vbo;
+    unsigned int faces_cube_ibo;
+    unsigned int faces_instances_vbo;
+    unsigned int wires_vao;
+    unsigned int wires_cube_vbo;
+    unsigned int wires_cube_ibo;
+    unsigned int wires_instances_vbo;
+} FrustumsInstances;
+
+void frustums_mesh_load(FrustumsMesh *mesh);
+void frustums_mesh_unload(FrustumsMesh *mesh);
+void frustums_mesh_begin(FrustumsMesh *mesh);
+void frustums_mesh_push_faces(FrustumsMesh *mesh, const Frustum *frustum, Color color);
+void frustums_mesh_push_wires(FrustumsMesh *mesh, const Frustum *frustum, Color color);
+void frustums_mesh_draw(FrustumsMesh *mesh, float line_width);
+
+void frustums_instances_load(FrustumsInstances *instances);
+void frustums_instances_unload(FrustumsInstances *instances);
+void frustums_instances_begin(FrustumsInstances *instances);
+void frustums_instances_push_faces(
+    FrustumsInstances *instances, Matrix inv_view_proj, Color color
+);
+void frustums_instances_push_wires(
+    FrustumsInstances *instances, Matrix inv_view_proj, Color color
+);
+void frustums_instances_draw(FrustumsInstances *instances, float line_width);
+
+Matrix get_frustum_inv_view_proj(const Frustum *frustum);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raylib.h"
+#include "raymath.h"
+#include "rlgl.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// -----------------------------------------------------------------------
+// Shaders. Vertex shaders are assembled from the shared pieces: the mesh
+// shaders take the world positions, the instanced ones take the NDC cube
+// positions and unproject them by the per-instance inverse view-projection
+#if defined(PLATFORM_DESKTOP)  // Shaders for PLATFORM_DESKTOP
+#define FRUSTUM_SHADER_VERT_HEADER \
+    "#version 330\n" \
+    "#define ATTRIBUTE in\n" \
+    "#define VARYING out\n"
+
+static const char *FRUSTUM_SHADER_FRAG = "\
+#version 330\n\
+in vec4 fragColor; \
+out vec4 finalColor; \
+void main() \
+{ \
+    finalColor = fragColor; \
+} \
+";
+
+#else  // Shaders for PLATFORM_ANDROID, PLATFORM_WEB
+#define FRUSTUM_SHADER_VERT_HEADER \
+    "#version 100\n" \
+    "#define ATTRIBUTE attribute\n" \
+    "#define VARYING varying\n"
+
+static const char *FRUSTUM_SHADER_FRAG = "\
+#version 100\n\
+precision mediump float; \
+varying vec4 fragColor; \
+void main() \
+{ \
+    gl_FragColor = fragColor; \
+} \
+";
+#endif
+
+#define FRUSTUM_FACES_SHADER_INPUTS \
+    "ATTRIBUTE vec3 vertexPosition;\n" \
+    "ATTRIBUTE vec4 vertexColor;\n" \
+    "VARYING vec4 fragColor;\n" \
+    "uniform mat4 mvp;\n"
+
+#define FRUSTUM_WIRES_SHADER_INPUTS \
+    FRUSTUM_FACES_SHADER_INPUTS \
+    "ATTRIBUTE vec3 vertexOtherPosition;\n" \
+    "ATTRIBUTE float vertexSide;\n" \
+    "uniform vec2 viewportSize;\n" \
+    "uniform float lineWidth;\n"
+
+#define FRUSTUM_MESH_SHADER_CLIP_POSITION \
+    "vec4 get_clip_position(vec3 position) {\n" \
+    "    return mvp * vec4(position, 1.0);\n" \
+    "}\n"
+
+// Instance matrix is passed by rows (raylib's Matrix memory layout)
+#define FRUSTUM_INSTANCE_SHADER_CLIP_POSITION \
+    "ATTRIBUTE vec4 instanceRow0;\n" \
+    "ATTRIBUTE vec4 instanceRow1;\n" \
+    "ATTRIBUTE vec4 instanceRow2;\n" \
+    "ATTRIBUTE vec4 instanceRow3;\n" \
+    "vec4 get_clip_position(vec3 position) {\n" \
+    "    vec4 p = vec4(position, 1.0);\n" \
+    "    vec4 world = vec4(\n" \
+    "        dot(instanceRow0, p), dot(instanceRow1, p),\n" \
+    "        dot(instanceRow2, p), dot(instanceRow3, p));\n" \
+    "    return mvp * vec4(world.xyz / world.w, 1.0);\n" \
+    "}\n"
+
+#define FRUSTUM_FACES_SHADER_MAIN \
+    "void main() {\n" \
+    "    fragColor = vertexColor;\n" \
+    "    gl_Position = get_clip_position(vertexPosition);\n" \
+    "}\n"
+
+// The edge is clipped by the near plane first, so the perspective division
+// of its ends is always valid
+#define FRUSTUM_WIRES_SHADER_MAIN \
+    "void main() {\n" \
+    "    fragColor = vertexColor;\n" \
+    "    vec4 p = get_clip_position(vertexPosition);\n" \
+    "    vec4 q = get_clip_position(vertexOtherPosition);\n" \
+    "    float p_dist = p.z + p.w;\n" \
+    "    float q_dist = q.z + q.w;\n" \
+    "    if (p_dist < 0.0 && q_dist < 0.0) {\n" \
+    "        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n" \
+    "        return;\n" \
+    "    }\n" \
+    "    if (p_dist < 0.0) p = mix(p, q, p_dist / (p_dist - q_dist));\n" \
+    "    if (q_dist < 0.0) q = mix(q, p, q_dist / (q_dist - p_dist));\n" \
+    "    vec2 dir = (q.xy / q.w - p.xy / p.w) * viewportSize;\n" \
+    "    if (dot(dir, dir) > 0.0) dir = normalize(dir);\n" \
+    "    vec2 offset = vec2(-dir.y, dir.x) * vertexSide * lineWidth / viewportSize;\n" \
+    "    gl_Position = vec4(p.xy + offset * p.w, p.z, p.w);\n" \
+    "}\n"
+
+static const char *FRUSTUM_FACES_SHADER_VERT = FRUSTUM_SHADER_VERT_HEADER
+    FRUSTUM_FACES_SHADER_INPUTS FRUSTUM_MESH_SHADER_CLIP_POSITION
+        FRUSTUM_FACES_SHADER_MAIN;
+
+static const char *FRUSTUM_WIRES_SHADER_VERT = FRUSTUM_SHADER_VERT_HEADER
+    FRUSTUM_WIRES_SHADER_INPUTS FRUSTUM_MESH_SHADER_CLIP_POSITION
+        FRUSTUM_WIRES_SHADER_MAIN;
+
+static const char *FRUSTUM_INSTANCED_FACES_SHADER_VERT = FRUSTUM_SHADER_VERT_HEADER
+    FRUSTUM_FACES_SHADER_INPUTS FRUSTUM_INSTANCE_SHADER_CLIP_POSITION
+        FRUSTUM_FACES_SHADER_MAIN;
+
+static const char *FRUSTUM_INSTANCED_WIRES_SHADER_VERT = FRUSTUM_SHADER_VERT_HEADER
+    FRUSTUM_WIRES_SHADER_INPUTS FRUSTUM_INSTANCE_SHADER_CLIP_POSITION
+        FRUSTUM_WIRES_SHADER_MAIN;
+
+// rlgl binds vertexPosition and vertexColor to these locations on shader load
+#define FRUSTUM_POSITION_ATTRIB_LOC 0
+#define FRUSTUM_COLOR_ATTRIB_LOC 3
+
+// Corners of the NDC cube, in the same order as the Frustum corners
+static const Vector3 NDC_CUBE_CORNERS[8] = {
+    {-1.0, -1.0, -1.0},
+    {-1.0, 1.0, -1.0},
+    {1.0, 1.0, -1.0},
+    {1.0, -1.0, -1.0},
+    {-1.0, -1.0, 1.0},
+    {-1.0, 1.0, 1.0},
+    {1.0, 1.0, 1.0},
+    {1.0, -1.0, 1.0}};
+
+// Triangles of the frustum faces (outward facing, counter-clockwise)
+static const unsigned short FRUSTUM_FACE_INDICES[36] = {
+    1, 0, 2, 3, 2, 0, 2, 3, 6, 7, 6, 3, 5, 4, 1, 0, 1, 4,
+    6, 7, 5, 4, 5, 7, 0, 4, 3, 7, 3, 4, 5, 1, 6, 2, 6, 1};
+
+// Edge quad vertices: (end, side) pairs, the far end goes with the flipped
+// side since its screen-space direction is flipped too
+static const int FRUSTUM_EDGE_QUAD_VERTICES[4][2] = {{0, -1}, {0, 1}, {1, 1}, {1, -1}};
+static const unsigned short FRUSTUM_EDGE_QUAD_INDICES[6] = {0, 1, 3, 0, 3, 2};
+
+// -----------------------------------------------------------------------
+// Vertex attributes
+static void set_face_vertex_attributes(unsigned int vbo, bool has_color) {
+    int stride = sizeof(FrustumFaceVertex);
+    rlEnableVertexBuffer(vbo);
+
+    rlSetVertexAttribute(
+        FRUSTUM_POSITION_ATTRIB_LOC,
+        3,
+        RL_FLOAT,
+        false,
+        stride,
+        (void *)offsetof(FrustumFaceVertex, position)
+    );
+    rlEnableVertexAttribute(FRUSTUM_POSITION_ATTRIB_LOC);
+    if (!has_color) return;
+
+    rlSetVertexAttribute(
+        FRUSTUM_COLOR_ATTRIB_LOC,
+        4,
+        RL_UNSIGNED_BYTE,
+        true,
+        stride,
+        (void *)offsetof(FrustumFaceVertex, color)
+    );
+    rlEnableVertexAttribute(FRUSTUM_COLOR_ATTRIB_LOC);
+}
+
+static void set_wire_vertex_attributes(
+    unsigned int vbo, int other_position_loc, int side_loc, bool has_color
+) {
+    int stride = sizeof(FrustumWireVertex);
+    rlEnableVertexBuffer(vbo);
+
+    rlSetVertexAttribute(
+        FRUSTUM_POSITION_ATTRIB_LOC,
+        3,
+        RL_FLOAT,
+        false,
+        stride,
+        (void *)offsetof(FrustumWireVertex, position)
+    );
+    rlEnableVertexAttribute(FRUSTUM_POSITION_ATTRIB_LOC);
+    rlSetVertexAttribute(
+        other_position_loc,
+        3,
+        RL_FLOAT,
+        false,
+        stride,
+        (void *)offsetof(FrustumWireVertex, other_position)
+    );
+    rlEnableVertexAttribute(other_position_loc);
+    rlSetVertexAttribute(
+        side_loc, 1, RL_FLOAT, false, stride, (void *)offsetof(FrustumWireVertex, side)
+    );
+    rlEnableVertexAttribute(side_loc);
+    if (!has_color) return;
+
+    rlSetVertexAttribute(
+        FRUSTUM_COLOR_ATTRIB_LOC,
+        4,
+        RL_UNSIGNED_BYTE,
+        true,
+        stride,
+        (void *)offsetof(FrustumWireVertex, color)
+    );
+    rlEnableVertexAttribute(FRUSTUM_COLOR_ATTRIB_LOC);
+}
+
+static void set_instance_attributes(unsigned int vbo, const int row_locs[4]) {
+    int stride = sizeof(FrustumInstance);
+    rlEnableVertexBuffer(vbo);
+
+    for (int i = 0; i < 4; ++i) {
+        rlSetVertexAttribute(
+            row_locs[i],
+            4,
+            RL_FLOAT,
+            false,
+            stride,
+            (void *)(offsetof(FrustumInstance, inv_view_proj) + i * 4 * sizeof(float))
+        );
+        rlEnableVertexAttribute(row_locs[i]);
+        rlSetVertexAttributeDivisor(row_locs[i], 1);
+    }
+    rlSetVertexAttribute(
+        FRUSTUM_COLOR_ATTRIB_LOC,
+        4,
+        RL_UNSIGNED_BYTE,
+        true,
+        stride,
+        (void *)offsetof(FrustumInstance, color)
+    );
+    rlEnableVertexAttribute(FRUSTUM_COLOR_ATTRIB_LOC);
+    rlSetVertexAttributeDivisor(FRUSTUM_COLOR_ATTRIB_LOC, 1);
+}
+
+static void set_frustum_faces_attributes(FrustumsMesh *mesh) {
+    set_face_vertex_attributes(mesh->faces_vbo, true);
+    rlEnableVertexBufferElement(mesh->faces_ibo);
+}
+
+static void set_frustum_wires_attributes(FrustumsMesh *mesh) {
+    set_wire_vertex_attributes(
+        mesh->wires_vbo, mesh->wires_other_position_loc, mesh->wires_side_loc, true
+    );
+    rlEnableVertexBufferElement(mesh->wires_ibo);
+}
+
+// -----------------------------------------------------------------------
+// Frustum vertices
+static void get_frustum_face_vertices(
+    const Vector3 corners[8], Color color, FrustumFaceVertex vertices[8]
+) {
+    memset(vertices, 0, 8 * sizeof(FrustumFaceVertex));
+    for (int i = 0; i < 8; ++i) {
+        vertices[i].position = corners[i];
+        vertices[i].color = color;
+    }
+}
+
+static void get_frustum_wire_vertices(
+    const Vector3 corners[8], Color color, FrustumWireVertex vertices[12 * 4]
+) {
+    memset(vertices, 0, 12 * 4 * sizeof(FrustumWireVertex));
+    for (int i = 0; i < 12; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            int end = FRUSTUM_EDGE_QUAD_VERTICES[j][0];
+            FrustumWireVertex *v = &vertices[i * 4 + j];
+            v->position = corners[FRUSTUM_EDGES[i][end]];
+            v->other_position = corners[FRUSTUM_EDGES[i][1 - end]];
+            v->side = FRUSTUM_EDGE_QUAD_VERTICES[j][1];
+            v->color = color;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Frustums mesh
+void frustums_mesh_load(FrustumsMesh *mesh) {
+    // -------------------------------------------------------------------
+    // Load shaders
+    mesh->faces_shader = LoadShaderFromMemory(
+        FRUSTUM_FACES_SHADER_VERT, FRUSTUM_SHADER_FRAG
+    );
+    mesh->wires_shader = LoadShaderFromMemory(
+        FRUSTUM_WIRES_SHADER_VERT, FRUSTUM_SHADER_FRAG
+    );
+    if (!IsShaderReady(mesh->faces_shader) || !IsShaderReady(mesh->wires_shader)) {
+        fprintf(stderr, "ERROR: Failed to load frustums mesh shaders\n");
+        exit(1);
+    }
+    mesh->faces_mvp_loc = GetShaderLocation(mesh->faces_shader, "mvp");
+    mesh->wires_mvp_loc = GetShaderLocation(mesh->wires_shader, "mvp");
+    mesh->wires_viewport_size_loc = GetShaderLocation(mesh->wires_shader, "viewportSize");
+    mesh->wires_line_width_loc = GetShaderLocation(mesh->wires_shader, "lineWidth");
+    mesh->wires_other_position_loc = GetShaderLocationAttrib(
+        mesh->wires_shader, "vertexOtherPosition"
+    );
+    mesh->wires_side_loc = GetShaderLocationAttrib(mesh->wires_shader, "vertexSide");
+
+    // -------------------------------------------------------------------
+    // Index buffers are static: frustum slots always have the same topology
+    static unsigned short face_indices[FRUSTUMS_MESH_MAX_N_FRUSTUMS * 36];
+    static unsigned short wire_indices[FRUSTUMS_MESH_MAX_N_FRUSTUMS * 12 * 6];
+    for (int i = 0; i < FRUSTUMS_MESH_MAX_N_FRUSTUMS; ++i) {
+        for (int j = 0; j < 36; ++j) {
+            face_indices[i * 36 + j] = i * 8 + FRUSTUM_FACE_INDICES[j];
+        }
+        for (int j = 0; j < 12; ++j) {
+            int edge = i * 12 + j;
+            for (int k = 0; k < 6; ++k) {
+                wire_indices[edge * 6 + k] = edge * 4 + FRUSTUM_EDGE_QUAD_INDICES[k];
+            }
+        }
+    }
+
+    // -------------------------------------------------------------------
+    // Load buffers (vertex buffers are allocated for the full capacity)
+    mesh->faces_vao = rlLoadVertexArray();
+    rlEnableVertexArray(mesh->faces_vao);
+    mesh->faces_vbo = rlLoadVertexBuffer(
+        mesh->face_vertices, sizeof(mesh->face_vertices), true
+    );
+    mesh->faces_ibo = rlLoadVertexBufferElement(
+        face_indices, sizeof(face_indices), false
+    );
+    set_frustum_faces_attributes(mesh);
+
+    mesh->wires_vao = rlLoadVertexArray();
+    rlEnableVertexArray(mesh->wires_vao);
+    mesh->wires_vbo = rlLoadVertexBuffer(
+        mesh->wire_vertices, sizeof(mesh->wire_vertices), true
+    );
+    mesh->wires_ibo = rlLoadVertexBufferElement(
+        wire_indices, sizeof(wire_indices), false
+    );
+    set_frustum_wires_attributes(mesh);
+
+    rlDisableVertexArray();
+    rlDisableVertexBuffer();
+    rlDisableVertexBufferElement();
+
+    mesh->uploaded_n_faces_frustums = 0;
+    mesh->uploaded_n_wires_frustums = 0;
+}
+
+void frustums_mesh_unload(FrustumsMesh *mesh) {
+    UnloadShader(mesh->faces_shader);
+    UnloadShader(mesh->wires_shader);
+    rlUnloadVertexArray(mesh->faces_vao);
+    rlUnloadVertexArray(mesh->wires_vao);
+    rlUnloadVertexBuffer(mesh->faces_vbo);
+    rlUnloadVertexBuffer(mesh->faces_ibo);
+    rlUnloadVertexBuffer(mesh->wires_vbo);
+    rlUnloadVertexBuffer(mesh->wires_ibo);
+}
+
+void frustums_mesh_begin(FrustumsMesh *mesh) {
+    // Vertex data of the previous frame is kept to detect the changes
+    mesh->n_faces_frustums = 0;
+    mesh->n_wires_frustums = 0;
+    mesh->is_faces_dirty = false;
+    mesh->is_wires_dirty = false;
+}
+
+static int get_frustums_mesh_slot(int *n_frustums) {
+    if (*n_frustums == FRUSTUMS_MESH_MAX_N_FRUSTUMS) {
+        fprintf(
+            stderr,
+            "ERROR: Number of frustums in the mesh must be <= %d\n",
+            FRUSTUMS_MESH_MAX_N_FRUSTUMS
+        );
+        exit(1);
+    }
+    return (*n_frustums)++;
+}
+
+void frustums_mesh_push_faces(FrustumsMesh *mesh, const Frustum *frustum, Color color) {
+    int slot = get_frustums_mesh_slot(&mesh->n_faces_frustums);
+
+    FrustumFaceVertex vertices[8];
+    get_frustum_face_vertices(frustum->corners, color, vertices);
+
+    FrustumFaceVertex *dst = &mesh->face_vertices[slot * 8];
+    if (memcmp(dst, vertices, sizeof(vertices)) != 0) {
+        memcpy(dst, vertices, sizeof(vertices));
+        mesh->is_faces_dirty = true;
+    }
+}
+
+void frustums_mesh_push_wires(FrustumsMesh *mesh, const Frustum *frustum, Color color) {
+    int slot = get_frustums_mesh_slot(&mesh->n_wires_frustums);
+
+    FrustumWireVertex vertices[12 * 4];
+    get_frustum_wire_vertices(frustum->corners, color, vertices);
+
+    FrustumWireVertex *dst = &mesh->wire_vertices[slot * 12 * 4];
+    if (memcmp(dst, vertices, sizeof(vertices)) != 0) {
+        memcpy(dst, vertices, sizeof(vertices));
+        mesh->is_wires_dirty = true;
+    }
+}
+
+void frustums_mesh_draw(FrustumsMesh *mesh, float line_width) {
+    // -------------------------------------------------------------------
+    // Upload the changed vertices (the number of frustums could only change
+    // together with the vertices of the last slots, which are then stale)
+    if (mesh->n_faces_frustums != mesh->uploaded_n_faces_frustums) {
+        mesh->is_faces_dirty = true;
+    }
+    if (mesh->n_wires_frustums != mesh->uploaded_n_wires_frustums) {
+        mesh->is_wires_dirty = true;
+    }
+
+    if (mesh->is_faces_dirty) {
+        rlUpdateVertexBuffer(
+            mesh->faces_vbo,
+            mesh->face_vertices,
+            mesh->n_faces_frustums * 8 * sizeof(FrustumFaceVertex),
+            0
+        );
+        mesh->uploaded_n_faces_frustums = mesh->n_faces_frustums;
+        mesh->n_uploads += 1;
+    }
+    if (mesh->is_wires_dirty) {
+        rlUpdateVertexBuffer(
+            mesh->wires_vbo,
+            mesh->wire_vertices,
+            mesh->n_wires_frustums * 12 * 4 * sizeof(FrustumWireVertex),
+            0
+        );
+        mesh->uploaded_n_wires_frustums = mesh->n_wires_frustums;
+        mesh->n_uploads += 1;
+    }
+
+    // -------------------------------------------------------------------
+    // Draw on top of everything drawn in the immediate mode so far
+    rlDrawRenderBatchActive();
+    Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+
+    if (mesh->n_wires_frustums > 0) {
+        // Edge quads are not consistently oriented
+        rlDisableBackfaceCulling();
+        float viewport_size[2] = {GetScreenWidth(), GetScreenHeight()};
+        rlEnableShader(mesh->wires_shader.id);
+        rlSetUniformMatrix(mesh->wires_mvp_loc, mvp);
+        rlSetUniform(
+            mesh->wires_viewport_size_loc, viewport_size, RL_SHADER_UNIFORM_VEC2, 1
+        );
+        rlSetUniform(mesh->wires_line_width_loc, &line_width, RL_SHADER_UNIFORM_FLOAT, 1);
+        if (!rlEnableVertexArray(mesh->wires_vao)) set_frustum_wires_attributes(mesh);
+        rlDrawVertexArrayElements(0, mesh->n_wires_frustums * 12 * 6, 0);
+        rlEnableBackfaceCulling();
+    }
+
+    if (mesh->n_faces_frustums > 0) {
+        rlEnableShader(mesh->faces_shader.id);
+        rlSetUniformMatrix(mesh->faces_mvp_loc, mvp);
+        if (!rlEnableVertexArray(mesh->faces_vao)) set_frustum_faces_attributes(mesh);
+        rlDrawVertexArrayElements(0, mesh->n_faces_frustums * 36, 0);
+    }
+
+    rlDisableVertexArray();
+    rlDisableVertexBuffer();
+    rlDisableVertexBufferElement();
+    rlDisableShader();
+}
+
+// -----------------------------------------------------------------------
+// Frustums instances
+Matrix get_frustum_inv_view_proj(const Frustum *frustum) {
+    return MatrixInvert(MatrixMultiply(frustum->view, frustum->proj));
+}
+
+static void load_frustums_instances_shader(
+    Shader *shader, const char *vert, int *mvp_loc, int row_locs[4]
+) {
+    *shader = LoadShaderFromMemory(vert, FRUSTUM_SHADER_FRAG);
+    if (!IsShaderReady(*shader)) {
+        fprintf(stderr, "ERROR: Failed to load frustums instances shaders\n");
+        exit(1);
+    }
+
+    *mvp_loc = GetShaderLocation(*shader, "mvp");
+    const char *row_names[4] = {
+        "instanceRow0", "instanceRow1", "instanceRow2", "instanceRow3"};
+    for (int i = 0; i < 4; ++i) {
+        row_locs[i] = GetShaderLocationAttrib(*shader, row_names[i]);
+    }
+}
+
+void frustums_instances_load(FrustumsInstances *instances) {
+    instances->faces_vao = rlLoadVertexArray();
+    instances->wires_vao = rlLoadVertexArray();
+    instances->is_supported = instances->faces_vao && instances->wires_vao;
+    if (!instances->is_supported) {
+        TraceLog(LOG_WARNING, "RAYFRUSTUM: Instanced frustums are not supported");
+        return;
+    }
+
+    // -------------------------------------------------------------------
+    // Load shaders
+    load_frustums_instances_shader(
+        &instances->faces_shader,
+        FRUSTUM_INSTANCED_FACES_SHADER_VERT,
+        &instances->faces_mvp_loc,
+        instances->faces_row_locs
+    );
+    load_frustums_instances_shader(
+        &instances->wires_shader,
+        FRUSTUM_INSTANCED_WIRES_SHADER_VERT,
+        &instances->wires_mvp_loc,
+        instances->wires_row_locs
+    );
+    instances->wires_viewport_size_loc = GetShaderLocation(
+        instances->wires_shader, "viewportSize"
+    );
+    instances->wires_line_width_loc = GetShaderLocation(
+        instances->wires_shader, "lineWidth"
+    );
+    instances->wires_other_position_loc = GetShaderLocationAttrib(
+        instances->wires_shader, "vertexOtherPosition"
+    );
+    instances->wires_side_loc = GetShaderLocationAttrib(
+        instances->wires_shader, "vertexSide"
+    );
+
+    // -------------------------------------------------------------------
+    // Static NDC cube geometry (its vertex colors are not used)
+    FrustumFaceVertex face_vertices[8];
+    get_frustum_face_vertices(NDC_CUBE_CORNERS, BLANK, face_vertices);
+    FrustumWireVertex wire_vertices[12 * 4];
+    get_frustum_wire_vertices(NDC_CUBE_CORNERS, BLANK, wire_vertices);
+    unsigned short wire_indices[12 * 6];
+    for (int i = 0; i < 12; ++i) {
+        for (int j = 0; j < 6; ++j) {
+            wire_indices[i * 6 + j] = i * 4 + FRUSTUM_EDGE_QUAD_INDICES[j];
+        }
+    }
+
+    // -------------------------------------------------------------------
+    // Load buffers (instance buffers are allocated for the full capacity)
+    rlEnableVertexArray(instances->faces_vao);
+    instances->faces_cube_vbo = rlLoadVertexBuffer(
+        face_vertices, sizeof(face_vertices), false
+    );
+    set_face_vertex_attributes(instances->faces_cube_vbo, false);
+    instances->faces_instances_vbo = rlLoadVertexBuffer(
+        instances->faces_instances, sizeof(instances->faces_instances), true
+    );
+    set_instance_attributes(instances->faces_instances_vbo, instances->faces_row_locs);
+    instances->faces_cube_ibo = rlLoadVertexBufferElement(
+        FRUSTUM_FACE_INDICES, sizeof(FRUSTUM_FACE_INDICES), false
+    );
+
+    rlEnableVertexArray(instances->wires_vao);
+    instances->wires_cube_vbo = rlLoadVertexBuffer(
+        wire_vertices, sizeof(wire_vertices), false
+    );
+    set_wire_vertex_attributes(
+        instances->wires_cube_vbo,
+        instances->wires_other_position_loc,
+        instances->wires_side_loc,
+        false
+    );
+    instances->wires_instances_vbo = rlLoadVertexBuffer(
+        instances->wires_instances, sizeof(instances->wires_instances), true
+    );
+    set_instance_attributes(instances->wires_instances_vbo, instances->wires_row_locs);
+    instances->wires_cube_ibo = rlLoadVertexBufferElement(
+        wire_indices, sizeof(wire_indices), false
+    );
+
+    rlDisableVertexArray();
+    rlDisableVertexBuffer();
+    rlDisableVertexBufferElement();
+
+    instances->uploaded_n_faces_instances = 0;
+    instances->uploaded_n_wires_instances = 0;
+}
+
+void frustums_instances_unload(FrustumsInstances *instances) {
+    if (!instances->is_supported) return;
+
+    UnloadShader(instances->faces_shader);
+    UnloadShader(instances->wires_shader);
+    rlUnloadVertexArray(instances->faces_vao);
+    rlUnloadVertexArray(instances->wires_vao);
+    rlUnloadVertexBuffer(instances->faces_cube_vbo);
+    rlUnloadVertexBuffer(instances->faces_cube_ibo);
+    rlUnloadVertexBuffer(instances->faces_instances_vbo);
+    rlUnloadVertexBuffer(instances->wires_cube_vbo);
+    rlUnloadVertexBuffer(instances->wires_cube_ibo);
+    rlUnloadVertexBuffer(instances->wires_instances_vbo);
+}
+
+void frustums_instances_begin(FrustumsInstances *instances) {
+    instances->n_faces_instances = 0;
+    instances->n_wires_instances = 0;
+    instances->is_faces_dirty = false;
+    instances->is_wires_dirty = false;
+}
+
+static void push_frustum_instance(
+    FrustumInstance *arr, int *n, bool *is_dirty, Matrix inv_view_proj, Color color
+) {
+    if (*n == FRUSTUMS_MAX_N_INSTANCES) {
+        fprintf(
+            stderr,
+            "ERROR: Number of frustum instances must be <= %d\n",
+            FRUSTUMS_MAX_N_INSTANCES
+        );
+        exit(1);
+    }
+
+    FrustumInstance instance;
+    memset(&instance, 0, sizeof(instance));
+    instance.inv_view_proj = inv_view_proj;
+    instance.color = color;
+
+    FrustumInstance *dst = &arr[(*n)++];
+    if (memcmp(dst, &instance, sizeof(instance)) != 0) {
+        *dst = instance;
+        *is_dirty = true;
+    }
+}
+
+void frustums_instances_push_faces(
+    FrustumsInstances *instances, Matrix inv_view_proj, Color color
+) {
+    push_frustum_instance(
+        instances->faces_instances,
+        &instances->n_faces_instances,
+        &instances->is_faces_dirty,
+        inv_view_proj,
+        color
+    );
+}
+
+void frustums_instances_push_wires(
+    FrustumsInstances *instances, Matrix inv_view_proj, Color color
+) {
+    push_frustum_instance(
+        instances->wires_instances,
+        &instances->n_wires_instances,
+        &instances->is_wires_dirty,
+        inv_view_proj,
+        color
+    );
+}
+
+void frustums_instances_draw(FrustumsInstances *instances, float line_width) {
+    if (!instances->is_supported) return;
+
+    // -------------------------------------------------------------------
+    // Upload the changed instances
+    if (instances->n_faces_instances != instances->uploaded_n_faces_instances) {
+        instances->is_faces_dirty = true;
+    }
+    if (instances->n_wires_instances != instances->uploaded_n_wires_instances) {
+        instances->is_wires_dirty = true;
+    }
+
+    if (instances->is_faces_dirty) {
+        rlUpdateVertexBuffer(
+            instances->faces_instances_vbo,
+            instances->faces_instances,
+            instances->n_faces_instances * sizeof(FrustumInstance),
+            0
+        );
+        instances->uploaded_n_faces_instances = instances->n_faces_instances;
+        instances->n_uploads += 1;
+    }
+    if (instances->is_wires_dirty) {
+        rlUpdateVertexBuffer(
+            instances->wires_instances_vbo,
+            instances->wires_instances,
+            instances->n_wires_instances * sizeof(FrustumInstance),
+            0
+        );
+        instances->uploaded_n_wires_instances = instances->n_wires_instances;
+        instances->n_uploads += 1;
+    }
+
+    // -------------------------------------------------------------------
+    // Draw on top of everything drawn in the immediate mode so far
+    rlDrawRenderBatchActive();
+    Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+
+    if (instances->n_wires_instances > 0) {
+        // Edge quads are not consistently oriented
+        rlDisableBackfaceCulling();
+        float viewport_size[2] = {GetScreenWidth(), GetScreenHeight()};
+        rlEnableShader(instances->wires_shader.id);
+        rlSetUniformMatrix(instances->wires_mvp_loc, mvp);
+        rlSetUniform(
+            instances->wires_viewport_size_loc,
+            viewport_size,
+            RL_SHADER_UNIFORM_VEC2,
+            1
+        );
+        rlSetUniform(
+            instances->wires_line_width_loc, &line_width, RL_SHADER_UNIFORM_FLOAT, 1
+        );
+        rlEnableVertexArray(instances->wires_vao);
+        rlDrawVertexArrayElementsInstanced(
+            0, 12 * 6, 0, instances->n_wires_instances
+        );
+        rlEnableBackfaceCulling();
+    }
+
+    if (instances->n_faces_instances > 0) {
+        rlEnableShader(instances->faces_shader.id);
+        rlSetUniformMatrix(instances->faces_mvp_loc, mvp);
+        rlEnableVertexArray(instances->faces_vao);
+        rlDrawVertexArrayElementsInstanced(0, 36, 0, instances->n_faces_instances);
+    }
+
+    rlDisableVertexArray();
+    rlDisableShader();
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFDRAW_H
@@ -0,0 +1,122 @@
+#ifndef RFJOBS_H
+#define RFJOBS_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Persistent pool of worker threads for the data-parallel kernels.
+//
+// job_pool_run splits the work into n_tasks independent tasks (tiles), the
+// workers and the calling thread grab them one by one from the shared atomic
+// counter, and the call returns when all tasks are done. Threads are created
+// only once in job_pool_start, so running the jobs doesn't allocate.
+//
+// A pool with 0 workers (or a NULL pool) runs all tasks on the calling thread.
+
+#define JOB_POOL_MAX_N_WORKERS 64
+
+typedef void (*JobFn)(void *ctx, int task);
+
+typedef struct JobPool {
+    int n_workers;
+    pthread_t workers[JOB_POOL_MAX_N_WORKERS];
+    sem_t n_started;
+    sem_t n_finished;
+    atomic_bool is_running;
+
+    JobFn fn;
+    void *ctx;
+    int n_tasks;
+    atomic_int next_task;
+} JobPool;
+
+void job_pool_start(JobPool *pool, int n_workers);
+void job_pool_stop(JobPool *pool);
+void job_pool_run(JobPool *pool, int n_tasks, JobFn fn, void *ctx);
+int job_pool_get_n_threads(const JobPool *pool);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include <stdio.h>
+#include <stdlib.h>
+
+static void run_job_pool_tasks(JobPool *pool) {
+    while (true) {
+        int task = atomic_fetch_add_explicit(&pool->next_task, 1, memory_order_relaxed);
+        if (task >= pool->n_tasks) break;
+        pool->fn(pool->ctx, task);
+    }
+}
+
+static void *run_job_pool_worker(void *arg) {
+    JobPool *pool = arg;
+
+    while (true) {
+        sem_wait(&pool->n_started);
+        if (!atomic_load(&pool->is_running)) break;
+
+        run_job_pool_tasks(pool);
+        sem_post(&pool->n_finished);
+    }
+
+    return NULL;
+}
+
+void job_pool_start(JobPool *pool, int n_workers) {
+    if (n_workers < 0 || n_workers > JOB_POOL_MAX_N_WORKERS) {
+        fprintf(
+            stderr,
+            "ERROR: Number of job pool workers must be in [0, %d], but you passed %d\n",
+            JOB_POOL_MAX_N_WORKERS,
+            n_workers
+        );
+        exit(1);
+    }
+
+    pool->n_workers = n_workers;
+    sem_init(&pool->n_started, 0, 0);
+    sem_init(&pool->n_finished, 0, 0);
+    atomic_init(&pool->is_running, true);
+    atomic_init(&pool->next_task, 0);
+    for (int i = 0; i < n_workers; ++i) {
+        if (pthread_create(&pool->workers[i], NULL, run_job_pool_worker, pool)) {
+            fprintf(stderr, "ERROR: Failed to create job pool worker\n");
+            exit(1);
+        }
+    }
+}
+
+void job_pool_stop(JobPool *pool) {
+    atomic_store(&pool->is_running, false);
+    for (int i = 0; i < pool->n_workers; ++i) sem_post(&pool->n_started);
+    for (int i = 0; i < pool->n_workers; ++i) pthread_join(pool->workers[i], NULL);
+    sem_destroy(&pool->n_started);
+    sem_destroy(&pool->n_finished);
+    pool->n_workers = 0;
+}
+
+void job_pool_run(JobPool *pool, int n_tasks, JobFn fn, void *ctx) {
+    if (!pool || pool->n_workers == 0 || n_tasks == 1) {
+        for (int i = 0; i < n_tasks; ++i) fn(ctx, i);
+        return;
+    }
+
+    // The semaphores order these writes before the workers read them
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->n_tasks = n_tasks;
+    atomic_store_explicit(&pool->next_task, 0, memory_order_relaxed);
+
+    for (int i = 0; i < pool->n_workers; ++i) sem_post(&pool->n_started);
+    run_job_pool_tasks(pool);
+    for (int i = 0; i < pool->n_workers; ++i) sem_wait(&pool->n_finished);
+}
+
+int job_pool_get_n_threads(const JobPool *pool) {
+    // Workers plus the calling thread
+    return pool ? pool->n_workers + 1 : 1;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFJOBS_H
@@ -0,0 +1,194 @@
+#ifndef RFMETRICS_H
+#define RFMETRICS_H
+
+#include "rayfrustum.h"
+
+// Shadow map texel efficiency of the light frustums fitted to the camera
+// slices (e.g. by get_frustum_of_directional_light).
+//
+// All metrics are computed in the light view space, where the shadow map is
+// the (ortho) rectangle of the light frustum:
+//     - coverage: area of the camera slice projected onto the shadow map
+//       (its convex hull) over the area of the shadow map rectangle. Texels
+//       outside of the hull are never sampled, so they are wasted
+//     - texel_size: world size of a shadow map texel at the given resolution
+//     - depth_utilization: depth extent of the casters (the boxes which
+//       intersect the light frustum, clipped to its depth range) over the
+//       depth range of the light frustum (the depth precision actually used).
+//       The camera slice can't be used here: the light frustum depth is
+//       fitted to it, so the ratio would always be 1
+//     - near/far_pixel_texel_ratio: world size of a screen pixel at the slice
+//       near/far plane over the (larger) texel size. Below 1 a texel covers
+//       several pixels, so the shadow edges get blocky (undersampling)
+
+typedef struct CascadeMetrics {
+    float coverage;
+    Vector2 texel_size;
+    float depth_utilization;
+    float near_pixel_texel_ratio;
+    float far_pixel_texel_ratio;
+} CascadeMetrics;
+
+CascadeMetrics get_cascade_metrics(
+    Frustum camera_frustum,
+    Frustum light_frustum,
+    const BoundingBox *casters,
+    int n_casters,
+    int resolution,
+    int screen_height
+);
+
+// Metrics of every light frustum of the cascade and the matching camera slice
+void get_cascades_metrics(
+    FrustumsCascade camera_cascade,
+    FrustumsCascade light_cascade,
+    const BoundingBox *casters,
+    int n_casters,
+    int resolution,
+    int screen_height,
+    CascadeMetrics *metrics
+);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include <float.h>
+#include <math.h>
+
+static float cross_2d(Vector2 o, Vector2 a, Vector2 b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static float get_convex_hull_area(Vector2 points[8]) {
+    // Monotone chain over the 8 corners, sorted by x (then y) with the
+    // insertion sort, which is the fastest for so few points
+    for (int i = 1; i < 8; ++i) {
+        Vector2 p = points[i];
+        int j = i - 1;
+        while (j >= 0
+            && (points[j].x > p.x || (points[j].x == p.x && points[j].y > p.y))) {
+            points[j + 1] = points[j];
+            j -= 1;
+        }
+        points[j + 1] = p;
+    }
+
+    Vector2 hull[16];
+    int n = 0;
+    for (int i = 0; i < 8; ++i) {
+        while (n >= 2 && cross_2d(hull[n - 2], hull[n - 1], points[i]) <= 0.0) n -= 1;
+        hull[n++] = points[i];
+    }
+    for (int i = 6, lower_n = n + 1; i >= 0; --i) {
+        while (n >= lower_n && cross_2d(hull[n - 2], hull[n - 1], points[i]) <= 0.0) {
+            n -= 1;
+        }
+        hull[n++] = points[i];
+    }
+
+    // Shoelace (the last hull point is the first one)
+    float area = 0.0;
+    for (int i = 0; i + 1 < n; ++i) {
+        area += hull[i].x * hull[i + 1].y - hull[i + 1].x * hull[i].y;
+    }
+
+    return 0.5 * fabsf(area);
+}
+
+CascadeMetrics get_cascade_metrics(
+    Frustum camera_frustum,
+    Frustum light_frustum,
+    const BoundingBox *casters,
+    int n_casters,
+    int resolution,
+    int screen_height
+) {
+    CascadeMetrics metrics = {0};
+    Matrix light_view = light_frustum.view;
+
+    // -------------------------------------------------------------------
+    // Shadow map rectangle and the depth range in the light space
+    Vector3 light_min = {FLT_MAX, FLT_MAX, FLT_MAX};
+    Vector3 light_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int i = 0; i < 8; ++i) {
+        Vector3 p = Vector3Transform(light_frustum.corners[i], light_view);
+        light_min = Vector3Min(light_min, p);
+        light_max = Vector3Max(light_max, p);
+    }
+    Vector3 light_size = Vector3Subtract(light_max, light_min);
+
+    // -------------------------------------------------------------------
+    // Camera slice projected onto the shadow map
+    Vector2 points[8];
+    for (int i = 0; i < 8; ++i) {
+        Vector3 p = Vector3Transform(camera_frustum.corners[i], light_view);
+        points[i] = (Vector2){p.x, p.y};
+    }
+
+    float rect_area = light_size.x * light_size.y;
+    if (rect_area > 0.0) metrics.coverage = get_convex_hull_area(points) / rect_area;
+
+    // -------------------------------------------------------------------
+    // Depth range of the casters within the light frustum
+    float caster_min_z = FLT_MAX;
+    float caster_max_z = -FLT_MAX;
+    for (int i = 0; i < n_casters; ++i) {
+        if (!is_box_in_frustum(light_frustum, casters[i])) continue;
+        for (int j = 0; j < 8; ++j) {
+            Vector3 corner = {
+                j & 1 ? casters[i].max.x : casters[i].min.x,
+                j & 2 ? casters[i].max.y : casters[i].min.y,
+                j & 4 ? casters[i].max.z : casters[i].min.z};
+            float z = Vector3Transform(corner, light_view).z;
+            caster_min_z = fminf(caster_min_z, z);
+            caster_max_z = fmaxf(caster_max_z, z);
+        }
+    }
+    caster_min_z = fmaxf(caster_min_z, light_min.z);
+    caster_max_z = fminf(caster_max_z, light_max.z);
+    if (light_size.z > 0.0 && caster_max_z > caster_min_z) {
+        metrics.depth_utilization = (caster_max_z - caster_min_z) / light_size.z;
+    }
+
+    // -------------------------------------------------------------------
+    // Texel and pixel sizes (the near/far plane height over the screen height)
+    metrics.texel_size = (Vector2){light_size.x / resolution, light_size.y / resolution};
+    float texel_size = fmaxf(metrics.texel_size.x, metrics.texel_size.y);
+    float near_pixel_size = Vector3Distance(
+                                camera_frustum.corners[0], camera_frustum.corners[1]
+                            )
+                            / screen_height;
+    float far_pixel_size = Vector3Distance(
+                               camera_frustum.corners[4], camera_frustum.corners[5]
+                           )
+                           / screen_height;
+    if (texel_size > 0.0) {
+        metrics.near_pixel_texel_ratio = near_pixel_size / texel_size;
+        metrics.far_pixel_texel_ratio = far_pixel_size / texel_size;
+    }
+
+    return metrics;
+}
+
+void get_cascades_metrics(
+    FrustumsCascade camera_cascade,
+    FrustumsCascade light_cascade,
+    const BoundingBox *casters,
+    int n_casters,
+    int resolution,
+    int screen_height,
+    CascadeMetrics *metrics
+) {
+    for (int i = 0; i < light_cascade.n_frustums; ++i) {
+        metrics[i] = get_cascade_metrics(
+            camera_cascade.frustums[i],
+            light_cascade.frustums[i],
+            casters,
+            n_casters,
+            resolution,
+            screen_height
+        );
+    }
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFMETRICS_H
@@ -0,0 +1,382 @@
+#ifndef RFOCCLUSION_H
+#define RFOCCLUSION_H
+
+#include "rayfrustum.h"
+#include "rfjobs.h"
+#include "rfraster.h"
+
+// Software occlusion culling against a coarse CPU depth buffer.
+//
+// A budget of the largest (by their projected size) occluder boxes is
+// rasterized into a low-resolution depth buffer of the camera, which is then
+// reduced into the hierarchical depth (HiZ) pyramid of the max depths. An
+// AABB is occluded if its nearest depth is behind the max depth of all HiZ
+// texels its screen rect touches. The HiZ level is picked so that the rect
+// covers at most 3x3 texels, so each test is O(1).
+//
+// Occluders are rendered as solid boxes, so they must be inside the actual
+// geometry (e.g. the boxes of the walls, not the AABBs of the meshes).
+// The test runs after the frustum test: only the boxes with non-zero masks
+// are tested, and the occluded ones get their masks cleared.
+
+#define OCCLUSION_DEFAULT_WIDTH 256
+#define OCCLUSION_DEFAULT_HEIGHT 128
+#define OCCLUSION_MAX_N_LEVELS 16
+#define OCCLUSION_DEPTH_BIAS 1e-6f
+#define OCCLUSION_MAX_N_CHUNKS 64
+#define OCCLUSION_MIN_CHUNK_SIZE 256
+
+typedef struct OcclusionCuller {
+    DepthRaster raster;
+
+    // Level 0 is the raster depth, level i is the 2x2 max of the level i - 1
+    int n_levels;
+    int level_widths[OCCLUSION_MAX_N_LEVELS];
+    int level_heights[OCCLUSION_MAX_N_LEVELS];
+    float *levels[OCCLUSION_MAX_N_LEVELS];
+
+    int max_n_occluders;
+    int *occluder_ids;
+    float *occluder_scores;
+    Vector3 *occluder_triangles;
+
+    // State of the last render (read by the tests)
+    Matrix view_proj;
+
+    // State of the current culling
+    const BoundingBox *boxes;
+    int n_boxes;
+    unsigned short *masks;
+    int chunk_size;
+    int chunk_n_occluded[OCCLUSION_MAX_N_CHUNKS];
+
+    // Stats of the last render and culling
+    int n_occluders;
+    int n_occluded;
+} OcclusionCuller;
+
+OcclusionCuller occlusion_culler_load(int width, int height, int max_n_occluders);
+void occlusion_culler_unload(OcclusionCuller *culler);
+
+// Selects up to max_n_occluders largest boxes among the ones with non-zero
+// masks (all boxes if masks is NULL), rasterizes them with the camera
+// view/proj (as in get_frustum_of_camera) and builds the HiZ pyramid
+void occlusion_culler_render(
+    OcclusionCuller *culler,
+    Frustum camera_frustum,
+    const BoundingBox *occluders,
+    const unsigned short *masks,
+    int n_occluders,
+    JobPool *pool
+);
+
+bool is_box_occluded(const OcclusionCuller *culler, BoundingBox box);
+
+// Clears the masks of the occluded boxes, returns the number of them
+int cull_boxes_by_occlusion(
+    OcclusionCuller *culler,
+    const BoundingBox *boxes,
+    int n_boxes,
+    unsigned short *masks,
+    JobPool *pool
+);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+OcclusionCuller occlusion_culler_load(int width, int height, int max_n_occluders) {
+    if (max_n_occluders <= 0) {
+        fprintf(
+            stderr,
+            "ERROR: Max number of occluders must be positive, but you passed %d\n",
+            max_n_occluders
+        );
+        exit(1);
+    }
+
+    // The buffer is coarse, so the bins are sized for the worst case: every
+    // occluder triangle covers every tile
+    int n_tiles = ((width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE)
+                  * ((height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE);
+    int max_n_triangles = RASTER_N_BOX_TRIANGLES * max_n_occluders;
+    OcclusionCuller culler = {
+        .raster = depth_raster_load(
+            width, height, max_n_triangles, 2 * max_n_triangles * n_tiles
+        ),
+        .max_n_occluders = max_n_occluders};
+    culler.raster.is_backface_culled = true;
+
+    culler.occluder_ids = malloc(sizeof(int) * max_n_occluders);
+    culler.occluder_scores = malloc(sizeof(float) * max_n_occluders);
+    culler.occluder_triangles = malloc(
+        sizeof(Vector3) * 3 * RASTER_N_BOX_TRIANGLES * max_n_occluders
+    );
+
+    // -------------------------------------------------------------------
+    // HiZ pyramid down to the single texel
+    culler.levels[0] = culler.raster.depth;
+    culler.level_widths[0] = width;
+    culler.level_heights[0] = height;
+    culler.n_levels = 1;
+    while (culler.n_levels < OCCLUSION_MAX_N_LEVELS) {
+        int i = culler.n_levels;
+        int w = culler.level_widths[i - 1];
+        int h = culler.level_heights[i - 1];
+        if (w == 1 && h == 1) break;
+
+        culler.level_widths[i] = (w + 1) / 2;
+        culler.level_heights[i] = (h + 1) / 2;
+        culler.levels[i] = malloc(
+            sizeof(float) * culler.level_widths[i] * culler.level_heights[i]
+        );
+        if (!culler.levels[i]) break;
+        culler.n_levels += 1;
+    }
+
+    if (!culler.occluder_ids || !culler.occluder_scores || !culler.occluder_triangles
+        || culler.level_widths[culler.n_levels - 1] != 1
+        || culler.level_heights[culler.n_levels - 1] != 1) {
+        fprintf(stderr, "ERROR: Failed to allocate occlusion culler\n");
+        exit(1);
+    }
+
+    return culler;
+}
+
+void occlusion_culler_unload(OcclusionCuller *culler) {
+    depth_raster_unload(&culler->raster);
+    for (int i = 1; i < culler->n_levels; ++i) free(culler->levels[i]);
+    free(culler->occluder_ids);
+    free(culler->occluder_scores);
+    free(culler->occluder_triangles);
+    *culler = (OcclusionCuller){0};
+}
+
+// -----------------------------------------------------------------------
+// Occluders
+static void sift_down_occluder(OcclusionCuller *culler, int n, int i) {
+    // Min-heap by the score, so the worst of the selected occluders is on top
+    float *scores = culler->occluder_scores;
+    int *ids = culler->occluder_ids;
+    while (true) {
+        int min = i;
+        int l = 2 * i + 1;
+        int r = 2 * i + 2;
+        if (l < n && scores[l] < scores[min]) min = l;
+        if (r < n && scores[r] < scores[min]) min = r;
+        if (min == i) break;
+
+        float score = scores[i];
+        scores[i] = scores[min];
+        scores[min] = score;
+        int id = ids[i];
+        ids[i] = ids[min];
+        ids[min] = id;
+        i = min;
+    }
+}
+
+static int select_occluders(
+    OcclusionCuller *culler,
+    Vector3 eye,
+    const BoundingBox *occluders,
+    const unsigned short *masks,
+    int n_occluders
+) {
+    // Top-k by the squared solid angle estimate: size^2 / distance^2
+    int n = 0;
+    for (int i = 0; i < n_occluders; ++i) {
+        if (masks && masks[i] == 0) continue;
+
+        BoundingBox box = occluders[i];
+        Vector3 center = Vector3Scale(Vector3Add(box.min, box.max), 0.5);
+        float size_sqr = Vector3LengthSqr(Vector3Subtract(box.max, box.min));
+        float distance_sqr = fmaxf(Vector3LengthSqr(Vector3Subtract(center, eye)), 1e-6f);
+        float score = size_sqr / distance_sqr;
+
+        if (n < culler->max_n_occluders) {
+            culler->occluder_ids[n] = i;
+            culler->occluder_scores[n] = score;
+            n += 1;
+            if (n == culler->max_n_occluders) {
+                for (int j = n / 2 - 1; j >= 0; --j) sift_down_occluder(culler, n, j);
+            }
+        } else if (score > culler->occluder_scores[0]) {
+            culler->occluder_ids[0] = i;
+            culler->occluder_scores[0] = score;
+            sift_down_occluder(culler, n, 0);
+        }
+    }
+
+    return n;
+}
+
+// -----------------------------------------------------------------------
+// HiZ
+static void build_hiz(OcclusionCuller *culler) {
+    for (int level = 1; level < culler->n_levels; ++level) {
+        const float *src = culler->levels[level - 1];
+        float *dst = culler->levels[level];
+        int src_w = culler->level_widths[level - 1];
+        int src_h = culler->level_heights[level - 1];
+        int w = culler->level_widths[level];
+        int h = culler->level_heights[level];
+
+        for (int y = 0; y < h; ++y) {
+            int y0 = 2 * y;
+            int y1 = 2 * y + 1 < src_h ? 2 * y + 1 : y0;
+            for (int x = 0; x < w; ++x) {
+                int x0 = 2 * x;
+                int x1 = 2 * x + 1 < src_w ? 2 * x + 1 : x0;
+                float a = fmaxf(src[y0 * src_w + x0], src[y0 * src_w + x1]);
+                float b = fmaxf(src[y1 * src_w + x0], src[y1 * src_w + x1]);
+                dst[y * w + x] = fmaxf(a, b);
+            }
+        }
+    }
+}
+
+void occlusion_culler_render(
+    OcclusionCuller *culler,
+    Frustum camera_frustum,
+    const BoundingBox *occluders,
+    const unsigned short *masks,
+    int n_occluders,
+    JobPool *pool
+) {
+    // Eye position is the translation of the inverse view
+    Matrix inv_view = MatrixInvert(camera_frustum.view);
+    Vector3 eye = {inv_view.m12, inv_view.m13, inv_view.m14};
+
+    int n = select_occluders(culler, eye, occluders, masks, n_occluders);
+    for (int i = 0; i < n; ++i) {
+        get_box_triangles(
+            occluders[culler->occluder_ids[i]],
+            &culler->occluder_triangles[3 * RASTER_N_BOX_TRIANGLES * i]
+        );
+    }
+
+    depth_raster_clear(&culler->raster);
+    depth_raster_render(
+        &culler->raster,
+        camera_frustum.view,
+        camera_frustum.proj,
+        culler->occluder_triangles,
+        RASTER_N_BOX_TRIANGLES * n,
+        pool
+    );
+    build_hiz(culler);
+
+    culler->view_proj = MatrixMultiply(camera_frustum.view, camera_frustum.proj);
+    culler->n_occluders = n;
+}
+
+// -----------------------------------------------------------------------
+// Tests
+bool is_box_occluded(const OcclusionCuller *culler, BoundingBox box) {
+    // -------------------------------------------------------------------
+    // Screen rect and the nearest depth of the box corners
+    Matrix m = culler->view_proj;
+    float min_x = FLT_MAX, min_y = FLT_MAX, min_z = FLT_MAX;
+    float max_x = -FLT_MAX, max_y = -FLT_MAX;
+    for (int c = 0; c < 8; ++c) {
+        Vector3 p = {
+            c & 4 ? box.max.x : box.min.x,
+            c & 2 ? box.max.y : box.min.y,
+            c & 1 ? box.max.z : box.min.z};
+        float x = m.m0 * p.x + m.m4 * p.y + m.m8 * p.z + m.m12;
+        float y = m.m1 * p.x + m.m5 * p.y + m.m9 * p.z + m.m13;
+        float z = m.m2 * p.x + m.m6 * p.y + m.m10 * p.z + m.m14;
+        float w = m.m3 * p.x + m.m7 * p.y + m.m11 * p.z + m.m15;
+
+        // Crossing the near plane: the box could cover anything
+        if (z < -w || w <= 0.0) return false;
+
+        float inv_w = 1.0f / w;
+        min_x = fminf(min_x, x * inv_w);
+        max_x = fmaxf(max_x, x * inv_w);
+        min_y = fminf(min_y, y * inv_w);
+        max_y = fmaxf(max_y, y * inv_w);
+        min_z = fminf(min_z, z * inv_w);
+    }
+
+    int width = culler->level_widths[0];
+    int height = culler->level_heights[0];
+    int x0 = (int)floorf((min_x * 0.5f + 0.5f) * width);
+    int x1 = (int)floorf((max_x * 0.5f + 0.5f) * width);
+    int y0 = (int)floorf((min_y * 0.5f + 0.5f) * height);
+    int y1 = (int)floorf((max_y * 0.5f + 0.5f) * height);
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 >= width ? width - 1 : x1;
+    y1 = y1 >= height ? height - 1 : y1;
+
+    // Outside of the screen: that's the frustum test business
+    if (x0 > x1 || y0 > y1) return false;
+
+    // -------------------------------------------------------------------
+    // The level where the rect spans at most 3x3 texels
+    int level = 0;
+    while (level + 1 < culler->n_levels
+           && ((x1 - x0) >> level > 1 || (y1 - y0) >> level > 1)) {
+        level += 1;
+    }
+
+    const float *hiz = culler->levels[level];
+    int w = culler->level_widths[level];
+    float depth = min_z * 0.5f + 0.5f;
+    for (int y = y0 >> level; y <= y1 >> level; ++y) {
+        for (int x = x0 >> level; x <= x1 >> level; ++x) {
+            if (depth <= hiz[y * w + x] + OCCLUSION_DEPTH_BIAS) return false;
+        }
+    }
+
+    return true;
+}
+
+static void run_occlusion_chunk(void *ctx, int chunk) {
+    OcclusionCuller *culler = ctx;
+    int begin = chunk * culler->chunk_size;
+    int end = begin + culler->chunk_size;
+    if (end > culler->n_boxes) end = culler->n_boxes;
+
+    int n_occluded = 0;
+    for (int i = begin; i < end; ++i) {
+        if (culler->masks[i] == 0) continue;
+        if (is_box_occluded(culler, culler->boxes[i])) {
+            culler->masks[i] = 0;
+            n_occluded += 1;
+        }
+    }
+    culler->chunk_n_occluded[chunk] = n_occluded;
+}
+
+int cull_boxes_by_occlusion(
+    OcclusionCuller *culler,
+    const BoundingBox *boxes,
+    int n_boxes,
+    unsigned short *masks,
+    JobPool *pool
+) {
+    int chunk_size = (n_boxes + OCCLUSION_MAX_N_CHUNKS - 1) / OCCLUSION_MAX_N_CHUNKS;
+    if (chunk_size < OCCLUSION_MIN_CHUNK_SIZE) chunk_size = OCCLUSION_MIN_CHUNK_SIZE;
+    int n_chunks = (n_boxes + chunk_size - 1) / chunk_size;
+
+    culler->chunk_size = chunk_size;
+    culler->boxes = boxes;
+    culler->n_boxes = n_boxes;
+    culler->masks = masks;
+    job_pool_run(pool, n_chunks, run_occlusion_chunk, culler);
+
+    culler->n_occluded = 0;
+    for (int i = 0; i < n_chunks; ++i) culler->n_occluded += culler->chunk_n_occluded[i];
+
+    return culler->n_occluded;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFOCCLUSION_H
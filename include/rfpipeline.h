@@ -0,0 +1,134 @@
+#ifndef RFPIPELINE_H
+#define RFPIPELINE_H
+
+#include "rayfrustum.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+// Wait-free single-producer single-consumer "latest value" slot.
+// Producer owns the `back` index, consumer owns the `front` index and the
+// `middle` index is swapped between them atomically, so nobody ever blocks
+typedef struct TripleBuffer {
+    atomic_int middle;
+    int back;
+    int front;
+} TripleBuffer;
+
+// Computes the FrameResult of the published FrameInput on a worker thread.
+// The render thread publishes inputs of the next frame and consumes the
+// latest completed result without waiting for the worker
+typedef struct FramePipeline {
+    FrameInput inputs[3];
+    FrameResult results[3];
+    TripleBuffer input_buffer;
+    TripleBuffer result_buffer;
+    bool has_result;
+
+    // Boxes are read by the worker, so they must not change while it's running
+    BoundingBox *boxes;
+    int n_boxes;
+
+    pthread_t worker;
+    sem_t n_published;
+    atomic_bool is_running;
+} FramePipeline;
+
+void frame_pipeline_start(FramePipeline *pipeline, BoundingBox *boxes, int n_boxes);
+void frame_pipeline_stop(FramePipeline *pipeline);
+void frame_pipeline_publish(FramePipeline *pipeline, FrameInput input);
+const FrameResult *frame_pipeline_consume(FramePipeline *pipeline);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRIPLE_BUFFER_FRESH_BIT 4
+
+static void triple_buffer_init(TripleBuffer *buffer) {
+    buffer->back = 0;
+    atomic_init(&buffer->middle, 1);
+    buffer->front = 2;
+}
+
+// Producer: publish the just written back slot and take the middle one
+static void triple_buffer_swap_back(TripleBuffer *buffer) {
+    int middle = atomic_exchange_explicit(
+        &buffer->middle, buffer->back | TRIPLE_BUFFER_FRESH_BIT, memory_order_acq_rel
+    );
+    buffer->back = middle & ~TRIPLE_BUFFER_FRESH_BIT;
+}
+
+// Consumer: take the middle slot if it holds a value which hasn't been read yet
+static bool triple_buffer_swap_front(TripleBuffer *buffer) {
+    int middle = atomic_load_explicit(&buffer->middle, memory_order_acquire);
+    if (!(middle & TRIPLE_BUFFER_FRESH_BIT)) return false;
+
+    middle = atomic_exchange_explicit(
+        &buffer->middle, buffer->front, memory_order_acq_rel
+    );
+    buffer->front = middle & ~TRIPLE_BUFFER_FRESH_BIT;
+    return true;
+}
+
+static void *run_frame_pipeline_worker(void *arg) {
+    FramePipeline *pipeline = arg;
+
+    while (true) {
+        sem_wait(&pipeline->n_published);
+        if (!atomic_load(&pipeline->is_running)) break;
+
+        // Several publications could be coalesced into the single fresh input
+        if (!triple_buffer_swap_front(&pipeline->input_buffer)) continue;
+
+        compute_frame_result(
+            pipeline->inputs[pipeline->input_buffer.front],
+            pipeline->boxes,
+            pipeline->n_boxes,
+            &pipeline->results[pipeline->result_buffer.back]
+        );
+        triple_buffer_swap_back(&pipeline->result_buffer);
+    }
+
+    return NULL;
+}
+
+void frame_pipeline_start(FramePipeline *pipeline, BoundingBox *boxes, int n_boxes) {
+    triple_buffer_init(&pipeline->input_buffer);
+    triple_buffer_init(&pipeline->result_buffer);
+    pipeline->has_result = false;
+    pipeline->boxes = boxes;
+    pipeline->n_boxes = n_boxes;
+
+    sem_init(&pipeline->n_published, 0, 0);
+    atomic_init(&pipeline->is_running, true);
+    if (pthread_create(&pipeline->worker, NULL, run_frame_pipeline_worker, pipeline)) {
+        fprintf(stderr, "ERROR: Failed to create frame pipeline worker\n");
+        exit(1);
+    }
+}
+
+void frame_pipeline_stop(FramePipeline *pipeline) {
+    atomic_store(&pipeline->is_running, false);
+    sem_post(&pipeline->n_published);
+    pthread_join(pipeline->worker, NULL);
+    sem_destroy(&pipeline->n_published);
+}
+
+void frame_pipeline_publish(FramePipeline *pipeline, FrameInput input) {
+    pipeline->inputs[pipeline->input_buffer.back] = input;
+    triple_buffer_swap_back(&pipeline->input_buffer);
+    sem_post(&pipeline->n_published);
+}
+
+const FrameResult *frame_pipeline_consume(FramePipeline *pipeline) {
+    if (triple_buffer_swap_front(&pipeline->result_buffer)) {
+        pipeline->has_result = true;
+    }
+    if (!pipeline->has_result) return NULL;
+
+    return &pipeline->results[pipeline->result_buffer.front];
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFPIPELINE_H
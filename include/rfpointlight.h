@@ -0,0 +1,105 @@
+#ifndef RFPOINTLIGHT_H
+#define RFPOINTLIGHT_H
+
+#include "rayfrustum.h"
+
+// Cube shadow map faces of the point (omni) light.
+//
+// Every face is the 90 degrees perspective frustum (get_frustum_of_view_proj
+// conventions) looking along one of the axes, in the GL cubemap order and
+// with the GL cubemap up vectors: +X, -X, +Y, -Y, +Z, -Z. Faces which don't
+// intersect the camera frustum (the SAT test) are dropped from the mask, the
+// others get their near/far tightened to the depth range of the intersection.
+// The FOV is kept, so the faces still tile the cube.
+
+#define N_POINT_LIGHT_FACES 6
+
+typedef struct PointLightFaces {
+    // i-th bit is set if the i-th face intersects the camera frustum
+    int mask;
+
+    // Tightened frustums and their near/far (the full ones for the dropped faces)
+    Frustum frustums[N_POINT_LIGHT_FACES];
+    float near[N_POINT_LIGHT_FACES];
+    float far[N_POINT_LIGHT_FACES];
+} PointLightFaces;
+
+PointLightFaces get_point_light_faces(
+    Frustum camera_frustum, Vector3 position, float range
+);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const Vector3 POINT_LIGHT_FACE_DIRECTIONS[N_POINT_LIGHT_FACES] = {
+    {1.0, 0.0, 0.0},
+    {-1.0, 0.0, 0.0},
+    {0.0, 1.0, 0.0},
+    {0.0, -1.0, 0.0},
+    {0.0, 0.0, 1.0},
+    {0.0, 0.0, -1.0}};
+
+static const Vector3 POINT_LIGHT_FACE_UPS[N_POINT_LIGHT_FACES] = {
+    {0.0, -1.0, 0.0},
+    {0.0, -1.0, 0.0},
+    {0.0, 0.0, 1.0},
+    {0.0, 0.0, -1.0},
+    {0.0, -1.0, 0.0},
+    {0.0, -1.0, 0.0}};
+
+PointLightFaces get_point_light_faces(
+    Frustum camera_frustum, Vector3 position, float range
+) {
+    if (range <= 0.0) {
+        fprintf(stderr, "ERROR: Point light range must be positive\n");
+        exit(1);
+    }
+
+    PointLightFaces faces = {0};
+    float min_near = 1e-3 * range;
+    for (int i = 0; i < N_POINT_LIGHT_FACES; ++i) {
+        Matrix view = MatrixLookAt(
+            position,
+            Vector3Add(position, POINT_LIGHT_FACE_DIRECTIONS[i]),
+            POINT_LIGHT_FACE_UPS[i]
+        );
+        Frustum face = get_frustum_of_view_proj(
+            view, MatrixPerspective(0.5 * PI, 1.0, min_near, range)
+        );
+        faces.frustums[i] = face;
+        faces.near[i] = min_near;
+        faces.far[i] = range;
+        if (!are_frustums_intersecting(face, camera_frustum)) continue;
+        faces.mask |= 1 << i;
+
+        // -------------------------------------------------------------------
+        // Depth range of the intersection along the face direction
+        Vector3 points[MAX_N_FRUSTUMS_INTERSECTION_POINTS];
+        int n_points = get_frustums_intersection_points(face, camera_frustum, points);
+        if (n_points == 0) continue;
+
+        float near = FLT_MAX, far = 0.0;
+        for (int j = 0; j < n_points; ++j) {
+            float depth = -Vector3Transform(points[j], view).z;
+            near = fminf(near, depth);
+            far = fmaxf(far, depth);
+        }
+        near = fmaxf(near, min_near);
+        far = fmaxf(fminf(far, range), near * (1.0 + FRUSTUM_SIDE_EPSILON));
+
+        faces.frustums[i] = get_frustum_of_view_proj(
+            view, MatrixPerspective(0.5 * PI, 1.0, near, far)
+        );
+        faces.near[i] = near;
+        faces.far[i] = far;
+    }
+
+    return faces;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFPOINTLIGHT_H
@@ -0,0 +1,224 @@
+#ifndef RFPROFILER_H
+#define RFPROFILER_H
+
+#include <stdbool.h>
+
+// Lightweight per-stage frame profiler.
+//
+// Stages are identified by the user defined ids in [0, n_stages). Durations
+// are accumulated per frame, kept in the rolling history for the overlay and
+// also appended to the ring buffer of events for the Chrome trace export
+// (chrome://tracing or https://ui.perfetto.dev).
+//
+// Events are recorded by the thread which owns the profiler (the render
+// thread). Stages executed on other threads are timestamped there and pushed
+// afterwards with profiler_push.
+//
+// Compile with -DRFPROFILER_DISABLE to remove all PROFILE_* instrumentation.
+
+#define PROFILER_MAX_N_STAGES 16
+#define PROFILER_N_HISTORY_FRAMES 128
+#define PROFILER_MAX_N_EVENTS (1 << 16)
+
+#ifdef RFPROFILER_DISABLE
+#define PROFILE_BEGIN_FRAME()
+#define PROFILE_END_FRAME()
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+#define PROFILE_SCOPE(stage)
+#define PROFILE_STAMP(time_ns)
+#else
+#define PROFILE_BEGIN_FRAME() profiler_begin_frame()
+#define PROFILE_END_FRAME() profiler_end_frame()
+#define PROFILE_BEGIN(stage) profiler_begin(stage)
+#define PROFILE_END(stage) profiler_end(stage)
+// Usage: PROFILE_SCOPE(STAGE_X) { ... } (don't leave the block with break/return)
+#define PROFILE_SCOPE(stage) \
+    for (int profile_scope_done = (profiler_begin(stage), 0); !profile_scope_done; \
+         profile_scope_done = (profiler_end(stage), 1))
+#define PROFILE_STAMP(time_ns) ((time_ns) = get_time_ns())
+#endif
+
+typedef struct ProfilerEvent {
+    int stage;
+    int thread;
+    long long begin_ns;
+    long long end_ns;
+} ProfilerEvent;
+
+long long get_time_ns(void);
+
+void profiler_init(const char **stage_names, int n_stages);
+void profiler_begin_frame(void);
+void profiler_end_frame(void);
+void profiler_begin(int stage);
+void profiler_end(int stage);
+void profiler_push(int stage, int thread, long long begin_ns, long long end_ns);
+
+int profiler_get_n_stages(void);
+const char *profiler_get_stage_name(int stage);
+float profiler_get_stage_average_ms(int stage);
+float profiler_get_frame_average_ms(void);
+float profiler_get_frame_max_ms(void);
+float profiler_get_frame_history_ms(int age);
+bool profiler_save_chrome_trace(const char *file_path);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include <stdio.h>
+#include <time.h>
+
+typedef struct Profiler {
+    int n_stages;
+    const char *stage_names[PROFILER_MAX_N_STAGES];
+
+    long long frame_begin_ns;
+    long long stage_begin_ns[PROFILER_MAX_N_STAGES];
+    long long stage_frame_ns[PROFILER_MAX_N_STAGES];
+
+    // Rolling history, the i-th finished frame is at i % PROFILER_N_HISTORY_FRAMES
+    int n_frames;
+    float frame_ms[PROFILER_N_HISTORY_FRAMES];
+    float stage_ms[PROFILER_MAX_N_STAGES][PROFILER_N_HISTORY_FRAMES];
+
+    // Ring buffer of the most recent events
+    long long n_events;
+    ProfilerEvent events[PROFILER_MAX_N_EVENTS];
+} Profiler;
+
+static Profiler PROFILER;
+
+long long get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void profiler_init(const char **stage_names, int n_stages) {
+    if (n_stages > PROFILER_MAX_N_STAGES) {
+        fprintf(
+            stderr,
+            "ERROR: Number of profiler stages must be <= %d, but you passed %d\n",
+            PROFILER_MAX_N_STAGES,
+            n_stages
+        );
+        n_stages = PROFILER_MAX_N_STAGES;
+    }
+
+    PROFILER.n_stages = n_stages;
+    for (int i = 0; i < n_stages; ++i) PROFILER.stage_names[i] = stage_names[i];
+    PROFILER.frame_begin_ns = get_time_ns();
+}
+
+void profiler_begin_frame(void) {
+    PROFILER.frame_begin_ns = get_time_ns();
+    for (int i = 0; i < PROFILER.n_stages; ++i) PROFILER.stage_frame_ns[i] = 0;
+}
+
+void profiler_end_frame(void) {
+    long long end_ns = get_time_ns();
+    int idx = PROFILER.n_frames % PROFILER_N_HISTORY_FRAMES;
+
+    PROFILER.frame_ms[idx] = (end_ns - PROFILER.frame_begin_ns) * 1e-6;
+    for (int i = 0; i < PROFILER.n_stages; ++i) {
+        PROFILER.stage_ms[i][idx] = PROFILER.stage_frame_ns[i] * 1e-6;
+    }
+    PROFILER.n_frames += 1;
+}
+
+void profiler_begin(int stage) {
+    PROFILER.stage_begin_ns[stage] = get_time_ns();
+}
+
+void profiler_end(int stage) {
+    profiler_push(stage, 0, PROFILER.stage_begin_ns[stage], get_time_ns());
+}
+
+void profiler_push(int stage, int thread, long long begin_ns, long long end_ns) {
+    PROFILER.stage_frame_ns[stage] += end_ns - begin_ns;
+
+    ProfilerEvent *event = &PROFILER.events[PROFILER.n_events % PROFILER_MAX_N_EVENTS];
+    *event = (ProfilerEvent){stage, thread, begin_ns, end_ns};
+    PROFILER.n_events += 1;
+}
+
+int profiler_get_n_stages(void) {
+    return PROFILER.n_stages;
+}
+
+const char *profiler_get_stage_name(int stage) {
+    return PROFILER.stage_names[stage];
+}
+
+static int get_profiler_n_history_frames(void) {
+    if (PROFILER.n_frames < PROFILER_N_HISTORY_FRAMES) return PROFILER.n_frames;
+    return PROFILER_N_HISTORY_FRAMES;
+}
+
+float profiler_get_stage_average_ms(int stage) {
+    int n = get_profiler_n_history_frames();
+    if (n == 0) return 0.0;
+
+    float sum = 0.0;
+    for (int i = 0; i < n; ++i) sum += PROFILER.stage_ms[stage][i];
+    return sum / n;
+}
+
+float profiler_get_frame_average_ms(void) {
+    int n = get_profiler_n_history_frames();
+    if (n == 0) return 0.0;
+
+    float sum = 0.0;
+    for (int i = 0; i < n; ++i) sum += PROFILER.frame_ms[i];
+    return sum / n;
+}
+
+float profiler_get_frame_max_ms(void) {
+    int n = get_profiler_n_history_frames();
+    float max = 0.0;
+    for (int i = 0; i < n; ++i) {
+        if (PROFILER.frame_ms[i] > max) max = PROFILER.frame_ms[i];
+    }
+    return max;
+}
+
+float profiler_get_frame_history_ms(int age) {
+    // age = 0 is the most recent finished frame
+    if (age < 0 || age >= get_profiler_n_history_frames()) return 0.0;
+    int idx = (PROFILER.n_frames - 1 - age) % PROFILER_N_HISTORY_FRAMES;
+    return PROFILER.frame_ms[idx];
+}
+
+bool profiler_save_chrome_trace(const char *file_path) {
+    FILE *file = fopen(file_path, "w");
+    if (!file) {
+        fprintf(stderr, "ERROR: Failed to open %s for writing\n", file_path);
+        return false;
+    }
+
+    long long n_events = PROFILER.n_events;
+    long long first = n_events > PROFILER_MAX_N_EVENTS ? n_events - PROFILER_MAX_N_EVENTS
+                                                       : 0;
+
+    // Complete ("X") events with microsecond timestamps
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (long long i = first; i < n_events; ++i) {
+        ProfilerEvent e = PROFILER.events[i % PROFILER_MAX_N_EVENTS];
+        fprintf(
+            file,
+            "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+            "\"ts\": %.3f, \"dur\": %.3f}%s\n",
+            PROFILER.stage_names[e.stage],
+            e.thread,
+            e.begin_ns * 1e-3,
+            (e.end_ns - e.begin_ns) * 1e-3,
+            i == n_events - 1 ? "" : ","
+        );
+    }
+    fprintf(file, "]}\n");
+    fclose(file);
+
+    return true;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFPROFILER_H
@@ -0,0 +1,502 @@
+#ifndef RFRASTER_H
+#define RFRASTER_H
+
+#include "rayfrustum.h"
+#include "rfjobs.h"
+
+// Depth-only CPU rasterizer of the triangle soups. It renders the shadow maps
+// of the light cascades (and the occlusion buffers) on the GPU-less machines.
+//
+// Rendering runs in 3 data-parallel passes on the job pool:
+//     1. setup: triangles are transformed by view * proj (ortho or perspective),
+//        clipped by the near plane, turned into the edge functions and the
+//        depth plane, and counted per screen tile
+//     2. binning: triangle indices are written into the per-tile bins
+//     3. raster: every tile is rasterized by exactly one task, 4 pixels at a
+//        time with the SIMD edge functions, so the depth writes don't race
+// The chunk and tile order of the bins is fixed, so the result doesn't depend
+// on the number of threads.
+//
+// The depth buffer follows the DepthImage conventions: window depth in [0, 1],
+// rows go bottom to top, samples are taken at the pixel centers. Faces are
+// rendered two-sided (as the shadow casters usually are), unless
+// is_backface_culled is set: then only the counter-clockwise ones (as in GL)
+// are rendered, which halves the fill of the closed occluders.
+//
+// With is_depth_clamped (orthographic projections only) the triangles in front
+// of the near plane are not clipped, their depth is clamped to 0 instead (the
+// shadow map "pancaking", as GL_DEPTH_CLAMP does), so the casters between the
+// light and a tightly fitted light frustum still cast the shadows.
+//
+// All memory is allocated in depth_raster_load, rendering doesn't allocate.
+
+#define RASTER_TILE_SIZE 64
+#define RASTER_MAX_N_CHUNKS 64
+#define RASTER_MIN_CHUNK_SIZE 256
+#define RASTER_N_BOX_TRIANGLES 12
+
+typedef struct RasterTriangle {
+    // Edge functions e(x, y) = a * x + b * y + c, inside pixels have all e >= 0
+    float edge_a[3];
+    float edge_b[3];
+    float edge_c[3];
+
+    // Depth plane z(x, y) = z_a * x + z_b * y + z_c
+    float z_a;
+    float z_b;
+    float z_c;
+
+    // Inclusive pixel bounds
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+} RasterTriangle;
+
+typedef struct DepthRaster {
+    int width;
+    int height;
+    int n_tiles_x;
+    int n_tiles_y;
+    float *depth;
+    bool is_backface_culled;
+    bool is_depth_clamped;
+
+    int max_n_triangles;
+    int max_n_bin_entries;
+    // Near clipping can split a triangle in two, so there are 2 slots per triangle
+    RasterTriangle *triangles;
+    int *bin_entries;
+    // [tile][chunk] counts, turned into the bin cursors by the binning
+    int *tile_chunk_counts;
+    int *tile_offsets;
+
+    // State of the current render
+    float m[4][4];
+    const Vector3 *vertices;
+    int n_triangles;
+    int n_chunks;
+    int chunk_size;
+    int chunk_n_triangles[RASTER_MAX_N_CHUNKS];
+
+    // Stats of the last render
+    int n_rasterized_triangles;
+    int n_bin_entries;
+} DepthRaster;
+
+// Width must be a multiple of 4 (the SIMD width)
+DepthRaster depth_raster_load(
+    int width, int height, int max_n_triangles, int max_n_bin_entries
+);
+void depth_raster_unload(DepthRaster *raster);
+void depth_raster_clear(DepthRaster *raster);
+
+// Renders n_triangles (3 vertices each) on top of the current depth
+void depth_raster_render(
+    DepthRaster *raster,
+    Matrix view,
+    Matrix proj,
+    const Vector3 *vertices,
+    int n_triangles,
+    JobPool *pool
+);
+
+// Writes the 12 triangles (36 vertices) of the box faces, counter-clockwise
+// when looked at from the outside
+void get_box_triangles(BoundingBox box, Vector3 *vertices);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include "rfsimd.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+DepthRaster depth_raster_load(
+    int width, int height, int max_n_triangles, int max_n_bin_entries
+) {
+    if (width <= 0 || height <= 0 || width % 4 != 0) {
+        fprintf(
+            stderr,
+            "ERROR: Depth raster size must be positive and its width must be a "
+            "multiple of 4, but you passed %dx%d\n",
+            width,
+            height
+        );
+        exit(1);
+    }
+
+    DepthRaster raster = {
+        .width = width,
+        .height = height,
+        .n_tiles_x = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE,
+        .n_tiles_y = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE,
+        .max_n_triangles = max_n_triangles,
+        .max_n_bin_entries = max_n_bin_entries};
+    int n_tiles = raster.n_tiles_x * raster.n_tiles_y;
+
+    raster.depth = malloc(sizeof(float) * width * height);
+    raster.triangles = malloc(sizeof(RasterTriangle) * 2 * max_n_triangles);
+    raster.bin_entries = malloc(sizeof(int) * max_n_bin_entries);
+    raster.tile_chunk_counts = malloc(sizeof(int) * n_tiles * RASTER_MAX_N_CHUNKS);
+    raster.tile_offsets = malloc(sizeof(int) * (n_tiles + 1));
+    if (!raster.depth || !raster.triangles || !raster.bin_entries
+        || !raster.tile_chunk_counts || !raster.tile_offsets) {
+        fprintf(stderr, "ERROR: Failed to allocate depth raster\n");
+        exit(1);
+    }
+
+    depth_raster_clear(&raster);
+
+    return raster;
+}
+
+void depth_raster_unload(DepthRaster *raster) {
+    free(raster->depth);
+    free(raster->triangles);
+    free(raster->bin_entries);
+    free(raster->tile_chunk_counts);
+    free(raster->tile_offsets);
+    *raster = (DepthRaster){0};
+}
+
+void depth_raster_clear(DepthRaster *raster) {
+    int n = raster->width * raster->height;
+    for (int i = 0; i < n; ++i) raster->depth[i] = 1.0;
+}
+
+// -----------------------------------------------------------------------
+// Setup
+static bool setup_raster_triangle(
+    const DepthRaster *raster, const float clip[3][4], RasterTriangle *t
+) {
+    float x[3], y[3], z[3];
+    for (int i = 0; i < 3; ++i) {
+        float inv_w = 1.0f / clip[i][3];
+        x[i] = (clip[i][0] * inv_w * 0.5f + 0.5f) * raster->width;
+        y[i] = (clip[i][1] * inv_w * 0.5f + 0.5f) * raster->height;
+        z[i] = clip[i][2] * inv_w * 0.5f + 0.5f;
+    }
+
+    // Clockwise triangles are either culled or flipped
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (!(fabsf(area) > 1e-12f)) return false;
+    if (area < 0.0 && raster->is_backface_culled) return false;
+    if (area < 0.0) {
+        float tx = x[1], ty = y[1], tz = z[1];
+        x[1] = x[2], y[1] = y[2], z[1] = z[2];
+        x[2] = tx, y[2] = ty, z[2] = tz;
+        area = -area;
+    }
+
+    // Pixels whose centers are inside the screen bounds of the triangle
+    float min_x = fminf(x[0], fminf(x[1], x[2]));
+    float max_x = fmaxf(x[0], fmaxf(x[1], x[2]));
+    float min_y = fminf(y[0], fminf(y[1], y[2]));
+    float max_y = fmaxf(y[0], fmaxf(y[1], y[2]));
+    t->min_x = (int)fmaxf(ceilf(min_x - 0.5f), 0.0f);
+    t->min_y = (int)fmaxf(ceilf(min_y - 0.5f), 0.0f);
+    t->max_x = (int)fminf(floorf(max_x - 0.5f), raster->width - 1);
+    t->max_y = (int)fminf(floorf(max_y - 0.5f), raster->height - 1);
+    if (t->min_x > t->max_x || t->min_y > t->max_y) return false;
+
+    // Edge i goes from the vertex i to the vertex i + 1, divided by the area
+    // it's the barycentric weight of the opposite vertex i + 2
+    float inv_area = 1.0f / area;
+    t->z_a = t->z_b = t->z_c = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        int k = (i + 2) % 3;
+        t->edge_a[i] = y[i] - y[j];
+        t->edge_b[i] = x[j] - x[i];
+        t->edge_c[i] = x[i] * y[j] - y[i] * x[j];
+        t->z_a += t->edge_a[i] * z[k] * inv_area;
+        t->z_b += t->edge_b[i] * z[k] * inv_area;
+        t->z_c += t->edge_c[i] * z[k] * inv_area;
+    }
+
+    return true;
+}
+
+static int clip_raster_triangle_by_near(const float in[3][4], float out[4][4]) {
+    // Sutherland-Hodgman against z >= -w, returns the number of the polygon vertices
+    int n = 0;
+    for (int i = 0; i < 3; ++i) {
+        const float *a = in[i];
+        const float *b = in[(i + 1) % 3];
+        float da = a[2] + a[3];
+        float db = b[2] + b[3];
+        if (da >= 0.0) memcpy(out[n++], a, sizeof(float) * 4);
+        if ((da >= 0.0) != (db >= 0.0)) {
+            float t = da / (da - db);
+            for (int c = 0; c < 4; ++c) out[n][c] = a[c] + t * (b[c] - a[c]);
+            n += 1;
+        }
+    }
+
+    return n;
+}
+
+static void count_raster_triangle_tiles(
+    const DepthRaster *raster, const RasterTriangle *t, int chunk
+) {
+    int tx0 = t->min_x / RASTER_TILE_SIZE, tx1 = t->max_x / RASTER_TILE_SIZE;
+    int ty0 = t->min_y / RASTER_TILE_SIZE, ty1 = t->max_y / RASTER_TILE_SIZE;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            int tile = ty * raster->n_tiles_x + tx;
+            raster->tile_chunk_counts[tile * raster->n_chunks + chunk] += 1;
+        }
+    }
+}
+
+static void run_raster_setup_chunk(void *ctx, int chunk) {
+    DepthRaster *raster = ctx;
+    const float(*m)[4] = raster->m;
+    int n_tiles = raster->n_tiles_x * raster->n_tiles_y;
+    for (int i = 0; i < n_tiles; ++i) {
+        raster->tile_chunk_counts[i * raster->n_chunks + chunk] = 0;
+    }
+
+    int begin = chunk * raster->chunk_size;
+    int end = begin + raster->chunk_size;
+    if (end > raster->n_triangles) end = raster->n_triangles;
+    RasterTriangle *out = &raster->triangles[2 * begin];
+    int n_out = 0;
+
+    for (int i = begin; i < end; ++i) {
+        // -------------------------------------------------------------------
+        // Transform to the clip space and reject the triangles which are fully
+        // outside of any frustum side
+        float clip[3][4];
+        int outside[6] = {0};
+        int n_behind_near = 0;
+        for (int v = 0; v < 3; ++v) {
+            Vector3 p = raster->vertices[3 * i + v];
+            for (int c = 0; c < 4; ++c) {
+                clip[v][c] = m[c][0] * p.x + m[c][1] * p.y + m[c][2] * p.z + m[c][3];
+            }
+            float w = clip[v][3];
+            outside[0] += clip[v][0] < -w;
+            outside[1] += clip[v][0] > w;
+            outside[2] += clip[v][1] < -w;
+            outside[3] += clip[v][1] > w;
+            outside[4] += clip[v][2] > w;
+            n_behind_near += clip[v][2] < -w && !raster->is_depth_clamped;
+        }
+        if (n_behind_near == 3) continue;
+        bool is_outside = false;
+        for (int s = 0; s < 5; ++s) is_outside |= outside[s] == 3;
+        if (is_outside) continue;
+
+        // -------------------------------------------------------------------
+        // Clip by the near plane (the result is a triangle or a quad)
+        if (n_behind_near == 0) {
+            if (setup_raster_triangle(raster, clip, &out[n_out])) {
+                count_raster_triangle_tiles(raster, &out[n_out++], chunk);
+            }
+            continue;
+        }
+
+        float polygon[4][4];
+        int n_vertices = clip_raster_triangle_by_near(clip, polygon);
+        for (int v = 1; v + 1 < n_vertices; ++v) {
+            float fan[3][4];
+            memcpy(fan[0], polygon[0], sizeof(fan[0]));
+            memcpy(fan[1], polygon[v], sizeof(fan[1]));
+            memcpy(fan[2], polygon[v + 1], sizeof(fan[2]));
+            if (setup_raster_triangle(raster, fan, &out[n_out])) {
+                count_raster_triangle_tiles(raster, &out[n_out++], chunk);
+            }
+        }
+    }
+
+    raster->chunk_n_triangles[chunk] = n_out;
+}
+
+// -----------------------------------------------------------------------
+// Binning
+static void run_raster_bin_chunk(void *ctx, int chunk) {
+    DepthRaster *raster = ctx;
+    int first = 2 * chunk * raster->chunk_size;
+    for (int i = 0; i < raster->chunk_n_triangles[chunk]; ++i) {
+        const RasterTriangle *t = &raster->triangles[first + i];
+        int tx0 = t->min_x / RASTER_TILE_SIZE, tx1 = t->max_x / RASTER_TILE_SIZE;
+        int ty0 = t->min_y / RASTER_TILE_SIZE, ty1 = t->max_y / RASTER_TILE_SIZE;
+        for (int ty = ty0; ty <= ty1; ++ty) {
+            for (int tx = tx0; tx <= tx1; ++tx) {
+                int tile = ty * raster->n_tiles_x + tx;
+                int *cursor = &raster->tile_chunk_counts[tile * raster->n_chunks + chunk];
+                raster->bin_entries[(*cursor)++] = first + i;
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Raster
+static void run_raster_tile(void *ctx, int tile) {
+    DepthRaster *raster = ctx;
+    int tile_x0 = (tile % raster->n_tiles_x) * RASTER_TILE_SIZE;
+    int tile_y0 = (tile / raster->n_tiles_x) * RASTER_TILE_SIZE;
+    int tile_x1 = tile_x0 + RASTER_TILE_SIZE;
+    int tile_y1 = tile_y0 + RASTER_TILE_SIZE;
+    if (tile_x1 > raster->width) tile_x1 = raster->width;
+    if (tile_y1 > raster->height) tile_y1 = raster->height;
+
+    f32x4 lanes = {0.0, 1.0, 2.0, 3.0};
+    f32x4 zero = f32x4_splat(0.0);
+
+    for (int e = raster->tile_offsets[tile]; e < raster->tile_offsets[tile + 1]; ++e) {
+        const RasterTriangle *t = &raster->triangles[raster->bin_entries[e]];
+
+        // The tile and the raster width are multiples of 4, so the aligned
+        // down x0 and the 4-pixel steps never leave the tile
+        int x0 = (t->min_x > tile_x0 ? t->min_x : tile_x0) & ~3;
+        int x1 = t->max_x + 1 < tile_x1 ? t->max_x + 1 : tile_x1;
+        int y0 = t->min_y > tile_y0 ? t->min_y : tile_y0;
+        int y1 = t->max_y + 1 < tile_y1 ? t->max_y + 1 : tile_y1;
+
+        f32x4 px = lanes + (x0 + 0.5f);
+        f32x4 step_e[3], row_e[3];
+        for (int i = 0; i < 3; ++i) {
+            step_e[i] = f32x4_splat(4.0f * t->edge_a[i]);
+            row_e[i] = px * t->edge_a[i] + t->edge_c[i];
+        }
+        f32x4 step_z = f32x4_splat(4.0f * t->z_a);
+        f32x4 row_z = px * t->z_a + t->z_c;
+        f32x4 min_z = f32x4_splat(raster->is_depth_clamped ? 0.0 : -FLT_MAX);
+
+        for (int y = y0; y < y1; ++y) {
+            float py = y + 0.5f;
+            f32x4 e0 = row_e[0] + t->edge_b[0] * py;
+            f32x4 e1 = row_e[1] + t->edge_b[1] * py;
+            f32x4 e2 = row_e[2] + t->edge_b[2] * py;
+            f32x4 z = row_z + t->z_b * py;
+            float *row = &raster->depth[y * raster->width];
+
+            for (int x = x0; x < x1; x += 4) {
+                i32x4 mask = (e0 >= zero) & (e1 >= zero) & (e2 >= zero);
+                if (i32x4_any(mask)) {
+                    f32x4 depth = f32x4_load(&row[x]);
+                    f32x4 clamped_z = f32x4_max(z, min_z);
+                    mask &= clamped_z < depth;
+                    f32x4_store(&row[x], f32x4_select(mask, clamped_z, depth));
+                }
+                e0 += step_e[0];
+                e1 += step_e[1];
+                e2 += step_e[2];
+                z += step_z;
+            }
+        }
+    }
+}
+
+void depth_raster_render(
+    DepthRaster *raster,
+    Matrix view,
+    Matrix proj,
+    const Vector3 *vertices,
+    int n_triangles,
+    JobPool *pool
+) {
+    if (n_triangles < 0 || n_triangles > raster->max_n_triangles) {
+        fprintf(
+            stderr,
+            "ERROR: Number of rasterized triangles must be in [0, %d], but you "
+            "passed %d\n",
+            raster->max_n_triangles,
+            n_triangles
+        );
+        exit(1);
+    }
+    if (raster->is_depth_clamped && proj.m15 != 1.0) {
+        fprintf(stderr, "ERROR: Depth clamp needs the orthographic projection\n");
+        exit(1);
+    }
+
+    Matrix m = MatrixMultiply(view, proj);
+    float rows[4][4] = {
+        {m.m0, m.m4, m.m8, m.m12},
+        {m.m1, m.m5, m.m9, m.m13},
+        {m.m2, m.m6, m.m10, m.m14},
+        {m.m3, m.m7, m.m11, m.m15}};
+    memcpy(raster->m, rows, sizeof(rows));
+    raster->vertices = vertices;
+    raster->n_triangles = n_triangles;
+
+    // A few chunks per thread, but not too small ones
+    int n_threads = job_pool_get_n_threads(pool);
+    int chunk_size = (n_triangles + 4 * n_threads - 1) / (4 * n_threads);
+    int min_chunk_size = (n_triangles + RASTER_MAX_N_CHUNKS - 1) / RASTER_MAX_N_CHUNKS;
+    if (chunk_size < min_chunk_size) chunk_size = min_chunk_size;
+    if (chunk_size < RASTER_MIN_CHUNK_SIZE) chunk_size = RASTER_MIN_CHUNK_SIZE;
+    raster->chunk_size = chunk_size;
+    raster->n_chunks = (n_triangles + chunk_size - 1) / chunk_size;
+
+    job_pool_run(pool, raster->n_chunks, run_raster_setup_chunk, raster);
+
+    // -------------------------------------------------------------------
+    // Turn the [tile][chunk] counts into the bin cursors
+    int n_tiles = raster->n_tiles_x * raster->n_tiles_y;
+    int n_entries = 0;
+    for (int tile = 0; tile < n_tiles; ++tile) {
+        raster->tile_offsets[tile] = n_entries;
+        for (int chunk = 0; chunk < raster->n_chunks; ++chunk) {
+            int *count = &raster->tile_chunk_counts[tile * raster->n_chunks + chunk];
+            int n = *count;
+            *count = n_entries;
+            n_entries += n;
+        }
+    }
+    raster->tile_offsets[n_tiles] = n_entries;
+
+    if (n_entries > raster->max_n_bin_entries) {
+        fprintf(
+            stderr,
+            "ERROR: Depth raster needs %d bin entries, but max_n_bin_entries is %d\n",
+            n_entries,
+            raster->max_n_bin_entries
+        );
+        exit(1);
+    }
+
+    job_pool_run(pool, raster->n_chunks, run_raster_bin_chunk, raster);
+    job_pool_run(pool, n_tiles, run_raster_tile, raster);
+
+    raster->n_rasterized_triangles = 0;
+    for (int i = 0; i < raster->n_chunks; ++i) {
+        raster->n_rasterized_triangles += raster->chunk_n_triangles[i];
+    }
+    raster->n_bin_entries = n_entries;
+}
+
+void get_box_triangles(BoundingBox box, Vector3 *vertices) {
+    // Corner c has the max x, y, z where the bits 4, 2, 1 of c are set
+    static const int quads[6][4] = {
+        {0, 1, 3, 2},
+        {4, 6, 7, 5},
+        {0, 4, 5, 1},
+        {2, 3, 7, 6},
+        {0, 2, 6, 4},
+        {1, 5, 7, 3}};
+    Vector3 corners[8];
+    for (int c = 0; c < 8; ++c) {
+        corners[c] = (Vector3){
+            c & 4 ? box.max.x : box.min.x,
+            c & 2 ? box.max.y : box.min.y,
+            c & 1 ? box.max.z : box.min.z};
+    }
+
+    Vector3 *v = vertices;
+    for (int q = 0; q < 6; ++q) {
+        const int *quad = quads[q];
+        *v++ = corners[quad[0]], *v++ = corners[quad[1]], *v++ = corners[quad[2]];
+        *v++ = corners[quad[0]], *v++ = corners[quad[2]], *v++ = corners[quad[3]];
+    }
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFRASTER_H
@@ -0,0 +1,368 @@
+#ifndef RFSHADOWBUDGET_H
+#define RFSHADOWBUDGET_H
+
+#include "rayfrustum.h"
+
+// Selection of the shadow maps to update this frame when there are more
+// shadowed lights than the frame can afford.
+//
+// Every candidate (a directional cascade, a spot frustum, a point light face)
+// is scored by:
+//     - the camera overlap: the volume of its intersection with the camera
+//       frustum relative to its volume (the fraction inside of the camera
+//       frustum). The intersection points are the vertices of the
+//       intersection polyhedron, so its volume is exact
+//     - the screen coverage: the projected size of the same intersection
+//       relative to the screen height (get_shadow_tile_size_of_points)
+//     - the distance from the camera to its center, relative to the camera
+//       frustum diagonal
+//     - the number of frames since its last update
+// as score = coverage * overlap / (1 + distance) * (1 + age). The intersection
+// points are found once per candidate, the camera position and diagonal once
+// per frame. Candidates which don't intersect the camera frustum are never
+// selected.
+//
+// All the candidates with positive scores go to a max-heap (built in O(n))
+// and are popped in the score order: the ones which fit the caster and texel
+// budgets are taken until max_n_updates of them are (O(n + m log n) for m
+// pops), so the expensive candidates which don't fit give their slots to the
+// cheaper ones further down. The candidate keys are the stable ids of the
+// shadow maps (e.g. the shadow atlas keys), the frames of their last updates
+// are kept by the keys.
+//
+// All memory is allocated in shadow_scheduler_load.
+
+// Age of the never updated candidates
+#define SHADOW_SCHEDULER_MAX_AGE 1000
+
+typedef struct ShadowCandidate {
+    int key;
+    Frustum frustum;
+    // Cost of the update
+    int n_casters;
+    long long n_texels;
+} ShadowCandidate;
+
+typedef struct ShadowBudget {
+    int max_n_updates;
+    // Non-positive values mean no limit
+    int max_n_casters;
+    long long max_n_texels;
+} ShadowBudget;
+
+typedef struct ShadowScheduler {
+    int max_n_keys;
+    int max_n_candidates;
+    int frame;
+
+    // Per key
+    int *last_update_frames;
+
+    // Per candidate scores and the max-heap of the candidate ids
+    float *scores;
+    int *heap;
+} ShadowScheduler;
+
+ShadowScheduler shadow_scheduler_load(int max_n_keys, int max_n_candidates);
+void shadow_scheduler_unload(ShadowScheduler *scheduler);
+
+float get_shadow_candidate_score(
+    const ShadowScheduler *scheduler,
+    Frustum camera_frustum,
+    ShadowCandidate candidate,
+    int screen_height
+);
+
+// Writes the indices of the selected candidates (the best first) and returns
+// their number. The selected keys are marked as updated in this frame
+int select_shadow_updates(
+    ShadowScheduler *scheduler,
+    Frustum camera_frustum,
+    const ShadowCandidate *candidates,
+    int n_candidates,
+    int screen_height,
+    ShadowBudget budget,
+    int *selected
+);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include "rfatlas.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+ShadowScheduler shadow_scheduler_load(int max_n_keys, int max_n_candidates) {
+    if (max_n_keys <= 0 || max_n_candidates <= 0) {
+        fprintf(
+            stderr,
+            "ERROR: Shadow scheduler max numbers of keys and candidates must be "
+            "positive\n"
+        );
+        exit(1);
+    }
+
+    ShadowScheduler scheduler = {
+        .max_n_keys = max_n_keys, .max_n_candidates = max_n_candidates};
+    scheduler.last_update_frames = malloc(sizeof(int) * max_n_keys);
+    scheduler.scores = malloc(sizeof(float) * max_n_candidates);
+    scheduler.heap = malloc(sizeof(int) * max_n_candidates);
+    if (!scheduler.last_update_frames || !scheduler.scores || !scheduler.heap) {
+        fprintf(stderr, "ERROR: Failed to allocate shadow scheduler\n");
+        exit(1);
+    }
+    for (int i = 0; i < max_n_keys; ++i) {
+        scheduler.last_update_frames[i] = -SHADOW_SCHEDULER_MAX_AGE;
+    }
+
+    return scheduler;
+}
+
+void shadow_scheduler_unload(ShadowScheduler *scheduler) {
+    free(scheduler->last_update_frames);
+    free(scheduler->scores);
+    free(scheduler->heap);
+    *scheduler = (ShadowScheduler){0};
+}
+
+static bool is_side_equal(Vector4 a, Vector4 b, float epsilon) {
+    float d = fabsf(a.x - b.x) + fabsf(a.y - b.y) + fabsf(a.z - b.z);
+    return d < FRUSTUM_SIDE_EPSILON && fabsf(a.w - b.w) < epsilon;
+}
+
+// Volume of the intersection polyhedron of a and b by its vertices: each face
+// lies on a side of a or b, its vertices are sorted around their center and
+// the face polygon is the base of a pyramid with the apex at the polyhedron
+// center
+static float get_frustums_intersection_volume(
+    Frustum a, Frustum b, const Vector3 *points, int n_points
+) {
+    Vector3 center = Vector3Zero();
+    for (int i = 0; i < n_points; ++i) center = Vector3Add(center, points[i]);
+    center = Vector3Scale(center, 1.0 / n_points);
+
+    // The vertices are found with the float precision of their coordinates, so
+    // the tolerance of the vertices lying on the sides grows with the size
+    float radius = 0.0;
+    for (int i = 0; i < n_points; ++i) {
+        radius = fmaxf(radius, Vector3Distance(center, points[i]));
+    }
+    float epsilon = FRUSTUM_SIDE_EPSILON * (1.0 + radius);
+
+    float volume = 0.0;
+    for (int i = 0; i < 12; ++i) {
+        Vector4 side = i < 6 ? a.sides[i] : b.sides[i - 6];
+        Vector3 normal = {side.x, side.y, side.z};
+
+        // The shared sides (e.g. of the cascade slices) bound the same face
+        bool is_shared = false;
+        for (int j = 0; j < 6 && i >= 6; ++j) {
+            is_shared |= is_side_equal(side, a.sides[j], epsilon);
+        }
+        if (is_shared) continue;
+
+        // Face vertices with their angles around the face center
+        Vector3 face[MAX_N_FRUSTUMS_INTERSECTION_POINTS];
+        float angles[MAX_N_FRUSTUMS_INTERSECTION_POINTS];
+        int n = 0;
+        Vector3 face_center = Vector3Zero();
+        for (int j = 0; j < n_points; ++j) {
+            float d = Vector3DotProduct(normal, points[j]) + side.w;
+            if (fabsf(d) > epsilon) continue;
+            face[n++] = points[j];
+            face_center = Vector3Add(face_center, points[j]);
+        }
+        if (n < 3) continue;
+        face_center = Vector3Scale(face_center, 1.0 / n);
+
+        Vector3 u = Vector3Zero();
+        for (int j = 0; j < n && Vector3LengthSqr(u) < 1e-12; ++j) {
+            u = Vector3Subtract(face[j], face_center);
+        }
+        Vector3 v = Vector3CrossProduct(normal, u);
+        for (int j = 0; j < n; ++j) {
+            Vector3 d = Vector3Subtract(face[j], face_center);
+            angles[j] = atan2f(Vector3DotProduct(d, v), Vector3DotProduct(d, u));
+        }
+        for (int j = 1; j < n; ++j) {
+            for (int k = j; k > 0 && angles[k - 1] > angles[k]; --k) {
+                float angle = angles[k];
+                angles[k] = angles[k - 1];
+                angles[k - 1] = angle;
+                Vector3 p = face[k];
+                face[k] = face[k - 1];
+                face[k - 1] = p;
+            }
+        }
+
+        Vector3 area = Vector3Zero();
+        for (int j = 0; j < n; ++j) {
+            Vector3 p = Vector3Subtract(face[j], face_center);
+            Vector3 q = Vector3Subtract(face[(j + 1) % n], face_center);
+            area = Vector3Add(area, Vector3CrossProduct(p, q));
+        }
+        float height = Vector3DotProduct(normal, center) + side.w;
+        volume += 0.5 * Vector3Length(area) * height / 3.0;
+    }
+
+    return volume;
+}
+
+static float get_shadow_candidate_score_of_camera(
+    const ShadowScheduler *scheduler,
+    Frustum camera_frustum,
+    Vector3 camera_position,
+    float camera_diagonal,
+    ShadowCandidate candidate,
+    int screen_height
+) {
+    Frustum f = candidate.frustum;
+    Vector3 points[MAX_N_FRUSTUMS_INTERSECTION_POINTS];
+    int n_points = get_frustums_intersection_points(f, camera_frustum, points);
+    if (n_points == 0) return 0.0;
+
+    float volume = get_frustum_volume(f);
+    float overlap = 1.0;
+    if (volume > 0.0) {
+        float intersection_volume = get_frustums_intersection_volume(
+            f, camera_frustum, points, n_points
+        );
+        overlap = fminf(intersection_volume / volume, 1.0);
+    }
+
+    float tile_size = get_shadow_tile_size_of_points(
+        camera_frustum, points, n_points, screen_height
+    );
+    float coverage = fminf(tile_size / screen_height, 1.0);
+
+    Vector3 center = Vector3Zero();
+    for (int i = 0; i < 8; ++i) center = Vector3Add(center, f.corners[i]);
+    center = Vector3Scale(center, 1.0 / 8.0);
+    float distance = Vector3Distance(center, camera_position) / camera_diagonal;
+
+    int age = scheduler->frame - scheduler->last_update_frames[candidate.key];
+    age = age < SHADOW_SCHEDULER_MAX_AGE ? age : SHADOW_SCHEDULER_MAX_AGE;
+
+    return coverage * overlap / (1.0 + distance) * (1.0 + age);
+}
+
+static Vector3 get_shadow_camera_position(Frustum camera_frustum) {
+    Matrix inv_view = MatrixInvert(camera_frustum.view);
+    return (Vector3){inv_view.m12, inv_view.m13, inv_view.m14};
+}
+
+static float get_shadow_camera_diagonal(Frustum camera_frustum) {
+    Vector3 *corners = camera_frustum.corners;
+    return fmaxf(Vector3Distance(corners[0], corners[6]), 1e-6);
+}
+
+float get_shadow_candidate_score(
+    const ShadowScheduler *scheduler,
+    Frustum camera_frustum,
+    ShadowCandidate candidate,
+    int screen_height
+) {
+    return get_shadow_candidate_score_of_camera(
+        scheduler,
+        camera_frustum,
+        get_shadow_camera_position(camera_frustum),
+        get_shadow_camera_diagonal(camera_frustum),
+        candidate,
+        screen_height
+    );
+}
+
+// -----------------------------------------------------------------------
+// Max-heap of the candidate ids by their scores
+static void sift_shadow_heap_down(const float *scores, int *heap, int n, int i) {
+    while (true) {
+        int max = i;
+        int l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && scores[heap[l]] > scores[heap[max]]) max = l;
+        if (r < n && scores[heap[r]] > scores[heap[max]]) max = r;
+        if (max == i) return;
+
+        int id = heap[i];
+        heap[i] = heap[max];
+        heap[max] = id;
+        i = max;
+    }
+}
+
+int select_shadow_updates(
+    ShadowScheduler *scheduler,
+    Frustum camera_frustum,
+    const ShadowCandidate *candidates,
+    int n_candidates,
+    int screen_height,
+    ShadowBudget budget,
+    int *selected
+) {
+    if (n_candidates > scheduler->max_n_candidates) {
+        fprintf(
+            stderr,
+            "ERROR: Number of shadow candidates must be <= %d\n",
+            scheduler->max_n_candidates
+        );
+        exit(1);
+    }
+    scheduler->frame += 1;
+
+    // -------------------------------------------------------------------
+    // Scores of all candidates, the positive ones go to the heap
+    float *scores = scheduler->scores;
+    int *heap = scheduler->heap;
+    int n = 0;
+    Vector3 camera_position = get_shadow_camera_position(camera_frustum);
+    float camera_diagonal = get_shadow_camera_diagonal(camera_frustum);
+    for (int i = 0; i < n_candidates && budget.max_n_updates > 0; ++i) {
+        int key = candidates[i].key;
+        if (key < 0 || key >= scheduler->max_n_keys) {
+            fprintf(
+                stderr,
+                "ERROR: Shadow candidate key must be in [0, %d)\n",
+                scheduler->max_n_keys
+            );
+            exit(1);
+        }
+
+        scores[i] = get_shadow_candidate_score_of_camera(
+            scheduler,
+            camera_frustum,
+            camera_position,
+            camera_diagonal,
+            candidates[i],
+            screen_height
+        );
+        if (scores[i] > 0.0) heap[n++] = i;
+    }
+    for (int i = n / 2 - 1; i >= 0; --i) sift_shadow_heap_down(scores, heap, n, i);
+
+    // -------------------------------------------------------------------
+    // The best ones first, the costs are accumulated in this order
+    int n_selected = 0;
+    int n_casters = 0;
+    long long n_texels = 0;
+    while (n > 0 && n_selected < budget.max_n_updates) {
+        int id = heap[0];
+        heap[0] = heap[--n];
+        sift_shadow_heap_down(scores, heap, n, 0);
+
+        ShadowCandidate c = candidates[id];
+        if (budget.max_n_casters > 0 && n_casters + c.n_casters > budget.max_n_casters) {
+            continue;
+        }
+        if (budget.max_n_texels > 0 && n_texels + c.n_texels > budget.max_n_texels) {
+            continue;
+        }
+        n_casters += c.n_casters;
+        n_texels += c.n_texels;
+        selected[n_selected++] = id;
+        scheduler->last_update_frames[c.key] = scheduler->frame;
+    }
+
+    return n_selected;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFSHADOWBUDGET_H
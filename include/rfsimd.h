@@ -0,0 +1,66 @@
+#ifndef RFSIMD_H
+#define RFSIMD_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// 4-lane float/int vectors of the GCC/Clang vector extensions. The compiler
+// lowers them to SSE on x86 and to NEON on ARM, so the kernels don't need
+// per-ISA intrinsics. Comparisons of f32x4 give i32x4 masks (all bits set in
+// the lanes where the comparison holds).
+
+typedef float f32x4 __attribute__((vector_size(16)));
+typedef int32_t i32x4 __attribute__((vector_size(16)));
+
+static inline f32x4 f32x4_splat(float v) {
+    return (f32x4){v, v, v, v};
+}
+
+// Unaligned loads/stores (memcpy keeps them free of the strict aliasing issues)
+static inline f32x4 f32x4_load(const float *src) {
+    f32x4 v;
+    memcpy(&v, src, sizeof(v));
+    return v;
+}
+
+static inline void f32x4_store(float *dst, f32x4 v) {
+    memcpy(dst, &v, sizeof(v));
+}
+
+static inline f32x4 f32x4_select(i32x4 mask, f32x4 a, f32x4 b) {
+    return (f32x4)((mask & (i32x4)a) | (~mask & (i32x4)b));
+}
+
+static inline f32x4 f32x4_min(f32x4 a, f32x4 b) {
+    return f32x4_select(a < b, a, b);
+}
+
+static inline f32x4 f32x4_max(f32x4 a, f32x4 b) {
+    return f32x4_select(a > b, a, b);
+}
+
+static inline f32x4 f32x4_sqrt(f32x4 v) {
+    // Lane-wise, the compiler turns it into the vector square root
+    return (f32x4){sqrtf(v[0]), sqrtf(v[1]), sqrtf(v[2]), sqrtf(v[3])};
+}
+
+static inline float f32x4_reduce_min(f32x4 v) {
+    return fminf(fminf(v[0], v[1]), fminf(v[2], v[3]));
+}
+
+static inline float f32x4_reduce_max(f32x4 v) {
+    return fmaxf(fmaxf(v[0], v[1]), fmaxf(v[2], v[3]));
+}
+
+static inline bool i32x4_any(i32x4 mask) {
+    return (mask[0] | mask[1] | mask[2] | mask[3]) != 0;
+}
+
+// i-th bit is set if the i-th lane of the mask is set
+static inline int i32x4_get_mask(i32x4 mask) {
+    return (mask[0] & 1) | (mask[1] & 2) | (mask[2] & 4) | (mask[3] & 8);
+}
+
+#endif  // RFSIMD_H
@@ -0,0 +1,212 @@
+#ifndef RFTRAJECTORY_H
+#define RFTRAJECTORY_H
+
+#include "rayfrustum.h"
+#include <stdio.h>
+
+// Binary trajectory of the camera and the light, used to replay exactly the
+// same frames in the demo and in the headless benchmarks.
+//
+// File layout (host byte order, all fields are 4 bytes wide):
+//     TrajectoryHeader
+//     TrajectoryFrame[n_frames]
+// Frames have a fixed size, so the file is memory-mapped and read in place
+
+#define TRAJECTORY_MAGIC "RFTRAJ"
+#define TRAJECTORY_VERSION 1
+
+typedef struct TrajectoryHeader {
+    char magic[8];
+    int version;
+    int frame_size;
+    int n_frames;
+    int reserved;
+} TrajectoryHeader;
+
+typedef struct TrajectoryFrame {
+    // Camera transform (camera looks along the -z axis rotated by the rotation)
+    Vector3 translation;
+    Quaternion rotation;
+    float fovy;
+    float aspect;
+
+    float light_azimuth;
+    float light_attitude;
+
+    int n_planes;
+    float planes[MAX_N_FRUSTUMS_IN_CASCADE + 1];
+} TrajectoryFrame;
+
+typedef struct TrajectoryWriter {
+    FILE *file;
+    int n_frames;
+} TrajectoryWriter;
+
+typedef struct TrajectoryReader {
+    void *data;
+    size_t size;
+    const TrajectoryFrame *frames;
+    int n_frames;
+} TrajectoryReader;
+
+TrajectoryWriter trajectory_writer_open(const char *file_path);
+void trajectory_writer_push(TrajectoryWriter *writer, TrajectoryFrame frame);
+void trajectory_writer_close(TrajectoryWriter *writer);
+
+TrajectoryReader trajectory_reader_open(const char *file_path);
+void trajectory_reader_close(TrajectoryReader *reader);
+TrajectoryFrame trajectory_reader_get_frame(TrajectoryReader reader, int frame);
+
+FrameInput get_frame_input_of_trajectory_frame(TrajectoryFrame frame);
+
+// Scripted frame of the headless tools when no trajectory file is given: the
+// camera orbits around the origin and the sun sweeps its azimuth above the
+// ground
+TrajectoryFrame get_orbit_trajectory_frame(int frame, int n_frames);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static TrajectoryHeader get_trajectory_header(int n_frames) {
+    TrajectoryHeader header = {0};
+    memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+    header.version = TRAJECTORY_VERSION;
+    header.frame_size = sizeof(TrajectoryFrame);
+    header.n_frames = n_frames;
+
+    return header;
+}
+
+TrajectoryWriter trajectory_writer_open(const char *file_path) {
+    TrajectoryWriter writer = {0};
+    writer.file = fopen(file_path, "wb");
+    if (!writer.file) {
+        fprintf(stderr, "ERROR: Failed to open trajectory file %s\n", file_path);
+        exit(1);
+    }
+
+    // Header is rewritten with the actual number of frames on close
+    TrajectoryHeader header = get_trajectory_header(0);
+    fwrite(&header, sizeof(header), 1, writer.file);
+
+    return writer;
+}
+
+void trajectory_writer_push(TrajectoryWriter *writer, TrajectoryFrame frame) {
+    if (fwrite(&frame, sizeof(frame), 1, writer->file) != 1) {
+        fprintf(stderr, "ERROR: Failed to write trajectory frame\n");
+        exit(1);
+    }
+    writer->n_frames += 1;
+}
+
+void trajectory_writer_close(TrajectoryWriter *writer) {
+    TrajectoryHeader header = get_trajectory_header(writer->n_frames);
+    fseek(writer->file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, writer->file);
+    fclose(writer->file);
+    writer->file = NULL;
+}
+
+TrajectoryReader trajectory_reader_open(const char *file_path) {
+    TrajectoryReader reader = {0};
+
+    int fd = open(file_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "ERROR: Failed to open trajectory file %s\n", file_path);
+        exit(1);
+    }
+    if ((size_t)st.st_size < sizeof(TrajectoryHeader)) {
+        fprintf(stderr, "ERROR: Trajectory file %s is too small\n", file_path);
+        exit(1);
+    }
+
+    reader.size = st.st_size;
+    reader.data = mmap(NULL, reader.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (reader.data == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Failed to map trajectory file %s\n", file_path);
+        exit(1);
+    }
+
+    // -------------------------------------------------------------------
+    // Validate the header
+    const TrajectoryHeader *header = reader.data;
+    size_t frames_size = reader.size - sizeof(TrajectoryHeader);
+    if (memcmp(header->magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0
+        || header->version != TRAJECTORY_VERSION
+        || header->frame_size != sizeof(TrajectoryFrame) || header->n_frames <= 0
+        || (size_t)header->n_frames * sizeof(TrajectoryFrame) > frames_size) {
+        fprintf(stderr, "ERROR: Trajectory file %s is invalid\n", file_path);
+        exit(1);
+    }
+
+    reader.frames = (const TrajectoryFrame *)(header + 1);
+    reader.n_frames = header->n_frames;
+
+    return reader;
+}
+
+void trajectory_reader_close(TrajectoryReader *reader) {
+    munmap(reader->data, reader->size);
+    *reader = (TrajectoryReader){0};
+}
+
+TrajectoryFrame trajectory_reader_get_frame(TrajectoryReader reader, int frame) {
+    // Replay loops over the trajectory
+    return reader.frames[frame % reader.n_frames];
+}
+
+FrameInput get_frame_input_of_trajectory_frame(TrajectoryFrame frame) {
+    Camera3D camera = {0};
+    camera.fovy = frame.fovy;
+    camera.up = (Vector3){0.0, 1.0, 0.0};
+    camera.position = frame.translation;
+    Vector3 dir = Vector3RotateByQuaternion((Vector3){0.0, 0.0, -1.0}, frame.rotation);
+    camera.target = Vector3Add(camera.position, dir);
+    camera.projection = CAMERA_PERSPECTIVE;
+
+    FrameInput input = {
+        .camera = camera,
+        .aspect = frame.aspect,
+        .n_planes = frame.n_planes,
+        .light_direction = get_direction_from_azimuth_attitude(
+            frame.light_azimuth, frame.light_attitude
+        )};
+    memcpy(input.planes, frame.planes, sizeof(input.planes));
+
+    return input;
+}
+
+TrajectoryFrame get_orbit_trajectory_frame(int frame, int n_frames) {
+    // The camera orbits around the origin while looking slightly downwards
+    // and the light sweeps its azimuth, so every frame gets new cascades.
+    // Azimuths in (180, 360) give light directions with negative y
+    float t = (float)frame / n_frames;
+    float angle = 2.0 * PI * t;
+
+    Vector3 position = {10.0 * cosf(angle), 3.0, 10.0 * sinf(angle)};
+    Vector3 dir = Vector3Normalize(Vector3Subtract((Vector3){0.0, 1.0, 0.0}, position));
+
+    TrajectoryFrame trajectory_frame = {
+        .translation = position,
+        .rotation = QuaternionFromVector3ToVector3((Vector3){0.0, 0.0, -1.0}, dir),
+        .fovy = 40.0 + 20.0 * sinf(4.0 * angle),
+        .aspect = 4.0 / 3.0,
+        .light_azimuth = 181.0 + 178.0 * t,
+        .light_attitude = 45.0,
+        .n_planes = 4,
+        .planes = {0.01, 2.0, 4.0, 16.0}};
+
+    return trajectory_frame;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFTRAJECTORY_H
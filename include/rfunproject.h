@@ -0,0 +1,206 @@
+#ifndef RFUNPROJECT_H
+#define RFUNPROJECT_H
+
+#include "rayfrustum.h"
+#include "rfjobs.h"
+#include "rfsimd.h"
+
+// Batched unprojection of the depth images into world (or any other) space.
+//
+// Unlike Vector3Unproject, which builds and inverts view * proj for every
+// point, the combined matrix to_space * inverse(view * proj) is computed once
+// per image, and the rows are processed 4 pixels at a time with the SIMD
+// vector extensions. The image is split into the row tiles which run on the
+// job pool.
+//
+// Depth image conventions (as read back from GL):
+//     - rows go bottom to top, the sample is taken at the pixel center
+//     - depth is the window-space depth in [0, 1] (the default depth range)
+//     - DEPTH_FORMAT_UINT24_8 is the packed depth-stencil format, depth is in
+//       the upper 24 bits of each 32-bit word
+// Samples with depth >= 1 (cleared background) are unprojected too, but they
+// are skipped by the bounds reduction.
+
+#define UNPROJECT_MAX_N_TILES 256
+#define UNPROJECT_MIN_TILE_HEIGHT 8
+
+typedef enum DepthFormat {
+    DEPTH_FORMAT_FLOAT32,
+    DEPTH_FORMAT_UINT24_8,
+} DepthFormat;
+
+typedef struct DepthImage {
+    const void *data;
+    int width;
+    int height;
+    DepthFormat format;
+} DepthImage;
+
+// Unprojects the depth image of the view/proj (as in Frustum) and transforms
+// the points by to_space (MatrixIdentity() for the world space, the light
+// view for the light space, etc).
+// points (width * height, row by row) and bounds are optional (could be NULL).
+// Returns the number of the non-background samples
+int unproject_depth_image(
+    DepthImage depth,
+    Matrix view,
+    Matrix proj,
+    Matrix to_space,
+    Vector3 *points,
+    BoundingBox *bounds,
+    JobPool *pool
+);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct UnprojectJob {
+    DepthImage depth;
+    // Rows of the combined (to_space * inverse(view * proj)) matrix
+    float m[4][4];
+    Vector3 *points;
+    int tile_height;
+
+    Vector3 tile_mins[UNPROJECT_MAX_N_TILES];
+    Vector3 tile_maxs[UNPROJECT_MAX_N_TILES];
+    int tile_n_samples[UNPROJECT_MAX_N_TILES];
+} UnprojectJob;
+
+static inline f32x4 load_depth_x4(DepthImage depth, int idx, int n) {
+    // Lanes past the row end (n < 4) are filled with the background depth
+    f32x4 d = {1.0, 1.0, 1.0, 1.0};
+    if (depth.format == DEPTH_FORMAT_FLOAT32) {
+        const float *src = (const float *)depth.data + idx;
+        for (int i = 0; i < n; ++i) d[i] = src[i];
+    } else {
+        const uint32_t *src = (const uint32_t *)depth.data + idx;
+        for (int i = 0; i < n; ++i) d[i] = (float)(src[i] >> 8) / 16777215.0f;
+    }
+    return d;
+}
+
+static void run_unproject_tile(void *ctx, int tile) {
+    UnprojectJob *job = ctx;
+    DepthImage depth = job->depth;
+    int row_begin = tile * job->tile_height;
+    int row_end = row_begin + job->tile_height;
+    if (row_end > depth.height) row_end = depth.height;
+
+    f32x4 mins[3], maxs[3];
+    for (int c = 0; c < 3; ++c) {
+        mins[c] = (f32x4){FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+        maxs[c] = (f32x4){-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+    }
+    i32x4 n_samples = {0};
+
+    const float(*m)[4] = job->m;
+    float dx = 2.0f / depth.width;
+    f32x4 lane_x = {
+        0.5f * dx - 1.0f, 1.5f * dx - 1.0f, 2.5f * dx - 1.0f, 3.5f * dx - 1.0f};
+    f32x4 one = {1.0, 1.0, 1.0, 1.0};
+
+    for (int y = row_begin; y < row_end; ++y) {
+        // -------------------------------------------------------------------
+        // Per row: p = m * (ndc_x, ndc_y, ndc_z, 1) = x_term + z_term + row_base
+        float ndc_y = (y + 0.5f) * (2.0f / depth.height) - 1.0f;
+        float row_base[4];
+        for (int c = 0; c < 4; ++c) row_base[c] = m[c][1] * ndc_y + m[c][3];
+
+        for (int x = 0; x < depth.width; x += 4) {
+            int idx = y * depth.width + x;
+            int n = depth.width - x < 4 ? depth.width - x : 4;
+
+            f32x4 d = load_depth_x4(depth, idx, n);
+            f32x4 ndc_x = lane_x + x * dx;
+            f32x4 ndc_z = d * 2.0f - 1.0f;
+
+            f32x4 p[4];
+            for (int c = 0; c < 4; ++c) {
+                p[c] = ndc_x * m[c][0] + ndc_z * m[c][2] + row_base[c];
+            }
+            f32x4 inv_w = one / p[3];
+            for (int c = 0; c < 3; ++c) p[c] *= inv_w;
+
+            // ---------------------------------------------------------------
+            // Bounds of the non-background samples
+            i32x4 is_sample = d < one;
+            n_samples -= is_sample;
+            for (int c = 0; c < 3; ++c) {
+                mins[c] = f32x4_select(is_sample, f32x4_min(mins[c], p[c]), mins[c]);
+                maxs[c] = f32x4_select(is_sample, f32x4_max(maxs[c], p[c]), maxs[c]);
+            }
+
+            if (job->points) {
+                Vector3 *dst = &job->points[idx];
+                for (int i = 0; i < n; ++i) dst[i] = (Vector3){p[0][i], p[1][i], p[2][i]};
+            }
+        }
+    }
+
+    job->tile_mins[tile] = (Vector3){
+        f32x4_reduce_min(mins[0]), f32x4_reduce_min(mins[1]), f32x4_reduce_min(mins[2])};
+    job->tile_maxs[tile] = (Vector3){
+        f32x4_reduce_max(maxs[0]), f32x4_reduce_max(maxs[1]), f32x4_reduce_max(maxs[2])};
+    job->tile_n_samples[tile] = n_samples[0] + n_samples[1] + n_samples[2] + n_samples[3];
+}
+
+int unproject_depth_image(
+    DepthImage depth,
+    Matrix view,
+    Matrix proj,
+    Matrix to_space,
+    Vector3 *points,
+    BoundingBox *bounds,
+    JobPool *pool
+) {
+    if (depth.width <= 0 || depth.height <= 0) {
+        fprintf(stderr, "ERROR: Depth image must not be empty\n");
+        exit(1);
+    }
+
+    // The job is too big for the stack of the worker-less callers
+    static _Thread_local UnprojectJob job;
+    job.depth = depth;
+    job.points = points;
+
+    Matrix inv = MatrixMultiply(MatrixInvert(MatrixMultiply(view, proj)), to_space);
+    float rows[4][4] = {
+        {inv.m0, inv.m4, inv.m8, inv.m12},
+        {inv.m1, inv.m5, inv.m9, inv.m13},
+        {inv.m2, inv.m6, inv.m10, inv.m14},
+        {inv.m3, inv.m7, inv.m11, inv.m15}};
+    memcpy(job.m, rows, sizeof(rows));
+
+    // -------------------------------------------------------------------
+    // Split into the row tiles: a few per thread for the load balancing
+    int n_tiles = 4 * job_pool_get_n_threads(pool);
+    if (n_tiles > UNPROJECT_MAX_N_TILES) n_tiles = UNPROJECT_MAX_N_TILES;
+    job.tile_height = (depth.height + n_tiles - 1) / n_tiles;
+    if (job.tile_height < UNPROJECT_MIN_TILE_HEIGHT) {
+        job.tile_height = UNPROJECT_MIN_TILE_HEIGHT;
+    }
+    n_tiles = (depth.height + job.tile_height - 1) / job.tile_height;
+
+    job_pool_run(pool, n_tiles, run_unproject_tile, &job);
+
+    // -------------------------------------------------------------------
+    // Reduce the tiles
+    int n_samples = 0;
+    Vector3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+    Vector3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int i = 0; i < n_tiles; ++i) {
+        n_samples += job.tile_n_samples[i];
+        min = Vector3Min(min, job.tile_mins[i]);
+        max = Vector3Max(max, job.tile_maxs[i]);
+    }
+    if (bounds) *bounds = (BoundingBox){min, max};
+
+    return n_samples;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFUNPROJECT_H
@@ -0,0 +1,351 @@
+#ifndef RFVSM_H
+#define RFVSM_H
+
+#include "rayfrustum.h"
+#include "rfjobs.h"
+#include "rfunproject.h"
+#include <stdint.h>
+
+// Page marking of the virtual shadow map of the directional light.
+//
+// The virtual shadow map is a huge (e.g. 16k x 16k) light-space texture split
+// into the pages of page_size texels, with the mip chain down to a single
+// page. It covers the square of extent world units around the center, in the
+// light space of get_frustum_of_directional_light (the light view rotation,
+// so the pages stay in place while the camera moves).
+//
+// Every frame the camera depth image is unprojected straight into the light
+// space (the per-row matrix terms of unproject_depth_image, fused with the
+// marking, so the samples are never stored), and each sample marks the page
+// it falls into at the mip which has the texel size right below the sample
+// pixel footprint (the pixel size at the sample view depth). Then the marked
+// pages are diffed against the resident ones of the previous frame: the new
+// pages go to the render list, the unmarked ones to the evict list. A change
+// of the light direction invalidates all pages.
+//
+// Page ids are the bit indices of the per-mip bitmaps, concatenated from the
+// finest mip (see get_virtual_shadow_page).
+//
+// All memory is allocated in virtual_shadow_map_load.
+
+#define VSM_MAX_N_MIPS 16
+#define VSM_MAX_N_TASKS 64
+
+typedef struct VirtualShadowPage {
+    int mip;
+    int x;
+    int y;
+} VirtualShadowPage;
+
+typedef struct VirtualShadowMap {
+    int resolution;
+    int page_size;
+    int n_mips;
+    float extent;
+    Vector3 center;
+
+    // Light direction and the view rotation of the marked pages
+    Vector3 light_direction;
+    Matrix light_rotation;
+
+    // Pages per side and the first page id of every mip
+    int n_mip_pages[VSM_MAX_N_MIPS];
+    int mip_offsets[VSM_MAX_N_MIPS + 1];
+    int n_pages;
+    int n_words;
+
+    // Bitmaps of the pages marked in this frame, the resident ones (marked in
+    // the previous frame) and the per-task ones
+    uint64_t *marked;
+    uint64_t *resident;
+    uint64_t *task_marked;
+
+    // Page ids to render and to evict in this frame
+    int *render_pages;
+    int n_render_pages;
+    int *evict_pages;
+    int n_evict_pages;
+} VirtualShadowMap;
+
+// resolution and page_size must be powers of two
+VirtualShadowMap virtual_shadow_map_load(
+    int resolution, int page_size, float extent, Vector3 center
+);
+void virtual_shadow_map_unload(VirtualShadowMap *vsm);
+
+// Depth image conventions are the ones of unproject_depth_image, view and proj
+// are the camera ones. Returns the number of the marked pages
+int mark_virtual_shadow_pages(
+    VirtualShadowMap *vsm,
+    DepthImage depth,
+    Matrix view,
+    Matrix proj,
+    Vector3 light_direction,
+    JobPool *pool
+);
+
+VirtualShadowPage get_virtual_shadow_page(const VirtualShadowMap *vsm, int page);
+
+// Orthographic frustum of the page to render its shadow map, near and far are
+// the distances along the light direction from the center
+Frustum get_virtual_shadow_page_frustum(
+    const VirtualShadowMap *vsm, int page, float near, float far
+);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct VsmMarkJob {
+    VirtualShadowMap *vsm;
+    DepthImage depth;
+    int tile_height;
+
+    // Rows of the NDC to the light space matrix (see UnprojectJob)
+    float m[4][4];
+
+    // Light-space center of the virtual texture
+    float center_x;
+    float center_y;
+
+    // Pixel footprint in the mip 0 texels: scale * view depth (perspective)
+    // or just scale (orthographic). View depth is m14 / (ndc_z + m10)
+    bool is_perspective;
+    float footprint_scale;
+    float m10;
+    float m14;
+} VsmMarkJob;
+
+static bool is_vsm_power_of_two(int x) {
+    return x > 0 && (x & (x - 1)) == 0;
+}
+
+VirtualShadowMap virtual_shadow_map_load(
+    int resolution, int page_size, float extent, Vector3 center
+) {
+    if (!is_vsm_power_of_two(resolution) || !is_vsm_power_of_two(page_size)
+        || page_size > resolution || extent <= 0.0) {
+        fprintf(
+            stderr,
+            "ERROR: Virtual shadow map resolution and page size must be powers of "
+            "two (the page size <= the resolution) and the extent must be positive\n"
+        );
+        exit(1);
+    }
+
+    VirtualShadowMap vsm = {
+        .resolution = resolution,
+        .page_size = page_size,
+        .extent = extent,
+        .center = center};
+
+    // Mips down to the single page
+    for (int side = resolution / page_size; side > 0 && vsm.n_mips < VSM_MAX_N_MIPS;
+         side /= 2) {
+        vsm.n_mip_pages[vsm.n_mips] = side;
+        vsm.mip_offsets[vsm.n_mips] = vsm.n_pages;
+        vsm.n_pages += side * side;
+        vsm.n_mips += 1;
+    }
+    vsm.mip_offsets[vsm.n_mips] = vsm.n_pages;
+    vsm.n_words = (vsm.n_pages + 63) / 64;
+
+    int n = vsm.n_words;
+    vsm.marked = calloc((2 + VSM_MAX_N_TASKS) * n, sizeof(uint64_t));
+    vsm.render_pages = malloc(sizeof(int) * 2 * vsm.n_pages);
+    if (!vsm.marked || !vsm.render_pages) {
+        fprintf(stderr, "ERROR: Failed to allocate virtual shadow map\n");
+        exit(1);
+    }
+    vsm.resident = vsm.marked + n;
+    vsm.task_marked = vsm.marked + 2 * n;
+    vsm.evict_pages = vsm.render_pages + vsm.n_pages;
+
+    return vsm;
+}
+
+void virtual_shadow_map_unload(VirtualShadowMap *vsm) {
+    free(vsm->marked);
+    free(vsm->render_pages);
+    *vsm = (VirtualShadowMap){0};
+}
+
+static void run_vsm_mark_tile(void *ctx, int task) {
+    VsmMarkJob *job = ctx;
+    VirtualShadowMap *vsm = job->vsm;
+    DepthImage depth = job->depth;
+    uint64_t *marked = &vsm->task_marked[task * vsm->n_words];
+    memset(marked, 0, sizeof(uint64_t) * vsm->n_words);
+
+    int row_begin = task * job->tile_height;
+    int row_end = row_begin + job->tile_height;
+    if (row_end > depth.height) row_end = depth.height;
+
+    const float(*m)[4] = job->m;
+    float dx = 2.0f / depth.width;
+    f32x4 lane_x = {
+        0.5f * dx - 1.0f, 1.5f * dx - 1.0f, 2.5f * dx - 1.0f, 3.5f * dx - 1.0f};
+    float inv_extent = 1.0f / vsm->extent;
+    for (int y = row_begin; y < row_end; ++y) {
+        // Per row: the light-space x, y and w terms of the NDC y (z is unused)
+        float ndc_y = (y + 0.5f) * (2.0f / depth.height) - 1.0f;
+        float row_x = m[0][1] * ndc_y + m[0][3];
+        float row_y = m[1][1] * ndc_y + m[1][3];
+        float row_w = m[3][1] * ndc_y + m[3][3];
+
+        for (int x = 0; x < depth.width; x += 4) {
+            int idx = y * depth.width + x;
+            int n = depth.width - x < 4 ? depth.width - x : 4;
+
+            // ---------------------------------------------------------------
+            // Mip of the footprint: floor(log2) is the float exponent
+            f32x4 d = load_depth_x4(depth, idx, n);
+            f32x4 footprint = f32x4_splat(job->footprint_scale);
+            if (job->is_perspective) footprint *= job->m14 / (d * 2.0f - 1.0f + job->m10);
+            i32x4 bits;
+            memcpy(&bits, &footprint, sizeof(bits));
+            i32x4 mips = ((bits >> 23) & 0xff) - 127;
+
+            // ---------------------------------------------------------------
+            // Virtual texture coordinates of the light-space samples
+            f32x4 ndc_x = lane_x + x * dx;
+            f32x4 ndc_z = d * 2.0f - 1.0f;
+            f32x4 inv_w = 1.0f / (ndc_x * m[3][0] + ndc_z * m[3][2] + row_w);
+            f32x4 u = (ndc_x * m[0][0] + ndc_z * m[0][2] + row_x) * inv_w;
+            f32x4 v = (ndc_x * m[1][0] + ndc_z * m[1][2] + row_y) * inv_w;
+            u = (u - job->center_x) * inv_extent + 0.5f;
+            v = (v - job->center_y) * inv_extent + 0.5f;
+            i32x4 is_inside = (d < 1.0f) & (u >= 0.0f) & (u < 1.0f) & (v >= 0.0f)
+                              & (v < 1.0f);
+            int mask = i32x4_get_mask(is_inside) & ((1 << n) - 1);
+
+            while (mask) {
+                int i = __builtin_ctz(mask);
+                mask &= mask - 1;
+
+                int mip = mips[i] < 0 ? 0 : mips[i];
+                mip = mip < vsm->n_mips ? mip : vsm->n_mips - 1;
+                int side = vsm->n_mip_pages[mip];
+                int page = vsm->mip_offsets[mip] + (int)(v[i] * side) * side
+                           + (int)(u[i] * side);
+                marked[page >> 6] |= 1ull << (page & 63);
+            }
+        }
+    }
+}
+
+int mark_virtual_shadow_pages(
+    VirtualShadowMap *vsm,
+    DepthImage depth,
+    Matrix view,
+    Matrix proj,
+    Vector3 light_direction,
+    JobPool *pool
+) {
+    if (depth.width <= 0 || depth.height <= 0) {
+        fprintf(stderr, "ERROR: Depth image must not be empty\n");
+        exit(1);
+    }
+
+    // -------------------------------------------------------------------
+    // The resident pages are valid only for the same light direction
+    light_direction = Vector3Normalize(light_direction);
+    bool is_light_changed = !Vector3Equals(light_direction, vsm->light_direction);
+    if (is_light_changed) {
+        vsm->light_direction = light_direction;
+        vsm->light_rotation = MatrixLookAt(
+            Vector3Zero(), light_direction, (Vector3){0.0, 1.0, 0.0}
+        );
+    }
+
+    // -------------------------------------------------------------------
+    // Per-task unprojection into the light space and the page marking
+    Matrix inv_view_proj = MatrixInvert(MatrixMultiply(view, proj));
+    Matrix inv = MatrixMultiply(inv_view_proj, vsm->light_rotation);
+    Vector3 center = Vector3Transform(vsm->center, vsm->light_rotation);
+    float texel_size = vsm->extent / vsm->resolution;
+    VsmMarkJob job = {
+        .vsm = vsm,
+        .depth = depth,
+        .center_x = center.x,
+        .center_y = center.y,
+        .is_perspective = proj.m15 == 0.0,
+        .footprint_scale = 2.0 / (proj.m5 * depth.height * texel_size),
+        .m10 = proj.m10,
+        .m14 = proj.m14};
+    float rows[4][4] = {
+        {inv.m0, inv.m4, inv.m8, inv.m12},
+        {inv.m1, inv.m5, inv.m9, inv.m13},
+        {inv.m2, inv.m6, inv.m10, inv.m14},
+        {inv.m3, inv.m7, inv.m11, inv.m15}};
+    memcpy(job.m, rows, sizeof(rows));
+
+    int n_tasks = 4 * job_pool_get_n_threads(pool);
+    if (n_tasks > VSM_MAX_N_TASKS) n_tasks = VSM_MAX_N_TASKS;
+    job.tile_height = (depth.height + n_tasks - 1) / n_tasks;
+    n_tasks = (depth.height + job.tile_height - 1) / job.tile_height;
+    job_pool_run(pool, n_tasks, run_vsm_mark_tile, &job);
+
+    // -------------------------------------------------------------------
+    // Reduce the tasks and diff against the resident pages
+    vsm->n_render_pages = 0;
+    vsm->n_evict_pages = 0;
+    int n_marked = 0;
+    for (int w = 0; w < vsm->n_words; ++w) {
+        uint64_t marked = 0;
+        for (int t = 0; t < n_tasks; ++t) {
+            marked |= vsm->task_marked[t * vsm->n_words + w];
+        }
+        uint64_t resident = vsm->resident[w];
+        uint64_t render = is_light_changed ? marked : marked & ~resident;
+        uint64_t evict = is_light_changed ? resident : resident & ~marked;
+
+        while (render) {
+            vsm->render_pages[vsm->n_render_pages++] = 64 * w + __builtin_ctzll(render);
+            render &= render - 1;
+        }
+        while (evict) {
+            vsm->evict_pages[vsm->n_evict_pages++] = 64 * w + __builtin_ctzll(evict);
+            evict &= evict - 1;
+        }
+
+        n_marked += __builtin_popcountll(marked);
+        vsm->marked[w] = marked;
+        vsm->resident[w] = marked;
+    }
+
+    return n_marked;
+}
+
+VirtualShadowPage get_virtual_shadow_page(const VirtualShadowMap *vsm, int page) {
+    int mip = 0;
+    while (mip + 1 < vsm->n_mips && vsm->mip_offsets[mip + 1] <= page) mip += 1;
+
+    int idx = page - vsm->mip_offsets[mip];
+    int side = vsm->n_mip_pages[mip];
+
+    return (VirtualShadowPage){mip, idx % side, idx / side};
+}
+
+Frustum get_virtual_shadow_page_frustum(
+    const VirtualShadowMap *vsm, int page, float near, float far
+) {
+    VirtualShadowPage p = get_virtual_shadow_page(vsm, page);
+    float page_extent = vsm->extent / vsm->n_mip_pages[p.mip];
+    float left = p.x * page_extent - 0.5 * vsm->extent;
+    float bottom = p.y * page_extent - 0.5 * vsm->extent;
+
+    Vector3 target = Vector3Add(vsm->center, vsm->light_direction);
+    Matrix view = MatrixLookAt(vsm->center, target, (Vector3){0.0, 1.0, 0.0});
+    Matrix proj = MatrixOrtho(
+        left, left + page_extent, bottom, bottom + page_extent, near, far
+    );
+
+    return get_frustum_of_view_proj(view, proj);
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFVSM_H
@@ -0,0 +1,300 @@
+#ifndef RFZBINS_H
+#define RFZBINS_H
+
+#include "rfclusters.h"
+#include "rfjobs.h"
+#include <stdint.h>
+
+// Z-binning: the low-memory alternative to the per-cluster light lists.
+//
+// Instead of a light list in every cluster (tiles * slices of them), the
+// lights are sorted by their view depth once and:
+//     - every depth slice of the grid (z-bin) stores the min and max sorted
+//       index of the lights it overlaps
+//     - every screen tile of the grid stores the bitmask of the sorted
+//       lights its column overlaps
+// The lights of a cluster are then the set bits of its tile mask between its
+// z-bin min and max. The memory is tiles * lights / 8 bytes for the masks plus
+// 8 bytes per z-bin, instead of the tiles * slices light lists.
+//
+// The result is conservative: a tile mask is built for the whole light depth
+// range and the cones of the spot lights are treated as their spheres, so a
+// query may return a few more lights than the clustered assignment.
+//
+// All memory is allocated in zbin_lights_load.
+
+typedef struct ZBinLights {
+    int n_tiles;
+    int n_bins;
+    int max_n_lights;
+    // Mask words of a single tile
+    int max_n_words;
+
+    // Lights within the grid depths, sorted by the view depth of their centers
+    int n_lights;
+    int *sorted_ids;
+
+    // Sorted index range of the lights of every z-bin (empty if min > max)
+    int *bin_min;
+    int *bin_max;
+
+    // Sorted light bits of the tiles: tile_masks[tile * max_n_words + word]
+    uint32_t *tile_masks;
+    int n_words;
+
+    // View depth ranges of the lights and their tile rectangles (in the
+    // sorted order)
+    float *near_depths;
+    float *far_depths;
+    int *tiles;
+
+    // Radix sort buffers
+    uint32_t *keys;
+    uint32_t *tmp_keys;
+    int *tmp_ids;
+
+    const ClusterGrid *grid;
+} ZBinLights;
+
+ZBinLights zbin_lights_load(const ClusterGrid *grid, int max_n_lights);
+void zbin_lights_unload(ZBinLights *zbin_lights);
+
+// Lights are in the world space, the view is the camera view of the grid
+void assign_lights_to_zbins(
+    ZBinLights *zbin_lights,
+    const ClusterGrid *grid,
+    Matrix view,
+    const Light *lights,
+    int n_lights,
+    JobPool *pool
+);
+
+// Same as get_cluster_lights_of_view_point
+int get_zbin_lights_of_view_point(
+    const ZBinLights *zbin_lights,
+    const ClusterGrid *grid,
+    Vector3 point,
+    int *light_ids,
+    int max_n_light_ids
+);
+
+#ifdef RAYFRUSTUM_IMPLEMENTATION
+#include "raymath.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ZBIN_RADIX_BITS 11
+#define ZBIN_RADIX_SIZE (1 << ZBIN_RADIX_BITS)
+
+ZBinLights zbin_lights_load(const ClusterGrid *grid, int max_n_lights) {
+    if (max_n_lights <= 0) {
+        fprintf(stderr, "ERROR: Max number of lights must be positive\n");
+        exit(1);
+    }
+
+    ZBinLights zl = {
+        .n_tiles = grid->n_x * grid->n_y,
+        .n_bins = grid->n_z,
+        .max_n_lights = max_n_lights,
+        .max_n_words = (max_n_lights + 31) / 32};
+    int n = max_n_lights;
+
+    zl.sorted_ids = malloc(sizeof(int) * n);
+    zl.bin_min = malloc(sizeof(int) * 2 * zl.n_bins);
+    zl.tile_masks = malloc(sizeof(uint32_t) * zl.n_tiles * zl.max_n_words);
+    zl.near_depths = malloc(sizeof(float) * 2 * n);
+    zl.tiles = malloc(sizeof(int) * 4 * n);
+    zl.keys = malloc(sizeof(uint32_t) * 2 * n);
+    zl.tmp_ids = malloc(sizeof(int) * n);
+    if (!zl.sorted_ids || !zl.bin_min || !zl.tile_masks || !zl.near_depths || !zl.tiles
+        || !zl.keys || !zl.tmp_ids) {
+        fprintf(stderr, "ERROR: Failed to allocate z-bin lights\n");
+        exit(1);
+    }
+    zl.bin_max = zl.bin_min + zl.n_bins;
+    zl.far_depths = zl.near_depths + n;
+    zl.tmp_keys = zl.keys + n;
+
+    return zl;
+}
+
+void zbin_lights_unload(ZBinLights *zbin_lights) {
+    free(zbin_lights->sorted_ids);
+    free(zbin_lights->bin_min);
+    free(zbin_lights->tile_masks);
+    free(zbin_lights->near_depths);
+    free(zbin_lights->tiles);
+    free(zbin_lights->keys);
+    free(zbin_lights->tmp_ids);
+    *zbin_lights = (ZBinLights){0};
+}
+
+static void sort_zbin_lights(ZBinLights *zl) {
+    // LSD radix sort of the depth keys (3 passes of 11 bits), the order of
+    // the equal depths is kept
+    int n = zl->n_lights;
+    uint32_t *keys = zl->keys, *tmp_keys = zl->tmp_keys;
+    int *ids = zl->sorted_ids, *tmp_ids = zl->tmp_ids;
+    for (int shift = 0; shift < 32; shift += ZBIN_RADIX_BITS) {
+        int offsets[ZBIN_RADIX_SIZE] = {0};
+        for (int i = 0; i < n; ++i) {
+            offsets[(keys[i] >> shift) & (ZBIN_RADIX_SIZE - 1)] += 1;
+        }
+        for (int i = 0, sum = 0; i < ZBIN_RADIX_SIZE; ++i) {
+            int count = offsets[i];
+            offsets[i] = sum;
+            sum += count;
+        }
+        for (int i = 0; i < n; ++i) {
+            int j = offsets[(keys[i] >> shift) & (ZBIN_RADIX_SIZE - 1)]++;
+            tmp_keys[j] = keys[i];
+            tmp_ids[j] = ids[i];
+        }
+
+        uint32_t *k = keys;
+        keys = tmp_keys;
+        tmp_keys = k;
+        int *d = ids;
+        ids = tmp_ids;
+        tmp_ids = d;
+    }
+
+    // Odd number of passes ends up in the tmp buffers
+    if (ids != zl->sorted_ids) memcpy(zl->sorted_ids, ids, sizeof(int) * n);
+}
+
+static void build_zbin_tile_row(void *ctx, int y) {
+    ZBinLights *zl = ctx;
+    int n_x = zl->grid->n_x;
+    uint32_t *row = &zl->tile_masks[y * n_x * zl->max_n_words];
+    for (int x = 0; x < n_x; ++x) {
+        memset(&row[x * zl->max_n_words], 0, sizeof(uint32_t) * zl->n_words);
+    }
+
+    for (int s = 0; s < zl->n_lights; ++s) {
+        const int *tiles = &zl->tiles[4 * s];
+        if (y < tiles[1] || y > tiles[3]) continue;
+
+        uint32_t bit = 1u << (s & 31);
+        uint32_t *mask = &row[tiles[0] * zl->max_n_words + (s >> 5)];
+        for (int x = tiles[0]; x <= tiles[2]; ++x, mask += zl->max_n_words) *mask |= bit;
+    }
+}
+
+void assign_lights_to_zbins(
+    ZBinLights *zbin_lights,
+    const ClusterGrid *grid,
+    Matrix view,
+    const Light *lights,
+    int n_lights,
+    JobPool *pool
+) {
+    ZBinLights *zl = zbin_lights;
+    if (n_lights > zl->max_n_lights || grid->n_x * grid->n_y != zl->n_tiles
+        || grid->n_z != zl->n_bins || !grid->is_built) {
+        fprintf(
+            stderr,
+            "ERROR: Number of lights must be <= %d and the cluster grid must be "
+            "built and of the same size as the z-bin lights\n",
+            zl->max_n_lights
+        );
+        exit(1);
+    }
+    zl->grid = grid;
+
+    // -------------------------------------------------------------------
+    // Sort the lights within the grid depths by the view depth. The key of
+    // a positive float is its bits, the negative ones are flipped
+    int n = 0;
+    for (int i = 0; i < n_lights; ++i) {
+        float depth = -Vector3Transform(lights[i].position, view).z;
+        float range = lights[i].range;
+        if (depth + range < grid->near || depth - range > grid->far) continue;
+
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        zl->keys[n] = bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+        zl->sorted_ids[n++] = i;
+    }
+    zl->n_lights = n;
+    zl->n_words = (n + 31) / 32;
+    sort_zbin_lights(zl);
+
+    // -------------------------------------------------------------------
+    // Z-bin ranges and the tile rectangles of the sorted lights
+    for (int z = 0; z < zl->n_bins; ++z) {
+        zl->bin_min[z] = n;
+        zl->bin_max[z] = -1;
+    }
+    for (int s = 0; s < n; ++s) {
+        Light light = lights[zl->sorted_ids[s]];
+        Vector3 p = Vector3Transform(light.position, view);
+        float near_depth = fmaxf(-p.z - light.range, grid->near);
+        float far_depth = fminf(-p.z + light.range, grid->far);
+        zl->near_depths[s] = near_depth;
+        zl->far_depths[s] = far_depth;
+
+        int *tiles = &zl->tiles[4 * s];
+        if (!get_light_tiles(grid, p.x, p.y, light.range, near_depth, far_depth, tiles)) {
+            // Empty rectangle: the light is off the screen
+            tiles[0] = tiles[1] = 0;
+            tiles[2] = tiles[3] = -1;
+            continue;
+        }
+
+        int z0 = get_cluster_slice(grid, near_depth);
+        int z1 = get_cluster_slice(grid, far_depth);
+        for (int z = z0; z <= z1; ++z) {
+            zl->bin_min[z] = s < zl->bin_min[z] ? s : zl->bin_min[z];
+            zl->bin_max[z] = s > zl->bin_max[z] ? s : zl->bin_max[z];
+        }
+    }
+
+    // -------------------------------------------------------------------
+    // Tile masks, every tile row is a task
+    job_pool_run(pool, grid->n_y, build_zbin_tile_row, zl);
+}
+
+int get_zbin_lights_of_view_point(
+    const ZBinLights *zbin_lights,
+    const ClusterGrid *grid,
+    Vector3 point,
+    int *light_ids,
+    int max_n_light_ids
+) {
+    const ZBinLights *zl = zbin_lights;
+    int c = get_cluster_of_view_point(grid, point);
+    if (c < 0) return 0;
+
+    int tile = c % zl->n_tiles;
+    int z = c / zl->n_tiles;
+    int min = zl->bin_min[z];
+    int max = zl->bin_max[z];
+    if (min > max) return 0;
+    float bin_near = grid->planes[z];
+    float bin_far = grid->planes[z + 1];
+
+    // Words of the z-bin range, the first and the last one are trimmed
+    const uint32_t *mask = &zl->tile_masks[tile * zl->max_n_words];
+    int n = 0;
+    for (int w = min >> 5; w <= max >> 5 && n < max_n_light_ids; ++w) {
+        uint32_t bits = mask[w];
+        if (w == min >> 5) bits &= ~0u << (min & 31);
+        if (w == max >> 5) bits &= ~0u >> (31 - (max & 31));
+        while (bits && n < max_n_light_ids) {
+            int s = (w << 5) + __builtin_ctz(bits);
+            bits &= bits - 1;
+
+            // Lights between the ones of the z-bin may not overlap it
+            if (zl->far_depths[s] < bin_near || zl->near_depths[s] > bin_far) continue;
+            light_ids[n++] = zl->sorted_ids[s];
+        }
+    }
+
+    return n;
+}
+
+#endif  // RAYFRUSTUM_IMPLEMENTATION
+#endif  // RFZBINS_H